@@ -5,11 +5,20 @@ HEADERS = \
         src/version.hpp \
         src/alloc.hpp \
         src/color.hpp \
+        src/diskcache.hpp \
         src/colormap.hpp \
         src/file.hpp \
+        src/prober.hpp \
+        src/mappedimport.hpp \
         src/frame.hpp \
         src/gl.hpp \
         src/histogram.hpp \
+        src/quantiles.hpp \
+        src/recentframes.hpp \
+        src/seekindex.hpp \
+        src/lightness.hpp \
+        src/loader.hpp \
+        src/memorybudget.hpp \
         src/overlay-fallback.hpp \
         src/overlay-info.hpp \
         src/overlay-value.hpp \
@@ -19,17 +28,30 @@ HEADERS = \
         src/overlay.hpp \
         src/parameters.hpp \
         src/qv.hpp \
+        src/quadtree.hpp \
         src/set.hpp \
         src/statistic.hpp \
+        src/threadpool.hpp \
+        src/valuecounts.hpp \
+        src/aggregates.hpp \
         src/gui.hpp
 
 SOURCES = \
         src/alloc.cpp \
         src/colormap.cpp \
+        src/diskcache.cpp \
         src/file.cpp \
+        src/prober.cpp \
+        src/mappedimport.cpp \
         src/frame.cpp \
         src/gl.cpp \
         src/histogram.cpp \
+        src/quantiles.cpp \
+        src/recentframes.cpp \
+        src/seekindex.cpp \
+        src/lightness.cpp \
+        src/loader.cpp \
+        src/memorybudget.cpp \
         src/overlay-fallback.cpp \
         src/overlay-info.cpp \
         src/overlay-value.cpp \
@@ -39,8 +61,12 @@ SOURCES = \
         src/overlay.cpp \
         src/parameters.cpp \
         src/qv.cpp \
+        src/quadtree.cpp \
         src/set.cpp \
         src/statistic.cpp \
+        src/threadpool.cpp \
+        src/valuecounts.cpp \
+        src/aggregates.cpp \
         src/gui.cpp \
         src/main.cpp
 
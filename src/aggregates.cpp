@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "aggregates.hpp"
+
+
+/* Count the finite values of one component of a rectangle of the array in
+ * the given bins */
+template<typename T>
+static void countBins(const TGD::ArrayContainer& array, size_t c,
+        size_t x, size_t y, size_t w, size_t h,
+        float minVal, float maxVal, unsigned long long* bins)
+{
+    size_t width = array.dimension(0);
+    size_t cc = array.componentCount();
+    const T* data = static_cast<const T*>(array.data());
+    for (size_t row = y; row < y + h; row++) {
+        const T* rowData = data + (row * width + x) * cc;
+        for (size_t e = 0; e < w; e++) {
+            T val = rowData[e * cc + c];
+            if (std::isfinite(val))
+                bins[Histogram::binIndex(val, minVal, maxVal, Aggregates::binCount)]++;
+        }
+    }
+}
+
+static void countBins(const TGD::ArrayContainer& array, size_t c,
+        size_t x, size_t y, size_t w, size_t h,
+        float minVal, float maxVal, unsigned long long* bins)
+{
+    switch (array.componentType()) {
+    case TGD::int8:
+        countBins<int8_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::uint8:
+        countBins<uint8_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::int16:
+        countBins<int16_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::uint16:
+        countBins<uint16_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::int32:
+        countBins<int32_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::uint32:
+        countBins<uint32_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::int64:
+        countBins<int64_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::uint64:
+        countBins<uint64_t>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::float32:
+        countBins<float>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    case TGD::float64:
+        countBins<double>(array, c, x, y, w, h, minVal, maxVal, bins);
+        break;
+    }
+}
+
+Aggregates::Aggregates() :
+    _width(0), _height(0),
+    _cellWidth(1), _cellHeight(1),
+    _componentIndex(0),
+    _histMinVal(0.0f), _histMaxVal(0.0f),
+    _computed(false)
+{
+}
+
+void Aggregates::init(int width, int height, int cellWidth, int cellHeight, size_t componentIndex,
+        float histMinVal, float histMaxVal)
+{
+    _width = width;
+    _height = height;
+    _cellWidth = cellWidth;
+    _cellHeight = cellHeight;
+    _componentIndex = componentIndex;
+    _histMinVal = histMinVal;
+    _histMaxVal = histMaxVal;
+    _levels.clear();
+    _computed = false;
+    int cellsX = (width + cellWidth - 1) / cellWidth;
+    int cellsY = (height + cellHeight - 1) / cellHeight;
+    for (;;) {
+        Level level;
+        level.cellsX = cellsX;
+        level.cellsY = cellsY;
+        _levels.push_back(level);
+        if (cellsX == 1 && cellsY == 1)
+            break;
+        cellsX = (cellsX + 1) / 2;
+        cellsY = (cellsY + 1) / 2;
+    }
+}
+
+void Aggregates::compute(const CellSource& source, const std::function<bool ()>& stop)
+{
+    for (size_t l = 0; l < _levels.size(); l++) {
+        Level& L = _levels[l];
+        L.statistics.assign(size_t(L.cellsX) * L.cellsY, Statistic());
+        L.bins.assign(size_t(L.cellsX) * L.cellsY * binCount, 0);
+    }
+
+    // Level 0 from the data. Without a histogram range, the statistics of
+    // all cells are needed before the bins can be counted.
+    Level& L0 = _levels[0];
+    bool knownRange = std::isfinite(_histMinVal) && std::isfinite(_histMaxVal);
+    std::vector<TGD::ArrayContainer> arrays(L0.cellsX);
+    std::vector<size_t> xs(L0.cellsX), ys(L0.cellsX);
+    for (int pass = (knownRange ? 1 : 0); pass < 2; pass++) {
+        if (pass == 1 && !knownRange) {
+            Statistic all;
+            for (size_t ci = 0; ci < L0.statistics.size(); ci++)
+                all.merge(L0.statistics[ci]);
+            if (!std::isfinite(_histMinVal))
+                _histMinVal = all.minVal();
+            if (!std::isfinite(_histMaxVal))
+                _histMaxVal = all.maxVal();
+        }
+        for (int cy = 0; cy < L0.cellsY; cy++) {
+            if (stop && stop())
+                return;
+            // get the data of a row of cells first since the source is not thread-safe
+            for (int cx = 0; cx < L0.cellsX; cx++)
+                arrays[cx] = source(cx, cy, xs[cx], ys[cx]);
+            #pragma omp parallel for schedule(dynamic)
+            for (int cx = 0; cx < L0.cellsX; cx++) {
+                size_t ci = size_t(cy) * L0.cellsX + cx;
+                if (pass == 0 || knownRange)
+                    L0.statistics[ci].add(arrays[cx], _componentIndex, xs[cx], ys[cx], cellWidthOf(0, cx), cellHeightOf(0, cy));
+                if (pass == 1)
+                    countBins(arrays[cx], _componentIndex, xs[cx], ys[cx], cellWidthOf(0, cx), cellHeightOf(0, cy),
+                            _histMinVal, _histMaxVal, L0.bins.data() + ci * binCount);
+            }
+        }
+    }
+    // Coarser levels from the 2x2 cells below
+    for (size_t l = 1; l < _levels.size(); l++) {
+        const Level& F = _levels[l - 1];
+        Level& L = _levels[l];
+        #pragma omp parallel for schedule(dynamic)
+        for (int cy = 0; cy < L.cellsY; cy++) {
+            for (int cx = 0; cx < L.cellsX; cx++) {
+                size_t ci = size_t(cy) * L.cellsX + cx;
+                for (int fy = 2 * cy; fy < std::min(2 * cy + 2, F.cellsY); fy++) {
+                    for (int fx = 2 * cx; fx < std::min(2 * cx + 2, F.cellsX); fx++) {
+                        size_t fi = size_t(fy) * F.cellsX + fx;
+                        L.statistics[ci].merge(F.statistics[fi]);
+                        for (int b = 0; b < binCount; b++)
+                            L.bins[ci * binCount + b] += F.bins[fi * binCount + b];
+                    }
+                }
+            }
+        }
+    }
+    _computed = true;
+}
+
+/* Merge the aggregates of the given cell if the rectangle covers it
+ * completely, otherwise descend to its children, or collect the covered part
+ * of a level 0 cell */
+void Aggregates::collect(int level, int cx, int cy, int x, int y, int w, int h, const CellSource& source,
+        Statistic& statistic, std::vector<unsigned long long>& bins, std::vector<Part>& parts) const
+{
+    int cellX0 = cellX(level, cx);
+    int cellY0 = cellY(level, cy);
+    int cellX1 = cellX0 + cellWidthOf(level, cx);
+    int cellY1 = cellY0 + cellHeightOf(level, cy);
+    int x0 = std::max(x, cellX0);
+    int y0 = std::max(y, cellY0);
+    int x1 = std::min(x + w, cellX1);
+    int y1 = std::min(y + h, cellY1);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    const Level& L = _levels[level];
+    if (_computed && x0 == cellX0 && x1 == cellX1 && y0 == cellY0 && y1 == cellY1) {
+        size_t ci = size_t(cy) * L.cellsX + cx;
+        statistic.merge(L.statistics[ci]);
+        for (int b = 0; b < binCount; b++)
+            bins[b] += L.bins[ci * binCount + b];
+    } else if (level > 0) {
+        const Level& F = _levels[level - 1];
+        for (int fy = 2 * cy; fy < std::min(2 * cy + 2, F.cellsY); fy++)
+            for (int fx = 2 * cx; fx < std::min(2 * cx + 2, F.cellsX); fx++)
+                collect(level - 1, fx, fy, x, y, w, h, source, statistic, bins, parts);
+    } else {
+        Part part;
+        part.array = source(cx, cy, part.x, part.y);
+        part.x += x0 - cellX0;
+        part.y += y0 - cellY0;
+        part.w = x1 - x0;
+        part.h = y1 - y0;
+        parts.push_back(part);
+    }
+}
+
+void Aggregates::region(int x, int y, int w, int h, const CellSource& source,
+        Statistic& statistic, Histogram& histogram) const
+{
+    statistic = Statistic();
+    std::vector<unsigned long long> bins(binCount, 0);
+    std::vector<Part> parts;
+    if (w > 0 && h > 0) {
+        const Level& top = _levels.back();
+        for (int cy = 0; cy < top.cellsY; cy++)
+            for (int cx = 0; cx < top.cellsX; cx++)
+                collect(_levels.size() - 1, cx, cy, x, y, w, h, source, statistic, bins, parts);
+    }
+    std::vector<Statistic> partStatistics(parts.size());
+    std::vector<unsigned long long> partBins(parts.size() * binCount, 0);
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < parts.size(); i++) {
+        const Part& p = parts[i];
+        partStatistics[i].add(p.array, _componentIndex, p.x, p.y, p.w, p.h);
+        countBins(p.array, _componentIndex, p.x, p.y, p.w, p.h,
+                _histMinVal, _histMaxVal, partBins.data() + i * binCount);
+    }
+    for (size_t i = 0; i < parts.size(); i++) {
+        statistic.merge(partStatistics[i]);
+        for (int b = 0; b < binCount; b++)
+            bins[b] += partBins[i * binCount + b];
+    }
+    statistic.finish();
+    histogram.init(_histMinVal, _histMaxVal, bins);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_AGGREGATES_HPP
+#define QV_AGGREGATES_HPP
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#include <tgd/array.hpp>
+
+#include "statistic.hpp"
+#include "histogram.hpp"
+
+
+/* Mergeable aggregates of one component of the data for each cell of a
+ * regular grid, e.g. the level 0 quads of a frame: the statistic accumulators
+ * (count, min, max, mean, M2) and a coarse histogram. Like the quadtree, the
+ * cells form a pyramid: each coarser level merges 2x2 cells of the level below
+ * until a single cell remains. The statistic and histogram of a rectangle are
+ * merged from the coarsest cells that it covers completely, so that their
+ * number grows with the perimeter instead of the area of the rectangle, and
+ * only the values in the level 0 cells that it covers partially are looked at
+ * again. Computing the aggregates is separate from setting up the grid, so
+ * that it can happen in the background; until then, region() looks at all
+ * values of the rectangle. */
+class Aggregates {
+public:
+    // Returns the array that holds the data of a cell and sets the position
+    // of the cell in it. Only called from one thread at a time.
+    typedef std::function<TGD::ArrayContainer (int cx, int cy, size_t& x, size_t& y)> CellSource;
+
+    static constexpr int binCount = 256;
+
+private:
+    struct Level {
+        int cellsX, cellsY;
+        std::vector<Statistic> statistics;    // per cell, not finished
+        std::vector<unsigned long long> bins; // per cell
+    };
+    struct Part {
+        TGD::ArrayContainer array;
+        size_t x, y, w, h;
+    };
+
+    int _width, _height;
+    int _cellWidth, _cellHeight;
+    size_t _componentIndex;
+    float _histMinVal, _histMaxVal;
+    std::vector<Level> _levels; // level 0 has the cells of the grid
+    bool _computed;
+
+    // Position and size of a cell of the given level
+    int cellX(int level, int cx) const { return cx * (_cellWidth << level); }
+    int cellY(int level, int cy) const { return cy * (_cellHeight << level); }
+    int cellWidthOf(int level, int cx) const { return std::min(_cellWidth << level, _width - cellX(level, cx)); }
+    int cellHeightOf(int level, int cy) const { return std::min(_cellHeight << level, _height - cellY(level, cy)); }
+
+    void collect(int level, int cx, int cy, int x, int y, int w, int h, const CellSource& source,
+            Statistic& statistic, std::vector<unsigned long long>& bins, std::vector<Part>& parts) const;
+
+public:
+    Aggregates();
+
+    // Set up the grid. The histograms of the cells use the given range; if
+    // it is not finite, compute() determines it from the data.
+    void init(int width, int height, int cellWidth, int cellHeight, size_t componentIndex,
+            float histMinVal, float histMaxVal);
+    // Compute the aggregates of all cells. Returns early, without result,
+    // as soon as the optional stop function returns true.
+    void compute(const CellSource& source, const std::function<bool ()>& stop = std::function<bool ()>());
+    bool initialized() const { return _levels.size() > 0; }
+    bool computed() const { return _computed; }
+    void reset() { *this = Aggregates(); }
+
+    float histMinVal() const { return _histMinVal; }
+    float histMaxVal() const { return _histMaxVal; }
+
+    // Statistic and histogram (with binCount bins) of the given rectangle.
+    // The source must provide the same data as for compute(). Without
+    // compute(), the histogram range given to init() must be finite.
+    void region(int x, int y, int w, int h, const CellSource& source,
+            Statistic& statistic, Histogram& histogram) const;
+};
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* A benchmark for the data processing kernels that qv runs on whole frames:
+ * the 2x2 reduction of the quadtree levels, the lightness computation
+ * (compared to the scalar per-pixel conversion it replaced), and the single
+ * pass statistics and histograms. It uses synthetic data and is
+ * only built if QV_BENCHMARK is enabled in CMake.
+ *
+ * Usage: qv-benchmark [WIDTH HEIGHT] */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <type_traits>
+
+#include <tgd/array.hpp>
+
+#include "alloc.hpp"
+#include "diskcache.hpp"
+#include "memorybudget.hpp"
+#include "threadpool.hpp"
+#include "color.hpp"
+#include "quadtree.hpp"
+#include "lightness.hpp"
+#include "statistic.hpp"
+#include "histogram.hpp"
+
+
+/* Fill the array with noise plus a gradient, so that the data is neither
+ * constant nor entirely random */
+static void fill(TGD::ArrayContainer& array)
+{
+    uint32_t state = 12345;
+    size_t w = array.dimension(0);
+    for (size_t e = 0; e < array.elementCount(); e++) {
+        float gradient = float(e % w) / w;
+        for (size_t c = 0; c < array.componentCount(); c++) {
+            state = state * 1664525u + 1013904223u;
+            float v = 0.75f * gradient + 0.25f * float(state >> 8) / float(1 << 24);
+            switch (array.componentType()) {
+            case TGD::uint8:
+                array.set<uint8_t>(e, c, v * 255.0f + 0.5f);
+                break;
+            case TGD::uint16:
+                array.set<uint16_t>(e, c, v * 65535.0f + 0.5f);
+                break;
+            default:
+                array.set<float>(e, c, v);
+                break;
+            }
+        }
+    }
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const std::string& what, const TGD::ArrayContainer& array, double s)
+{
+    std::printf("%-36s %8.3f s %8.2f GB/s\n", what.c_str(), s, array.dataSize() / s / 1e9);
+}
+
+static std::string describe(const TGD::ArrayContainer& array)
+{
+    return TGD::typeToString(array.componentType()) + " x" + std::to_string(array.componentCount());
+}
+
+static void benchmarkQuadTree(const TGD::ArrayContainer& array, bool s)
+{
+    // the quad geometry that Frame uses for frames that need more than one texture
+    int borderSize = 1;
+    std::vector<size_t> quadDims(2, 1022 + 2 * borderSize);
+    std::vector<int> channels;
+    bool isS[4] = { false, false, false, false };
+    for (size_t c = 0; c < array.componentCount(); c++) {
+        channels.push_back(c);
+        isS[c] = s;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<QuadTree> quadTree = std::make_shared<QuadTree>(array, channels,
+            TGD::ArrayDescription(quadDims, channels.size(), array.componentType()),
+            borderSize, isS);
+    // the top level quad depends on all other levels
+    quadTree->waitFor({ { quadTree->levels() - 1, 0, 0 } });
+    report("pyramid " + describe(array) + (s ? " sRGB" : ""), array, seconds(start));
+}
+
+/* The scalar per-pixel lightness conversion that Lightness used before it
+ * was rewritten with lookup tables and vectorizable loops, as a reference */
+
+template<typename T>
+static float referenceNormalize(T value)
+{
+    float normalizedValue = value;
+    if (std::is_integral<T>::value) {
+        float minVal = std::numeric_limits<T>::min();
+        float maxVal = std::numeric_limits<T>::max();
+        normalizedValue = (value - minVal) / (maxVal - minVal);
+    }
+    return normalizedValue;
+}
+
+template<typename T>
+static void referenceLightnessHelper(float* lightness, const TGD::ArrayContainer& array, ColorSpace colorSpace)
+{
+    const T* data = static_cast<const T*>(array.data());
+    size_t w = array.dimension(0);
+    size_t h = array.dimension(1);
+    size_t cc = array.componentCount();
+    #pragma omp parallel for
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+            size_t e = y * w + x;
+            const T* v = data + e * cc;
+            float l = 0.0f;
+            switch (colorSpace) {
+            case ColorSpaceNone:
+                break;
+            case ColorSpaceLinearGray:
+                l = rgbToL(referenceNormalize(v[0]), referenceNormalize(v[0]), referenceNormalize(v[0]));
+                break;
+            case ColorSpaceLinearRGB:
+                l = rgbToL(referenceNormalize(v[0]), referenceNormalize(v[1]), referenceNormalize(v[2]));
+                break;
+            case ColorSpaceSGray:
+                {
+                    float g = toLinear(referenceNormalize(v[0]));
+                    l = rgbToL(g, g, g);
+                }
+                break;
+            case ColorSpaceSRGB:
+                l = rgbToL(toLinear(referenceNormalize(v[0])), toLinear(referenceNormalize(v[1])),
+                        toLinear(referenceNormalize(v[2])));
+                break;
+            case ColorSpaceY:
+            case ColorSpaceXYZ:
+                {
+                    float Y = referenceNormalize(v[colorSpace == ColorSpaceY ? 0 : 1]);
+                    if (std::is_integral<T>::value)
+                        Y *= 100.0f;
+                    l = YToL(Y);
+                }
+                break;
+            }
+            lightness[e] = l;
+        }
+    }
+}
+
+static void referenceLightness(float* lightness, const TGD::ArrayContainer& array, ColorSpace colorSpace)
+{
+    switch (array.componentType()) {
+    case TGD::uint8:
+        referenceLightnessHelper<uint8_t>(lightness, array, colorSpace);
+        break;
+    case TGD::uint16:
+        referenceLightnessHelper<uint16_t>(lightness, array, colorSpace);
+        break;
+    default:
+        referenceLightnessHelper<float>(lightness, array, colorSpace);
+        break;
+    }
+}
+
+static void benchmarkLightness(const TGD::ArrayContainer& array, ColorSpace colorSpace, const char* name)
+{
+    std::vector<float> reference(array.elementCount());
+    auto start = std::chrono::steady_clock::now();
+    referenceLightness(reference.data(), array, colorSpace);
+    double referenceSeconds = seconds(start);
+    report("lightness " + describe(array) + ' ' + name + " (old)", array, referenceSeconds);
+
+    int colorChannels[3] = { 0, 1, 2 };
+    start = std::chrono::steady_clock::now();
+    Lightness lightness;
+    lightness.init(array, colorSpace, colorChannels, false, FrameCache());
+    lightness.forEachTile([](const TGD::ArrayContainer&) {});
+    double newSeconds = seconds(start);
+    report("lightness " + describe(array) + ' ' + name, array, newSeconds);
+    std::printf("%-36s %8.2fx\n", "  speedup", referenceSeconds / newSeconds);
+}
+
+static void benchmarkStatistics(const TGD::ArrayContainer& array)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Statistic> statistics(array.componentCount());
+    Statistic::init(array, statistics);
+    report("statistics " + describe(array), array, seconds(start));
+
+    std::vector<float> minVals(array.componentCount()), maxVals(array.componentCount());
+    for (size_t c = 0; c < array.componentCount(); c++) {
+        minVals[c] = statistics[c].minVal();
+        maxVals[c] = statistics[c].maxVal();
+    }
+    start = std::chrono::steady_clock::now();
+    std::vector<Histogram> histograms(array.componentCount());
+    Histogram::init(array, histograms, minVals, maxVals);
+    report("histograms " + describe(array), array, seconds(start));
+}
+
+int main(int argc, char* argv[])
+{
+    size_t width = 6000;
+    size_t height = 6000;
+    if (argc == 3) {
+        width = std::strtoul(argv[1], nullptr, 10);
+        height = std::strtoul(argv[2], nullptr, 10);
+    }
+    if ((argc != 1 && argc != 3) || width < 1 || height < 1) {
+        std::fprintf(stderr, "Usage: %s [WIDTH HEIGHT]\n", argv[0]);
+        return 1;
+    }
+
+    // the same environment as in qv, but without persistent cache
+    Allocator alloc(std::filesystem::temp_directory_path().string());
+    DiskCache diskCache("");
+    MemoryBudget memoryBudget;
+    ThreadPool threadPool;
+
+    const TGD::Type types[] = { TGD::uint8, TGD::uint16, TGD::float32 };
+    for (TGD::Type type : types) {
+        TGD::ArrayContainer gray({ width, height }, 1, type, defaultAllocator());
+        TGD::ArrayContainer rgb({ width, height }, 3, type, defaultAllocator());
+        fill(gray);
+        fill(rgb);
+
+        benchmarkQuadTree(gray, false);
+        benchmarkQuadTree(rgb, false);
+        // only 8 bit data is stored in sRGB textures, see Frame
+        if (type == TGD::uint8)
+            benchmarkQuadTree(rgb, true);
+
+        benchmarkLightness(gray, ColorSpaceLinearGray, "linear gray");
+        benchmarkLightness(gray, ColorSpaceSGray, "sGray");
+        benchmarkLightness(gray, ColorSpaceY, "Y");
+        benchmarkLightness(rgb, ColorSpaceLinearRGB, "linear RGB");
+        benchmarkLightness(rgb, ColorSpaceSRGB, "sRGB");
+        benchmarkLightness(rgb, ColorSpaceXYZ, "XYZ");
+
+        benchmarkStatistics(gray);
+        benchmarkStatistics(rgb);
+    }
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+
+#include "diskcache.hpp"
+
+static DiskCache* diskCache;
+
+// Increase this whenever the layout of cached data changes
+static const char* cacheFormat = "qv-cache-2";
+
+
+std::string FrameCache::path(const std::string& name) const
+{
+    return _directory + '/' + name;
+}
+
+bool FrameCache::load(const std::string& name, void* data, size_t size) const
+{
+    if (!isEnabled())
+        return false;
+    std::error_code ec;
+    if (std::filesystem::file_size(path(name), ec) != size || ec)
+        return false;
+    FILE* f = std::fopen(path(name).c_str(), "rb");
+    if (!f)
+        return false;
+    bool ok = (std::fread(data, 1, size, f) == size);
+    std::fclose(f);
+    //fprintf(stderr, "cache: loading %s %s\n", path(name).c_str(), ok ? "succeeded" : "failed");
+    return ok;
+}
+
+bool FrameCache::load(const std::string& name, std::vector<unsigned char>& data) const
+{
+    if (!isEnabled())
+        return false;
+    std::error_code ec;
+    size_t size = std::filesystem::file_size(path(name), ec);
+    if (ec)
+        return false;
+    data.resize(size);
+    return load(name, data.data(), data.size());
+}
+
+void FrameCache::store(const std::string& name, const void* data, size_t size) const
+{
+    if (!isEnabled())
+        return;
+    // Write to a temporary file first so that other threads or processes
+    // never see incomplete data
+    std::string tmpName = path(name) + ".tmp"
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    FILE* f = std::fopen(tmpName.c_str(), "wb");
+    if (!f)
+        return;
+    bool ok = (std::fwrite(data, 1, size, f) == size);
+    ok = (std::fclose(f) == 0 && ok);
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmpName, path(name), ec);
+    if (!ok || ec)
+        std::filesystem::remove(tmpName, ec);
+    else if (diskCache)
+        diskCache->stored(size);
+    //fprintf(stderr, "cache: storing %s %s\n", path(name).c_str(), ok && !ec ? "succeeded" : "failed");
+}
+
+DiskCache::DiskCache(const std::string& directory, size_t maxSize) :
+    _directory(directory), _maxSize(maxSize),
+    _storedSinceCleanup(0), _stopping(false), _cleanupRunning(false)
+{
+    diskCache = this;
+    // also removes leftovers of earlier sessions, so do this even without limit
+    startCleanup();
+}
+
+DiskCache::~DiskCache()
+{
+    std::thread cleanupThread;
+    {
+        std::lock_guard<std::mutex> lock(_cleanupMutex);
+        _stopping = true;
+        cleanupThread = std::move(_cleanupThread);
+    }
+    if (cleanupThread.joinable())
+        cleanupThread.join();
+    diskCache = nullptr;
+}
+
+void DiskCache::stored(size_t size)
+{
+    // check again when the new data could have filled a good part of the cache
+    if (_maxSize > 0 && (_storedSinceCleanup += size) > _maxSize / 8)
+        startCleanup();
+}
+
+void DiskCache::startCleanup()
+{
+    if (_directory.size() == 0)
+        return;
+    std::lock_guard<std::mutex> lock(_cleanupMutex);
+    if (_cleanupRunning || _stopping)
+        return;
+    if (_cleanupThread.joinable())
+        _cleanupThread.join();
+    _storedSinceCleanup = 0;
+    _cleanupRunning = true;
+    _cleanupThread = std::thread([this]() {
+            cleanup();
+            std::lock_guard<std::mutex> lock(_cleanupMutex);
+            _cleanupRunning = false;
+        });
+}
+
+// Temporary files older than this were left behind by a crashed writer
+static const auto tmpFileMaxAge = std::chrono::minutes(10);
+
+void DiskCache::cleanup()
+{
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUse;
+        size_t size;
+    };
+    std::vector<Entry> entries;
+    size_t totalSize = 0;
+    std::error_code ec;
+    auto now = std::filesystem::file_time_type::clock::now();
+    for (auto it = std::filesystem::directory_iterator(_directory, ec);
+            !ec && it != std::filesystem::directory_iterator() && !_stopping; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if ((name.compare(0, 6, "frame-") != 0 && name.compare(0, 5, "file-") != 0)
+                || !it->is_directory(ec))
+            continue;
+        Entry entry = { it->path(), std::filesystem::file_time_type::min(), 0 };
+        // the key file is touched whenever the cache is used, see cache()
+        entry.lastUse = std::filesystem::last_write_time(it->path() / "key", ec);
+        std::error_code ec2;
+        for (auto& f : std::filesystem::directory_iterator(it->path(), ec2)) {
+            std::error_code ec3;
+            size_t size = f.file_size(ec3);
+            if (f.path().filename().string().find(".tmp") != std::string::npos
+                    && now - f.last_write_time(ec3) > tmpFileMaxAge) {
+                //fprintf(stderr, "cache: removing leftover %s\n", f.path().string().c_str());
+                std::filesystem::remove(f.path(), ec3);
+            } else if (!ec3) {
+                entry.size += size;
+            }
+        }
+        totalSize += entry.size;
+        entries.push_back(entry);
+    }
+    if (_maxSize == 0 || totalSize <= _maxSize)
+        return;
+    // remove the least recently used entries until there is room for new data
+    std::sort(entries.begin(), entries.end(),
+            [](const Entry& e0, const Entry& e1) { return e0.lastUse < e1.lastUse; });
+    size_t targetSize = _maxSize / 8 * 7;
+    for (size_t i = 0; i < entries.size() && totalSize > targetSize && !_stopping; i++) {
+        //fprintf(stderr, "cache: removing %s\n", entries[i].path.string().c_str());
+        std::filesystem::remove_all(entries[i].path, ec);
+        totalSize -= entries[i].size;
+    }
+}
+
+static std::string readKey(const std::string& fileName)
+{
+    std::string key;
+    FILE* f = std::fopen(fileName.c_str(), "rb");
+    if (f) {
+        char buf[256];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+            key.append(buf, n);
+        std::fclose(f);
+    }
+    return key;
+}
+
+FrameCache DiskCache::cache(const std::string& fileName, const std::string& what, const char* prefix) const
+{
+    if (_directory.size() == 0)
+        return FrameCache();
+
+    // Identify the file
+    std::error_code ec;
+    std::filesystem::path p = std::filesystem::canonical(fileName, ec);
+    if (ec)
+        return FrameCache();
+    auto mtime = std::filesystem::last_write_time(p, ec);
+    if (ec)
+        return FrameCache();
+    auto size = std::filesystem::file_size(p, ec);
+    if (ec)
+        return FrameCache();
+    std::string key = std::string(cacheFormat) + '\n'
+        + p.string() + '\n'
+        + std::to_string(mtime.time_since_epoch().count()) + '\n'
+        + std::to_string(size) + '\n'
+        + what + '\n';
+
+    // Find the directory: its name is the FNV-1a hash of the key, and it
+    // contains the key to detect hash collisions
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < key.size(); i++) {
+        hash ^= static_cast<unsigned char>(key[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    char hashString[17];
+    std::snprintf(hashString, sizeof(hashString), "%016llx", static_cast<unsigned long long>(hash));
+    std::string cacheDirectory = _directory + '/' + prefix + hashString;
+    std::string keyFileName = cacheDirectory + "/key";
+    if (std::filesystem::exists(keyFileName, ec)) {
+        if (readKey(keyFileName) != key)
+            return FrameCache();
+        // remember the use so that the cleanup removes the least recently used data first
+        std::filesystem::last_write_time(keyFileName, std::filesystem::file_time_type::clock::now(), ec);
+    } else {
+        std::filesystem::create_directories(cacheDirectory, ec);
+        if (ec)
+            return FrameCache();
+        FrameCache(cacheDirectory).store("key", key.data(), key.size());
+    }
+    //fprintf(stderr, "cache: using %s for %s %s\n", cacheDirectory.c_str(), fileName.c_str(), what.c_str());
+    return FrameCache(cacheDirectory);
+}
+
+FrameCache DiskCache::frameCache(const std::string& fileName, int frameIndex) const
+{
+    if (frameIndex < 0)
+        return FrameCache();
+    return cache(fileName, std::to_string(frameIndex), "frame-");
+}
+
+FrameCache DiskCache::fileCache(const std::string& fileName) const
+{
+    return cache(fileName, "file", "file-");
+}
+
+const DiskCache& defaultDiskCache()
+{
+    return *diskCache;
+}
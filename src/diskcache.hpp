@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_DISKCACHE_HPP
+#define QV_DISKCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <tgd/array.hpp>
+
+
+/* The cached data of a single frame (or of a whole file), stored in its own directory.
+ * All functions are thread-safe. Failures are not errors: if data cannot be
+ * loaded, it is simply computed again, and if it cannot be stored, it is
+ * not cached. */
+class FrameCache {
+private:
+    std::string _directory; // empty if caching is disabled
+
+    std::string path(const std::string& name) const;
+
+public:
+    FrameCache() {}
+    FrameCache(const std::string& directory) : _directory(directory) {}
+
+    bool isEnabled() const { return _directory.size() > 0; }
+
+    // Load/store raw data; loading fails if the stored size differs
+    bool load(const std::string& name, void* data, size_t size) const;
+    void store(const std::string& name, const void* data, size_t size) const;
+    // Load data of unknown size
+    bool load(const std::string& name, std::vector<unsigned char>& data) const;
+
+    // Load/store array data; the array must already have the right description
+    bool load(const std::string& name, TGD::ArrayContainer& array) const
+    {
+        return load(name, array.data(), array.dataSize());
+    }
+    void store(const std::string& name, const TGD::ArrayContainer& array) const
+    {
+        store(name, array.data(), array.dataSize());
+    }
+};
+
+/* A persistent cache for data computed from frames (quads, lightness,
+ * statistics, histograms), so that reopening a file is fast. Frames are
+ * identified by file name, modification time, file size, and frame index,
+ * so modified files never get outdated data.
+ * If the cache grows beyond its maximum size, the data of the least recently
+ * used frames and files is removed in a background thread. This happens at
+ * startup and whenever enough new data was stored. */
+class DiskCache {
+private:
+    friend class FrameCache;
+    std::string _directory;
+    size_t _maxSize; // 0 means no limit
+    std::atomic<size_t> _storedSinceCleanup;
+    std::atomic<bool> _stopping;
+    std::mutex _cleanupMutex;
+    std::thread _cleanupThread;
+    bool _cleanupRunning;
+
+    FrameCache cache(const std::string& fileName, const std::string& what, const char* prefix) const;
+    void stored(size_t size);
+    void startCleanup();
+    void cleanup();
+
+public:
+    DiskCache(const std::string& directory, size_t maxSize = 0);
+    ~DiskCache();
+
+    // Returns a disabled cache if the file cannot be identified
+    FrameCache frameCache(const std::string& fileName, int frameIndex) const;
+    // Same for data that concerns the file as a whole, e.g. its SeekIndex
+    FrameCache fileCache(const std::string& fileName) const;
+};
+
+const DiskCache& defaultDiskCache();
+
+#endif
@@ -25,43 +25,107 @@
  */
 
 #include <limits>
+#include <algorithm>
 
 #include "file.hpp"
 #include "alloc.hpp"
+#include "diskcache.hpp"
 
 
-File::File() : _frameIndex(-1), _maxFrameIndexSoFar(-1), _haveSeenLastFrame(false)
+File::File() : _frameIndex(-1), _maxFrameIndexSoFar(-1), _haveSeenLastFrame(false), _mappable(-1)
 {
 }
 
 TGD::Importer& File::importer()
 {
-    if (_importer.fileName().size() == 0) {
-        _importer.initialize(fileName(), _importerHints);
+    if (!_importer) {
+        _importer = std::make_shared<TGD::Importer>(fileName(), _importerHints);
     }
-    return _importer;
+    return *_importer;
 }
 
-bool File::init(const std::string& fileName, const TGD::TagList& importerHints, std::string& errorMessage)
+bool File::useRecentFrames()
 {
-    _fileName = fileName;
-    _importerHints = importerHints;
+    // Only for files with random access to their frames: the importer is
+    // not used for recent frames, so it would lose track of the position
+    // in files that are read sequentially
+    std::string dummyErrorMsg;
+    return _recentFrames && RecentFrames::maxFrames() > 0 && frameCount(dummyErrorMsg) > 0;
+}
+
+bool File::init(const std::string& fileName, const TGD::TagList& importerHints,
+        const std::shared_ptr<RecentFrames>& recentFrames, std::string& errorMessage)
+{
+    init(fileName, importerHints, recentFrames, std::shared_ptr<FileProbe>());
     TGD::Error tgdError = importer().checkAccess();
     if (tgdError != TGD::ErrorNone) {
         errorMessage = fileName + ": " + TGD::strerror(tgdError);
         return false;
     }
-    _description = TGD::ArrayDescription();
+    return true;
+}
+
+void File::init(const std::string& fileName, const TGD::TagList& importerHints,
+        const std::shared_ptr<RecentFrames>& recentFrames, const std::shared_ptr<FileProbe>& probe)
+{
+    _fileName = fileName;
+    _importerHints = importerHints;
+    _importer.reset();
+    _description.reset();
+    _recentFrames = recentFrames;
+    _probe = probe;
+    _mappable = -1;
     _frame.reset();
     _frameIndex = -1;
     _maxFrameIndexSoFar = -1;
     _haveSeenLastFrame = false;
+    _seekIndex.reset();
+}
+
+bool File::checkAccess(std::string& errorMessage)
+{
+    if (!_probe)
+        return true;
+    if (_probe->state == FileProbe::Failed) {
+        errorMessage = _probe->errorMessage;
+        return false;
+    }
+    if (_probe->state == FileProbe::Unknown) {
+        TGD::Error tgdError = importer().checkAccess();
+        if (tgdError != TGD::ErrorNone) {
+            errorMessage = fileName() + ": " + TGD::strerror(tgdError);
+            return false;
+        }
+    }
+    // from now on, the importer knows everything the probe knows
+    _probe.reset();
     return true;
 }
 
+bool File::mappable()
+{
+    if (_mappable < 0)
+        _mappable = isMappable(fileName(), _importerHints) ? 1 : 0;
+    return _mappable == 1;
+}
+
+bool File::probeFailed(std::string& errorMessage) const
+{
+    if (_probe && _probe->state == FileProbe::Failed) {
+        errorMessage = _probe->errorMessage;
+        return true;
+    }
+    return false;
+}
+
 int File::frameCount(std::string& errorMessage)
 {
-    int arrayCount = importer().arrayCount();
+    if (probeFailed(errorMessage))
+        return 0;
+    // avoid opening files that are not visited yet if the probe knows the answer
+    int arrayCount = (mappable() ? 1
+            : _probe && _probe->state == FileProbe::Accessible ? _probe->arrayCount
+            : importer().arrayCount());
     if (arrayCount == 0) {
         errorMessage = fileName() + ": no frames";
         _maxFrameIndexSoFar = -1;
@@ -78,12 +142,12 @@ bool File::hasMore()
 
 int File::maxFrameIndexSoFar()
 {
-    return _maxFrameIndexSoFar;
+    return std::max(_maxFrameIndexSoFar, _seekIndex ? _seekIndex->frameCount() - 1 : -1);
 }
 
 bool File::haveSeenLastFrame()
 {
-    return _haveSeenLastFrame;
+    return _haveSeenLastFrame || (_seekIndex && _seekIndex->isComplete());
 }
 
 static bool isCompatible(const TGD::ArrayDescription& desc0, const TGD::ArrayDescription& desc1)
@@ -106,14 +170,25 @@ bool File::setFrameIndex(int index, std::string& errorMessage)
         return true;
     }
     if (index < 0) {
-        _importer = TGD::Importer();
+        if (_frameIndex >= 0 && useRecentFrames())
+            _recentFrames->put(fileName(), _frameIndex, _frame);
+        _importer.reset();
         _frame.reset();
         _frameIndex = -1;
+        if (_seekIndex)
+            _seekIndex->stop();
         return true;
     }
+    if (!checkAccess(errorMessage))
+        return false;
     int frCnt = frameCount(errorMessage);
     if (frCnt == 0)
         return false;
+    if (frCnt < 0) {
+        if (!_seekIndex)
+            _seekIndex = std::make_shared<SeekIndex>(fileName(), _importerHints);
+        _seekIndex->start();
+    }
     if (frCnt > 0 && index >= frCnt) {
         errorMessage = fileName() + ": " + "array " + std::to_string(index) + " does not exist";
         return false;
@@ -126,14 +201,37 @@ bool File::setFrameIndex(int index, std::string& errorMessage)
         errorMessage = fileName() + ": " + "array " + std::to_string(index) + " does not exist";
         return false;
     }
-    TGD::Error tgdError;
+    if (isRecentFrame(index)) {
+        return setFrame(index, TGD::ArrayContainer(), nullptr, errorMessage);
+    }
     TGD::ArrayContainer a;
-    a = importer().readArray(&tgdError, index, defaultAllocator());
-    if (tgdError != TGD::ErrorNone) {
-        errorMessage = fileName() + ": " + TGD::strerror(tgdError);
-        return false;
+    if (mappable())
+        a = mapArray(fileName(), _importerHints);
+    if (a.elementCount() == 0) {
+        TGD::Error tgdError;
+        a = importer().readArray(&tgdError, index, defaultAllocator());
+        if (tgdError != TGD::ErrorNone) {
+            errorMessage = fileName() + ": " + TGD::strerror(tgdError);
+            return false;
+        }
     }
-    if (_description.dimensionCount() == 0) {
+    return setFrame(index, a, nullptr, errorMessage);
+}
+
+bool File::isRecentFrame(int index)
+{
+    return useRecentFrames() && _recentFrames->contains(fileName(), index);
+}
+
+bool File::setFrame(int index, const TGD::ArrayContainer& array, const Frame* prefetchedFrame,
+        std::string& errorMessage)
+{
+    Frame recentFrame;
+    bool haveRecentFrame = (!prefetchedFrame && useRecentFrames()
+            && _recentFrames->take(fileName(), index, recentFrame));
+    const TGD::ArrayContainer& a = (haveRecentFrame ? recentFrame.array()
+            : prefetchedFrame ? prefetchedFrame->array() : array);
+    if (!_description) {
         // first frame to read: initialize description
         if (a.dimensionCount() != 2) {
             errorMessage = fileName() + ": " + "array does not have two dimensions";
@@ -148,13 +246,33 @@ bool File::setFrameIndex(int index, std::string& errorMessage)
                 return false;
             }
         }
-        _description = a;
-    } else if (!isCompatible(_description, a)) {
+        _description = std::make_shared<TGD::ArrayDescription>(a);
+    } else if (!isCompatible(*_description, a)) {
         errorMessage = fileName() + ": " + "incompatible arrays";
         return false;
     }
     int channelIndex = (currentFrame() ? currentFrame()->channelIndex() : -1);
-    _frame.init(a);
+    // The quads of the previous frame whose data did not change are reused.
+    // If the previous frame is kept among the recent frames or replaced by
+    // a prefetched one, they are shared (see Frame::adoptQuads()), otherwise
+    // the previous frame is updated in place.
+    Frame previousFrame;
+    bool keepPrevious = (_frameIndex >= 0 && index != _frameIndex && useRecentFrames());
+    if (keepPrevious || prefetchedFrame)
+        previousFrame = _frame;
+    if (keepPrevious)
+        _recentFrames->put(fileName(), _frameIndex, _frame);
+    if (haveRecentFrame) {
+        std::swap(_frame, recentFrame);
+    } else if (prefetchedFrame) {
+        _frame = *prefetchedFrame;
+        _frame.adoptQuads(previousFrame);
+    } else if (keepPrevious) {
+        _frame.init(a, defaultDiskCache().frameCache(fileName(), index));
+        _frame.adoptQuads(previousFrame);
+    } else {
+        _frame.update(a, defaultDiskCache().frameCache(fileName(), index));
+    }
     _frameIndex = index;
     if (_frameIndex > _maxFrameIndexSoFar) {
         _maxFrameIndexSoFar = _frameIndex;
@@ -167,17 +285,39 @@ bool File::setFrameIndex(int index, std::string& errorMessage)
         channelIndex = -1;
     if (channelIndex >= 0)
         _frame.setChannelIndex(channelIndex);
+    // the file was read successfully, so the probe is not needed anymore
+    _probe.reset();
     return true;
 }
 
 bool File::reload(std::string& errorMessage)
 {
-    if (_description.dimensionCount() == 0) {
+    // If the current frame maps a file that changed, its data must not be
+    // accessed anymore, even if the file cannot be read again
+    bool mappingChanged = (currentFrame() && mappedFileChanged(_frame.array()));
+    bool ok = reloadFrames(errorMessage);
+    if (!ok && mappingChanged) {
+        _frame.reset();
+        _frameIndex = -1;
+        _importer.reset();
+        _description.reset();
+    }
+    return ok;
+}
+
+bool File::reloadFrames(std::string& errorMessage)
+{
+    if (_recentFrames)
+        _recentFrames->remove(fileName());
+    // the file changed, so its frames must be discovered again
+    _seekIndex.reset();
+    _mappable = -1;
+    if (!_description) {
         // we did not load anything yet
         return setFrameIndex(0, errorMessage);
     }
 
-    TGD::ArrayDescription origDescription = _description;
+    TGD::ArrayDescription origDescription = *_description;
     TGD::Importer newImporter(fileName(), _importerHints);
     TGD::Error tgdError = newImporter.checkAccess();
     if (tgdError != TGD::ErrorNone) {
@@ -198,9 +338,9 @@ bool File::reload(std::string& errorMessage)
     int index = frameIndex();
     int channelIndex = (currentFrame() ? currentFrame()->channelIndex() : -1);
     if (index == 0) {
-        _importer = newImporter;
-        _description = a;
-        _frame.init(a);
+        _importer = std::make_shared<TGD::Importer>(newImporter);
+        _description = std::make_shared<TGD::ArrayDescription>(a);
+        _frame.update(a, defaultDiskCache().frameCache(fileName(), 0));
         _frameIndex = 0;
         _maxFrameIndexSoFar = 0;
         _haveSeenLastFrame = false;
@@ -218,8 +358,8 @@ bool File::reload(std::string& errorMessage)
             index = 0;
         if (index >= frCnt)
             index = frCnt - 1;
-        _importer = newImporter;
-        _description = a;
+        _importer = std::make_shared<TGD::Importer>(newImporter);
+        _description = std::make_shared<TGD::ArrayDescription>(a);
         _frameIndex = -1;
         _maxFrameIndexSoFar = -1;
         _haveSeenLastFrame = false;
@@ -28,6 +28,10 @@
 #include <tgd/io.hpp>
 
 #include "frame.hpp"
+#include "recentframes.hpp"
+#include "seekindex.hpp"
+#include "prober.hpp"
+#include "mappedimport.hpp"
 
 // All frames in a file are uniform: 2d, same width/height, same component types, same component number.
 
@@ -35,30 +39,56 @@ class File {
 private:
     std::string _fileName;
     TGD::TagList _importerHints;
-    TGD::Importer _importer;
-    TGD::ArrayDescription _description;
+    std::shared_ptr<TGD::Importer> _importer; // created on first use
+    std::shared_ptr<TGD::ArrayDescription> _description; // known when the first frame was read
+    std::shared_ptr<FileProbe> _probe; // only for files that were added unchecked, until they are visited
     Frame _frame;
+    std::shared_ptr<RecentFrames> _recentFrames; // may be shared with other files
     int _frameIndex;
     int _maxFrameIndexSoFar;
     bool _haveSeenLastFrame;
+    std::shared_ptr<SeekIndex> _seekIndex; // only if the frame count is unknown
+    int _mappable; // -1 if unknown, otherwise whether the file has a single array that can be mapped
 
     TGD::Importer& importer();
+    bool useRecentFrames();
+    bool checkAccess(std::string& errorMessage);
+    bool reloadFrames(std::string& errorMessage);
+    bool mappable();
 
 public:
     File();
 
-    bool init(const std::string& fileName, const TGD::TagList& importerHints, std::string& errorMessage);
+    bool init(const std::string& fileName, const TGD::TagList& importerHints,
+            const std::shared_ptr<RecentFrames>& recentFrames, std::string& errorMessage);
+    // Like init(), but without opening the file: the file is only checked
+    // when it is visited, unless the given probe knows about it earlier
+    void init(const std::string& fileName, const TGD::TagList& importerHints,
+            const std::shared_ptr<RecentFrames>& recentFrames, const std::shared_ptr<FileProbe>& probe);
+    // Whether the probe found that this file cannot be used
+    bool probeFailed(std::string& errorMessage) const;
 
     const std::string& fileName() const { return _fileName; }
+    const TGD::TagList& importerHints() const { return _importerHints; }
     int frameCount(std::string& errorMessage); // returns -1 if unknown, 0 if there are no frames (error), or > 0
     // only use the following 3 functions if frameCount() returns -1:
     bool hasMore(); // returns true if there is a next frame
     int maxFrameIndexSoFar(); // returns the maximum frame index that is known to be valid, useful for seeking
     bool haveSeenLastFrame(); // returns true if the last frame of the file has been seen, in which case
                               // maxFrameIndexSoFar() returns the last valid frame index
+    // While a frame of such a file is shown, its SeekIndex discovers the
+    // frames ahead in the background, so the values returned by the last two
+    // functions can grow at any time
 
     bool setFrameIndex(int index, std::string& errorMessage); // index=-1 is allowed and frees resources; this cannot fail
+    // Like setFrameIndex(), but with an array that was already read from this file,
+    // e.g. by the Loader, or a frame that was prefetched from it (then the array is
+    // ignored); only use this if frameCount() returns > 0
+    bool setFrame(int index, const TGD::ArrayContainer& array, const Frame* prefetchedFrame,
+            std::string& errorMessage);
     int frameIndex() const { return _frameIndex; }
+    // Whether the given frame is among the recent frames, so that setFrameIndex() is fast
+    bool isRecentFrame(int index);
     Frame* currentFrame() { return frameIndex() >= 0 ? &_frame : nullptr; }
 
     bool reload(std::string& errorMessage);
@@ -25,18 +25,55 @@
  */
 
 #include <limits>
+#include <cstring>
 #include <type_traits>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
 
 #include "frame.hpp"
 #include "alloc.hpp"
+#include "memorybudget.hpp"
 #include "gl.hpp"
+#include "threadpool.hpp"
+#include "mappedimport.hpp"
 
 
+static bool halfFloatPyramid = false;
+
+void Frame::setHalfFloatPyramid(bool enable)
+{
+    halfFloatPyramid = enable;
+}
+
+static bool compactLightness = false;
+
+void Frame::setCompactLightness(bool enable)
+{
+    compactLightness = enable;
+}
+
+// Statistics and histograms that are computed in the background
+struct Frame::Analysis {
+    std::atomic<bool> done;
+    std::atomic<bool> cancelled;
+    std::vector<Statistic> statistics;
+    std::vector<Histogram> histograms;
+    ValueCounts valueCounts;
+    int channelIndex; // only for quantiles and aggregates
+    Quantiles quantiles;
+    Aggregates aggregates;
+
+    Analysis() : done(false), cancelled(false), channelIndex(-1) {}
+};
+
 Frame::Frame() :
     _gotNewData(true),
     _colorSpace(ColorSpaceNone), _colorChannels { -1, -1, -1 }, _alphaChannel(-1),
-    _channelIndex(-1)
+    _channelIndex(-1),
+    _colorTextureGroup(-1),
+    _texValueFactor(1.0f),
+    _texBytesPerComponent(4)
 {
 }
 
@@ -53,6 +90,12 @@ static int componentIndex(const TGD::ArrayContainer& a, const std::string& inter
 }
 
 void Frame::determineColorSpace()
+{
+    determineColorChannels();
+    determineColorRange();
+}
+
+void Frame::determineColorChannels()
 {
     //fprintf(stderr, "determine color space\n");
     _colorSpace = ColorSpaceNone;
@@ -117,6 +160,10 @@ void Frame::determineColorSpace()
     if (_colorSpace == ColorSpaceNone) {
         _alphaChannel = -1;
     }
+}
+
+void Frame::determineColorRange()
+{
     if (_colorSpace == ColorSpaceLinearGray) {
         _colorMinVal = minVal(colorChannelIndex(0));
         _colorMaxVal = maxVal(colorChannelIndex(0));
@@ -162,64 +209,229 @@ void Frame::determineColorSpace()
     }
 }
 
-void Frame::init(const TGD::ArrayContainer& a)
+void Frame::init(const TGD::ArrayContainer& a, const FrameCache& cache)
 {
     reset();
     _originalArray = a;
+    // mapped data consists of clean file pages that the system can drop at
+    // any time, so it does not count against the RAM budget
+    if (!isMapped(a))
+        _originalAllocation = defaultMemoryBudget().add(MemoryRAM, a.dataSize(), false);
+    _cache = cache;
     // Make room for min/max etc
     _minVals.resize(channelCount(), std::numeric_limits<float>::quiet_NaN());
     _maxVals.resize(channelCount(), std::numeric_limits<float>::quiet_NaN());
     _statistics.resize(channelCount());
     _histograms.resize(channelCount());
+    _quantiles.resize(channelCount());
+    _aggregates.resize(channelCount());
     // Determine color space, if any
     determineColorSpace();
     // Set initial channel
     _channelIndex = (_colorSpace != ColorSpaceNone ? ColorChannelIndex : 0);
-    // Initialize quadtree representation. Quads in level 0 are never explicitly
-    // stored in order to not duplicate the original data in memory
-    TGD::Type quadType = TGD::float32;
+    // Determine the texture groups: frames with up to four channels use a
+    // single texture; otherwise, each texture holds a group of up to four
+    // channels, and an additional group holds the color channels so that
+    // displaying color only requires a single texture.
     if (channelCount() <= 4) {
-        // single texture
-        GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
-        _texFormat = formats[channelCount() - 1];
-        if (type() == TGD::uint8 && (colorSpace() == ColorSpaceSGray || colorSpace() == ColorSpaceSRGB)) {
-            _texInternalFormat = (colorSpace() == ColorSpaceSGray ? GL_SRGB8
-                    : colorSpace() == ColorSpaceSRGB && !hasAlpha() ? GL_SRGB8
-                    : GL_SRGB8_ALPHA8);
-            _texType = GL_UNSIGNED_BYTE;
-            quadType = TGD::uint8;
-        } else {
-            GLint internalFormats[4] = { GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F };
-            _texInternalFormat = internalFormats[channelCount() - 1];
-            _texType = GL_FLOAT;
+        std::vector<int> group(channelCount());
+        for (int c = 0; c < channelCount(); c++)
+            group[c] = c;
+        _textureGroups.push_back(group);
+        _colorTextureGroup = (colorSpace() != ColorSpaceNone ? 0 : -1);
+    } else {
+        for (int c = 0; c < channelCount(); c += 4) {
+            std::vector<int> group;
+            for (int i = c; i < std::min(c + 4, channelCount()); i++)
+                group.push_back(i);
+            _textureGroups.push_back(group);
         }
+        if (colorSpace() != ColorSpaceNone) {
+            std::vector<int> group;
+            for (int i = 0; i < 3; i++)
+                if (std::find(group.begin(), group.end(), colorChannelIndex(i)) == group.end())
+                    group.push_back(colorChannelIndex(i));
+            if (hasAlpha())
+                group.push_back(alphaChannelIndex());
+            _colorTextureGroup = _textureGroups.size();
+            _textureGroups.push_back(group);
+        }
+    }
+    // Determine texture formats for 1-4 channels per texture
+    TGD::Type quadType = TGD::float32;
+    _texValueFactor = 1.0f;
+    GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    for (int i = 0; i < 4; i++)
+        _texFormats[i] = formats[i];
+    if (channelCount() <= 4 && type() == TGD::uint8
+            && (colorSpace() == ColorSpaceSGray || colorSpace() == ColorSpaceSRGB)) {
+        _texInternalFormats[channelCount() - 1] = (colorSpace() == ColorSpaceSGray ? GL_SRGB8
+                : colorSpace() == ColorSpaceSRGB && !hasAlpha() ? GL_SRGB8
+                : GL_SRGB8_ALPHA8);
+        _texType = GL_UNSIGNED_BYTE;
+        quadType = TGD::uint8;
+    } else if (type() == TGD::int8 || type() == TGD::uint8) {
+        // normalized textures in the native data type
+        GLint internalFormatsS[4] = { GL_R8_SNORM, GL_RG8_SNORM, GL_RGB8_SNORM, GL_RGBA8_SNORM };
+        GLint internalFormatsU[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+        for (int i = 0; i < 4; i++)
+            _texInternalFormats[i] = (type() == TGD::int8 ? internalFormatsS : internalFormatsU)[i];
+        _texType = (type() == TGD::int8 ? GL_BYTE : GL_UNSIGNED_BYTE);
+        _texValueFactor = (type() == TGD::int8 ? 127.0f : 255.0f);
+        quadType = type();
+    } else if ((type() == TGD::int16 || type() == TGD::uint16) && !isOpenGLES()) {
+        // normalized textures in the native data type; OpenGL ES lacks 16 bit formats
+        GLint internalFormatsS[4] = { GL_R16_SNORM, GL_RG16_SNORM, GL_RGB16_SNORM, GL_RGBA16_SNORM };
+        GLint internalFormatsU[4] = { GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 };
+        for (int i = 0; i < 4; i++)
+            _texInternalFormats[i] = (type() == TGD::int16 ? internalFormatsS : internalFormatsU)[i];
+        _texType = (type() == TGD::int16 ? GL_SHORT : GL_UNSIGNED_SHORT);
+        _texValueFactor = (type() == TGD::int16 ? 32767.0f : 65535.0f);
+        quadType = type();
     } else {
-        // one texture per channel
-        _texInternalFormat = GL_R32F;
-        _texFormat = GL_RED;
+        GLint internalFormats[4] = { GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F };
+        for (int i = 0; i < 4; i++)
+            _texInternalFormats[i] = internalFormats[i];
         _texType = GL_FLOAT;
     }
-    _quadLevel0BorderSize = 1;
-    std::vector<size_t> quadDims(2, 1022 + 2 * quadBorderSize(0));
+    _texBytesPerComponent = TGD::typeSize(quadType);
+    // Initialize quadtree representation, one per texture group. Quads in
+    // level 0 are never explicitly stored if they would only duplicate the
+    // original data in memory; they are uploaded directly from it.
+    int quadLevel0BorderSize = 1;
+    std::vector<size_t> quadDims(2, 1022 + 2 * quadLevel0BorderSize);
     if (width() <= requiredMaxTextureSize && height() <= requiredMaxTextureSize) {
         // optimization for frames that fit into a single texture (covers 4K resolution)
-        _quadLevel0BorderSize = 0;
+        quadLevel0BorderSize = 0;
         quadDims[0] = width();
         quadDims[1] = height();
     }
-    _quadLevel0Description = TGD::ArrayDescription(quadDims, channelCount(), quadType);
-    int level = 0;
-    int quadsX = std::max(width() / quadWidth() + (width() % quadWidth() ? 1 : 0), 1);
-    int quadsY = std::max(height() / quadHeight() + (height() % quadHeight() ? 1 : 0), 1);
-    _quadTreeWidths.push_back(quadsX);
-    _quadTreeHeights.push_back(quadsY);
-    while (quadsX > 1 || quadsY > 1) {
-        level++;
-        quadsX = quadsX / 2 + quadsX % 2;
-        quadsY = quadsY / 2 + quadsY % 2;
-        _quadTreeWidths.push_back(quadsX);
-        _quadTreeHeights.push_back(quadsY);
+    bool halfFloat = (halfFloatPyramid && quadType == TGD::float32);
+    for (size_t g = 0; g < _textureGroups.size(); g++) {
+        const std::vector<int>& group = _textureGroups[g];
+        bool isS[4] = { false, false, false, false };
+        for (size_t i = 0; i < group.size(); i++)
+            isS[i] = (quadType == TGD::uint8 && channelIsS(group[i]));
+        std::string cacheName = (_textureGroups.size() == 1 ? std::string("quad")
+                : int(g) == _colorTextureGroup ? std::string("quad-color")
+                : "quad-group" + std::to_string(g));
+        _quadTrees.push_back(std::make_shared<QuadTree>(_originalArray, group,
+                    TGD::ArrayDescription(quadDims, group.size(), quadType),
+                    quadLevel0BorderSize, isS, halfFloat, _cache, cacheName));
     }
+    // Make room for the new data if necessary
+    defaultMemoryBudget().enforce();
+}
+
+void Frame::update(const TGD::ArrayContainer& a, const FrameCache& cache)
+{
+    // Keep the quadtree if the new data has the same geometry so that only
+    // quads whose data actually changed need to be recomputed
+    if (_quadTrees.size() == 0
+            || a.dimensionCount() != 2
+            || a.dimension(0) != _originalArray.dimension(0)
+            || a.dimension(1) != _originalArray.dimension(1)
+            || a.componentCount() != _originalArray.componentCount()
+            || a.componentType() != _originalArray.componentType()) {
+        init(a, cache);
+        return;
+    }
+    ColorSpace oldColorSpace = _colorSpace;
+    int oldColorChannels[3] = { _colorChannels[0], _colorChannels[1], _colorChannels[2] };
+    int oldAlphaChannel = _alphaChannel;
+    _originalArray = a;
+    determineColorChannels();
+    if (_colorSpace != oldColorSpace
+            || _colorChannels[0] != oldColorChannels[0]
+            || _colorChannels[1] != oldColorChannels[1]
+            || _colorChannels[2] != oldColorChannels[2]
+            || _alphaChannel != oldAlphaChannel) {
+        // texture formats depend on the color space
+        init(a, cache);
+        return;
+    }
+    _cache = cache;
+    if (updateQuadTrees(_cache))
+        dropDerivedData();
+    else if (_lightness.initialized())
+        _lightness.update(_originalArray, _cache);
+    // the color range depends on the statistics of the new data
+    determineColorRange();
+}
+
+void Frame::adoptQuads(const Frame& previous)
+{
+    if (_quadTrees.size() == 0
+            || previous._quadTrees.size() != _quadTrees.size()
+            || previous.width() != width() || previous.height() != height()
+            || previous.type() != type()
+            || previous._colorSpace != _colorSpace
+            || previous._textureGroups != _textureGroups)
+        return;
+    // all quadtrees share the same geometry, so the hashes need to be computed only once
+    std::vector<uint64_t> hashes = _quadTrees[0]->level0Hashes(_originalArray);
+    for (size_t g = 0; g < _quadTrees.size(); g++)
+        _quadTrees[g]->adopt(*(previous._quadTrees[g]), hashes);
+}
+
+bool Frame::updateQuadTrees(const FrameCache& cache)
+{
+    // all quadtrees share the same geometry, so the hashes need to be computed only once
+    std::vector<uint64_t> hashes = _quadTrees[0]->level0Hashes(_originalArray);
+    bool changed = false;
+    for (size_t g = 0; g < _quadTrees.size(); g++)
+        changed = _quadTrees[g]->update(_originalArray, cache, hashes) || changed;
+    return changed;
+}
+
+void Frame::dropDerivedData()
+{
+    _lightness.reset();
+    _valueCounts.invalidate();
+    if (_channelAnalysis)
+        _channelAnalysis->cancelled = true;
+    _channelAnalysis.reset();
+    if (_colorAnalysis)
+        _colorAnalysis->cancelled = true;
+    _colorAnalysis.reset();
+    if (_quantileAnalysis)
+        _quantileAnalysis->cancelled = true;
+    _quantileAnalysis.reset();
+    if (_aggregateAnalysis)
+        _aggregateAnalysis->cancelled = true;
+    _aggregateAnalysis.reset();
+    _sampleArray = TGD::ArrayContainer();
+    _sampleLightness.reset();
+    _approxStatistics.clear();
+    _approxHistograms.clear();
+    _approxColorStatistic.invalidate();
+    _approxColorHistogram.invalidate();
+    _approxQuantiles.clear();
+    _approxColorQuantiles.invalidate();
+    _approxAggregates.clear();
+    _approxColorAggregates.reset();
+    for (size_t i = 0; i < _minVals.size(); i++)
+        _minVals[i] = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < _maxVals.size(); i++)
+        _maxVals[i] = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < _statistics.size(); i++)
+        _statistics[i].invalidate();
+    _colorStatistic.invalidate();
+    for (size_t i = 0; i < _histograms.size(); i++)
+        _histograms[i].invalidate();
+    _colorHistogram.invalidate();
+    for (size_t i = 0; i < _quantiles.size(); i++)
+        _quantiles[i].invalidate();
+    _colorQuantiles.invalidate();
+    for (size_t i = 0; i < _aggregates.size(); i++)
+        _aggregates[i].reset();
+    _colorAggregates.reset();
+}
+
+void Frame::releaseEvictedData()
+{
+    // The memory budget may ask us to drop data that we can compute again
+    _lightness.releaseEvictedTiles();
 }
 
 void Frame::reset()
@@ -280,261 +492,23 @@ std::string Frame::channelName(int channelIndex) const
     return channelName;
 }
 
-template<typename T>
-float normalize(T value)
-{
-    // for integer types, convert original value range to [0,1]
-    // for floating point types, do nothing
-    float normalizedValue = value;
-    if (std::is_integral<T>::value) {
-        float minVal = std::numeric_limits<T>::min();
-        float maxVal = std::numeric_limits<T>::max();
-        normalizedValue = (value - minVal) / (maxVal - minVal);
-    }
-    return normalizedValue;
-}
-
-template<typename T>
-static void lightnessArrayHelperLinearGray(float* lightness, size_t n, const T* src, int cc, int c)
+const ValueCounts& Frame::valueCounts()
 {
-    #pragma omp parallel for
-    for (size_t e = 0; e < n; e++) {
-        float v = normalize(src[e * cc + c]);
-        lightness[e] = rgbToL(v, v, v);
+    // Statistics and histograms of all channels are derived from these,
+    // so that the data is scanned only once
+    if (!_valueCounts.initialized()) {
+        SequentialScan scan(_originalArray);
+        _valueCounts.init(_originalArray);
     }
+    return _valueCounts;
 }
 
-template<typename T>
-static void lightnessArrayHelperLinearRGB(float* lightness, size_t n, const T* src, int cc, int cr, int cg, int cb)
+Lightness& Frame::lightness()
 {
-    #pragma omp parallel for
-    for (size_t e = 0; e < n; e++) {
-        float r = normalize(src[e * cc + cr]);
-        float g = normalize(src[e * cc + cg]);
-        float b = normalize(src[e * cc + cb]);
-        lightness[e] = rgbToL(r, g, b);
-    }
-}
-
-template<typename T>
-static void lightnessArrayHelperSGray(float* lightness, size_t n, const T* src, int cc, int c)
-{
-    #pragma omp parallel for
-    for (size_t e = 0; e < n; e++) {
-        float v = toLinear(normalize(src[e * cc + c]));
-        lightness[e] = rgbToL(v, v, v);
-    }
-}
-
-template<typename T>
-static void lightnessArrayHelperSRGB(float* lightness, size_t n, const T* src, int cc, int cr, int cg, int cb)
-{
-    #pragma omp parallel for
-    for (size_t e = 0; e < n; e++) {
-        float r = toLinear(normalize(src[e * cc + cr]));
-        float g = toLinear(normalize(src[e * cc + cg]));
-        float b = toLinear(normalize(src[e * cc + cb]));
-        lightness[e] = rgbToL(r, g, b);
-    }
-}
-
-template<typename T>
-static void lightnessArrayHelperY(float* lightness, size_t n, const T* src, int cc, int c)
-{
-    #pragma omp parallel for
-    for (size_t e = 0; e < n; e++) {
-        float v = normalize(src[e * cc + c]);
-        if (std::is_integral<T>::value)
-            v *= 100.0f;
-        lightness[e] = YToL(v);
-    }
-}
-
-const TGD::Array<float>& Frame::lightnessArray()
-{
-    if (_lightnessArray.elementCount() == 0) {
-        //fprintf(stderr, "computing lightness array\n");
-        _lightnessArray = TGD::Array<float>(_originalArray.dimensions(), 1, defaultAllocator());
-        float* lightness = static_cast<float*>(_lightnessArray.data());
-        size_t n = _lightnessArray.elementCount();
-        int cc = _originalArray.componentCount();
-        if (colorSpace() == ColorSpaceLinearGray) {
-            int c = colorChannelIndex(0);
-            switch (type()) {
-            case TGD::int8:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const int8_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint8:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const uint8_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int16:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const int16_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint16:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const uint16_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int32:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const int32_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint32:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const uint32_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int64:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const int64_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint64:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const uint64_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::float32:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const float*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::float64:
-                lightnessArrayHelperLinearGray(lightness, n, static_cast<const double*>(_originalArray.data()), cc, c);
-                break;
-            }
-        } else if (colorSpace() == ColorSpaceLinearRGB) {
-            int cr = colorChannelIndex(0);
-            int cg = colorChannelIndex(1);
-            int cb = colorChannelIndex(2);
-            switch (type()) {
-            case TGD::int8:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const int8_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint8:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const uint8_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::int16:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const int16_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint16:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const uint16_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::int32:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const int32_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint32:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const uint32_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::int64:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const int64_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint64:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const uint64_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::float32:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const float*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::float64:
-                lightnessArrayHelperLinearRGB(lightness, n, static_cast<const double*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            }
-        } else if (colorSpace() == ColorSpaceSGray) {
-            int c = colorChannelIndex(0);
-            switch (type()) {
-            case TGD::int8:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const int8_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint8:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const uint8_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int16:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const int16_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint16:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const uint16_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int32:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const int32_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint32:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const uint32_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int64:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const int64_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint64:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const uint64_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::float32:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const float*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::float64:
-                lightnessArrayHelperSGray(lightness, n, static_cast<const double*>(_originalArray.data()), cc, c);
-                break;
-            }
-        } else if (colorSpace() == ColorSpaceSRGB) {
-            int cr = colorChannelIndex(0);
-            int cg = colorChannelIndex(1);
-            int cb = colorChannelIndex(2);
-            switch (type()) {
-            case TGD::int8:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const int8_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint8:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const uint8_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::int16:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const int16_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint16:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const uint16_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::int32:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const int32_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint32:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const uint32_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::int64:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const int64_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::uint64:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const uint64_t*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::float32:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const float*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            case TGD::float64:
-                lightnessArrayHelperSRGB(lightness, n, static_cast<const double*>(_originalArray.data()), cc, cr, cg, cb);
-                break;
-            }
-        } else if (colorSpace() == ColorSpaceY || colorSpace() == ColorSpaceXYZ) {
-            int c = colorChannelIndex(colorSpace() == ColorSpaceY ? 0 : 1);
-            switch (type()) {
-            case TGD::int8:
-                lightnessArrayHelperY(lightness, n, static_cast<const int8_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint8:
-                lightnessArrayHelperY(lightness, n, static_cast<const uint8_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int16:
-                lightnessArrayHelperY(lightness, n, static_cast<const int16_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint16:
-                lightnessArrayHelperY(lightness, n, static_cast<const uint16_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int32:
-                lightnessArrayHelperY(lightness, n, static_cast<const int32_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint32:
-                lightnessArrayHelperY(lightness, n, static_cast<const uint32_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::int64:
-                lightnessArrayHelperY(lightness, n, static_cast<const int64_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::uint64:
-                lightnessArrayHelperY(lightness, n, static_cast<const uint64_t*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::float32:
-                lightnessArrayHelperY(lightness, n, static_cast<const float*>(_originalArray.data()), cc, c);
-                break;
-            case TGD::float64:
-                lightnessArrayHelperY(lightness, n, static_cast<const double*>(_originalArray.data()), cc, c);
-                break;
-            }
-        }
-    }
-    return _lightnessArray;
+    releaseEvictedData();
+    if (!_lightness.initialized())
+        _lightness.init(_originalArray, colorSpace(), _colorChannels, compactLightness, _cache);
+    return _lightness;
 }
 
 float Frame::value(int x, int y, int channelIndex)
@@ -542,7 +516,7 @@ float Frame::value(int x, int y, int channelIndex)
     float v = std::numeric_limits<float>::quiet_NaN();
     if (x >= 0 && x < width() && y >= 0 && y < height()) {
         if (channelIndex == ColorChannelIndex) {
-            v = lightnessArray()[{ size_t(x), size_t(y) }][0];
+            v = lightness().value(x, y);
         } else {
             switch (type()) {
             case TGD::int8:
@@ -627,16 +601,39 @@ float Frame::visMaxVal(int channelIndex)
 
 const Statistic& Frame::statistic(int channelIndex)
 {
+    collectAnalysisResults();
     if (channelIndex == ColorChannelIndex) {
-        if (!_colorStatistic.initialized()) {
+        if (!_colorStatistic.initialized() && !_colorStatistic.load(_cache, "statistic-color")) {
             //fprintf(stderr, "init color statistic\n");
-            _colorStatistic.init(lightnessArray(), 0);
+            lightness().forEachTile([&](const TGD::ArrayContainer& tile) { _colorStatistic.add(tile, 0); });
+            _colorStatistic.finish();
+            _colorStatistic.store(_cache, "statistic-color");
         }
         return _colorStatistic;
     } else {
         if (!_statistics[channelIndex].initialized()) {
-            //fprintf(stderr, "init channel %d statistic \n", channelIndex);
-            _statistics[channelIndex].init(_originalArray, channelIndex);
+            // The statistics of all channels are computed in a single pass
+            // over the data, so compute all that are not cached yet
+            std::vector<bool> notCached(channelCount(), false);
+            for (int c = 0; c < channelCount(); c++) {
+                if (!_statistics[c].initialized()) {
+                    notCached[c] = !_statistics[c].load(_cache, "statistic-" + std::to_string(c));
+                }
+            }
+            if (!_statistics[channelIndex].initialized()) {
+                //fprintf(stderr, "init statistics of all channels\n");
+                if (ValueCounts::supports(type())) {
+                    for (int c = 0; c < channelCount(); c++)
+                        if (notCached[c])
+                            _statistics[c].init(valueCounts(), c);
+                } else {
+                    SequentialScan scan(_originalArray);
+                    Statistic::init(_originalArray, _statistics);
+                }
+                for (int c = 0; c < channelCount(); c++)
+                    if (notCached[c])
+                        _statistics[c].store(_cache, "statistic-" + std::to_string(c));
+            }
         }
         return _statistics[channelIndex];
     }
@@ -644,296 +641,647 @@ const Statistic& Frame::statistic(int channelIndex)
 
 const Histogram& Frame::histogram(int channelIndex)
 {
+    collectAnalysisResults();
     if (channelIndex == ColorChannelIndex) {
-        if (!_colorHistogram.initialized()) {
+        if (!_colorHistogram.initialized()
+                && !_colorHistogram.load(_cache, "histogram-color", visMinVal(ColorChannelIndex), visMaxVal(ColorChannelIndex))) {
             //fprintf(stderr, "init color histogram\n");
-            _colorHistogram.init(lightnessArray(), 0, visMinVal(ColorChannelIndex), visMaxVal(ColorChannelIndex));
+            float histMinVal = visMinVal(ColorChannelIndex);
+            float histMaxVal = visMaxVal(ColorChannelIndex);
+            lightness().forEachTile([&](const TGD::ArrayContainer& tile) {
+                    _colorHistogram.add(tile, 0, histMinVal, histMaxVal); });
+            _colorHistogram.finish();
+            _colorHistogram.store(_cache, "histogram-color");
         }
         return _colorHistogram;
     } else {
         if (!_histograms[channelIndex].initialized()) {
-            //fprintf(stderr, "init channel %d histogram\n", channelIndex);
-            _histograms[channelIndex].init(_originalArray, channelIndex,
-                    type() == TGD::uint8 ?   0.0f : minVal(channelIndex),
-                    type() == TGD::uint8 ? 255.0f : maxVal(channelIndex));
+            // As with the statistics, compute the histograms of all channels
+            // that are not cached yet in a single pass over the data
+            std::vector<float> histMinVals(channelCount()), histMaxVals(channelCount());
+            std::vector<bool> notCached(channelCount(), false);
+            for (int c = 0; c < channelCount(); c++) {
+                histMinVals[c] = (type() == TGD::uint8 ?   0.0f : minVal(c));
+                histMaxVals[c] = (type() == TGD::uint8 ? 255.0f : maxVal(c));
+                if (!_histograms[c].initialized()) {
+                    notCached[c] = !_histograms[c].load(_cache, "histogram-" + std::to_string(c),
+                            histMinVals[c], histMaxVals[c]);
+                }
+            }
+            if (!_histograms[channelIndex].initialized()) {
+                //fprintf(stderr, "init histograms of all channels\n");
+                if (ValueCounts::supports(type())) {
+                    for (int c = 0; c < channelCount(); c++)
+                        if (notCached[c])
+                            _histograms[c].init(valueCounts(), c, histMinVals[c], histMaxVals[c]);
+                } else {
+                    SequentialScan scan(_originalArray);
+                    Histogram::init(_originalArray, _histograms, histMinVals, histMaxVals);
+                }
+                for (int c = 0; c < channelCount(); c++)
+                    if (notCached[c])
+                        _histograms[c].store(_cache, "histogram-" + std::to_string(c));
+            }
         }
         return _histograms[channelIndex];
     }
 }
 
-void Frame::setChannelIndex(int index)
+const Quantiles& Frame::quantiles(int channelIndex, float lowFraction, float highFraction)
 {
-    if (index == ColorChannelIndex)
-        assert(colorSpace() != ColorSpaceNone);
-    else
-        assert(index >= 0 && index < channelCount());
-    _channelIndex = index;
+    if (channelIndex == ColorChannelIndex) {
+        if (!_colorQuantiles.matches(lowFraction, highFraction)
+                && !_colorQuantiles.load(_cache, "quantiles-color", lowFraction, highFraction)) {
+            //fprintf(stderr, "init color quantiles\n");
+            _colorQuantiles.init([&](const std::function<void (const TGD::ArrayContainer&)>& f) {
+                    lightness().forEachTile(f); }, TGD::float32, 0, lowFraction, highFraction);
+            _colorQuantiles.store(_cache, "quantiles-color");
+        }
+        return _colorQuantiles;
+    } else {
+        Quantiles& Q = _quantiles[channelIndex];
+        std::string cacheName = "quantiles-" + std::to_string(channelIndex);
+        if (!Q.matches(lowFraction, highFraction) && !Q.load(_cache, cacheName, lowFraction, highFraction)) {
+            //fprintf(stderr, "init channel %d quantiles\n", channelIndex);
+            if (ValueCounts::supports(type()))
+                Q.init(valueCounts(), channelIndex, lowFraction, highFraction);
+            else
+                Q.init(_originalArray, channelIndex, lowFraction, highFraction);
+            Q.store(_cache, cacheName);
+        }
+        return Q;
+    }
 }
 
-int Frame::quadIndex(int level, int qx, int qy) const // returns -1 if nonexistent
+/* Estimates and background computation of statistics, histograms and quantiles */
+
+// Frames are analyzed progressively if they have more elements than this
+static const size_t bigFrameSize = size_t(Frame::requiredMaxTextureSize) * size_t(Frame::requiredMaxTextureSize) / 4;
+// Estimates use every sampleStep-th element in both directions
+static const size_t sampleStep = 10;
+
+bool Frame::isBig() const
 {
-    int i = -1;
-    if (qx >= 0 && qx < quadTreeLevelWidth(level)
-            && qy >= 0 && qy < quadTreeLevelHeight(level)) {
-        i = 0;
-        for (int l = 0; l < level; l++)
-            i += quadTreeLevelWidth(l) * quadTreeLevelHeight(l);
-        i += qy * quadTreeLevelWidth(level) + qx;
-    }
-    return i;
+    return size_t(width()) * size_t(height()) > bigFrameSize;
 }
 
-void Frame::computeQuadOnLevel0Worker(TGD::ArrayContainer& q, int qx, int qy) const
+void Frame::knownHistogramRange(int channelIndex, float& minVal, float& maxVal)
 {
-    const TGD::ArrayContainer& src = _originalArray;
-    int srcX = qx * quadWidth() - quadBorderSize(0);
-    int srcY = qy * quadHeight() - quadBorderSize(0);
-
-    if (srcX >= 0 && srcY >= 0
-            && srcX + int(q.dimension(0)) < width()
-            && srcY + int(q.dimension(1)) < height()) {
-        // case 1: copy the whole block
-        for (size_t y = 0; y < q.dimension(1); y++) {
-            std::memcpy(q.get({ 0, y }),
-                    src.get({ size_t(srcX), size_t(srcY + y) }),
-                    q.dimension(0) * q.elementSize());
-        }
+    // Same as in histogram(), but without computing statistics; unknown values are NaN
+    if (type() == TGD::uint8) {
+        minVal = 0.0f;
+        maxVal = 255.0f;
     } else {
-        // case 2: border coordinates need to be clamped
-        int copyableBlockMinX = srcX;
-        if (copyableBlockMinX < 0)
-            copyableBlockMinX = 0;
-        int copyableBlockMaxX = srcX + q.dimension(0) - 1;
-        if (copyableBlockMaxX >= width())
-            copyableBlockMaxX = width() - 1;
-        int copyableBlockMinY = srcY;
-        if (copyableBlockMinY < 0)
-            copyableBlockMinY = 0;
-        int copyableBlockMaxY = srcY + q.dimension(1) - 1;
-        if (copyableBlockMaxY >= height())
-            copyableBlockMaxY = height() - 1;
-        for (int y = 0; y < copyableBlockMinY - srcY; y++) {
-            for (int x = 0; x < copyableBlockMinX - srcX; x++) {
-                std::memcpy(q.get({ size_t(x), size_t(y) }),
-                        src.get({ size_t(0), size_t(0) }),
-                        q.elementSize());
-            }
-            std::memcpy(q.get({ size_t(copyableBlockMinX - srcX), size_t(y) }),
-                    src.get({ size_t(copyableBlockMinX), size_t(0) }),
-                    (copyableBlockMaxX - copyableBlockMinX + 1) * q.elementSize());
-            for (int x = copyableBlockMaxX - srcX + 1; x < int(q.dimension(0)); x++) {
-                std::memcpy(q.get({ size_t(x), size_t(y) }),
-                        src.get({ size_t(width() - 1), size_t(0) }),
-                        q.elementSize());
+        minVal = _minVals[channelIndex];
+        maxVal = _maxVals[channelIndex];
+        if (!std::isfinite(minVal))
+            _originalArray.componentTagList(channelIndex).value("MINVAL", &minVal);
+        if (!std::isfinite(maxVal))
+            _originalArray.componentTagList(channelIndex).value("MAXVAL", &maxVal);
+    }
+}
+
+const TGD::ArrayContainer& Frame::sampleArray()
+{
+    if (_sampleArray.elementCount() == 0) {
+        size_t sampleWidth = (width() + sampleStep - 1) / sampleStep;
+        size_t sampleHeight = (height() + sampleStep - 1) / sampleStep;
+        _sampleArray = TGD::ArrayContainer({ sampleWidth, sampleHeight }, channelCount(), type(),
+                TGD::Allocator() /* we want in-memory storage here */);
+        size_t elementSize = _originalArray.elementSize();
+        #pragma omp parallel for
+        for (size_t y = 0; y < sampleHeight; y++)
+            for (size_t x = 0; x < sampleWidth; x++)
+                std::memcpy(_sampleArray.get({ x, y }),
+                        _originalArray.get({ x * sampleStep, y * sampleStep }), elementSize);
+    }
+    return _sampleArray;
+}
+
+void Frame::startChannelAnalysis()
+{
+    if (_channelAnalysis)
+        return;
+    std::shared_ptr<Analysis> analysis = std::make_shared<Analysis>();
+    // values that are already known are not computed again
+    analysis->statistics = _statistics;
+    analysis->histograms = _histograms;
+    std::vector<float> histMinVals(channelCount()), histMaxVals(channelCount());
+    for (int c = 0; c < channelCount(); c++)
+        knownHistogramRange(c, histMinVals[c], histMaxVals[c]);
+    TGD::ArrayContainer array = _originalArray;
+    _channelAnalysis = analysis;
+    //fprintf(stderr, "starting background analysis of all channels\n");
+    defaultThreadPool().enqueue([analysis, array, histMinVals, histMaxVals]() mutable {
+            SequentialScan scan(array);
+            if (ValueCounts::supports(array.componentType())) {
+                analysis->valueCounts.init(array);
+                for (size_t c = 0; c < analysis->statistics.size(); c++)
+                    if (!analysis->statistics[c].initialized())
+                        analysis->statistics[c].init(analysis->valueCounts, c);
+            } else {
+                Statistic::init(array, analysis->statistics);
             }
-        }
-        for (int y = copyableBlockMinY - srcY; y <= copyableBlockMaxY - srcY; y++) {
-            for (int x = 0; x < copyableBlockMinX - srcX; x++) {
-                std::memcpy(q.get({ size_t(x), size_t(y) }),
-                        src.get({ size_t(0), size_t(srcY + y) }),
-                        q.elementSize());
+            if (!analysis->cancelled && !defaultThreadPool().stopping()) {
+                for (size_t c = 0; c < histMinVals.size(); c++) {
+                    if (!std::isfinite(histMinVals[c]))
+                        histMinVals[c] = analysis->statistics[c].minVal();
+                    if (!std::isfinite(histMaxVals[c]))
+                        histMaxVals[c] = analysis->statistics[c].maxVal();
+                }
+                if (ValueCounts::supports(array.componentType())) {
+                    for (size_t c = 0; c < analysis->histograms.size(); c++)
+                        if (!analysis->histograms[c].initialized())
+                            analysis->histograms[c].init(analysis->valueCounts, c, histMinVals[c], histMaxVals[c]);
+                } else {
+                    Histogram::init(array, analysis->histograms, histMinVals, histMaxVals);
+                }
             }
-            std::memcpy(q.get({ size_t(copyableBlockMinX - srcX), size_t(y) }),
-                    src.get({ size_t(copyableBlockMinX), size_t(srcY + y) }),
-                    (copyableBlockMaxX - copyableBlockMinX + 1) * q.elementSize());
-            for (int x = copyableBlockMaxX - srcX + 1; x < int(q.dimension(0)); x++) {
-                std::memcpy(q.get({ size_t(x), size_t(y) }),
-                        src.get({ size_t(width() - 1), size_t(srcY + y) }),
-                        q.elementSize());
+            analysis->done = true;
+        });
+}
+
+void Frame::startColorAnalysis()
+{
+    if (_colorAnalysis)
+        return;
+    std::shared_ptr<Analysis> analysis = std::make_shared<Analysis>();
+    analysis->statistics.resize(1);
+    analysis->histograms.resize(1);
+    Lightness lightness;
+    lightness.init(_originalArray, colorSpace(), _colorChannels, compactLightness, _cache);
+    float histMinVal = visMinVal(ColorChannelIndex);
+    float histMaxVal = visMaxVal(ColorChannelIndex);
+    _colorAnalysis = analysis;
+    //fprintf(stderr, "starting background analysis of color\n");
+    defaultThreadPool().enqueue([analysis, lightness, histMinVal, histMaxVal]() mutable {
+            // the tiles are stored in the frame cache, if any, so the lightness
+            // of this frame will be cheap to get afterwards
+            lightness.forEachTile([&](const TGD::ArrayContainer& tile) {
+                    if (!analysis->cancelled && !defaultThreadPool().stopping()) {
+                        analysis->statistics[0].add(tile, 0);
+                        analysis->histograms[0].add(tile, 0, histMinVal, histMaxVal);
+                    }
+                });
+            analysis->statistics[0].finish();
+            analysis->histograms[0].finish();
+            analysis->done = true;
+        });
+}
+
+void Frame::startQuantileAnalysis(int channelIndex, float lowFraction, float highFraction)
+{
+    // Only one at a time: a request for other quantiles waits until the
+    // results of the current analysis were collected
+    if (_quantileAnalysis)
+        return;
+    std::shared_ptr<Analysis> analysis = std::make_shared<Analysis>();
+    analysis->channelIndex = channelIndex;
+    _quantileAnalysis = analysis;
+    if (channelIndex == ColorChannelIndex) {
+        Lightness lightness;
+        lightness.init(_originalArray, colorSpace(), _colorChannels, compactLightness, _cache);
+        //fprintf(stderr, "starting background analysis of color quantiles\n");
+        defaultThreadPool().enqueue([analysis, lightness, lowFraction, highFraction]() mutable {
+                analysis->quantiles.init([&](const std::function<void (const TGD::ArrayContainer&)>& f) {
+                        lightness.forEachTile([&](const TGD::ArrayContainer& tile) {
+                                if (!analysis->cancelled && !defaultThreadPool().stopping())
+                                    f(tile);
+                            });
+                    }, TGD::float32, 0, lowFraction, highFraction);
+                analysis->done = true;
+            });
+    } else {
+        TGD::ArrayContainer array = _originalArray;
+        //fprintf(stderr, "starting background analysis of channel %d quantiles\n", channelIndex);
+        defaultThreadPool().enqueue([analysis, array, lowFraction, highFraction]() mutable {
+                SequentialScan scan(array);
+                // the selection makes up to four passes over the data; stop between them
+                analysis->quantiles.init([&](const std::function<void (const TGD::ArrayContainer&)>& f) {
+                        if (!analysis->cancelled && !defaultThreadPool().stopping())
+                            f(array);
+                    }, array.componentType(), analysis->channelIndex, lowFraction, highFraction);
+                analysis->done = true;
+            });
+    }
+}
+
+void Frame::startAggregateAnalysis(int channelIndex, int cellWidth, int cellHeight)
+{
+    // Only one at a time, as for the quantiles
+    if (_aggregateAnalysis)
+        return;
+    std::shared_ptr<Analysis> analysis = std::make_shared<Analysis>();
+    analysis->channelIndex = channelIndex;
+    _aggregateAnalysis = analysis;
+    if (channelIndex == ColorChannelIndex) {
+        Lightness lightness;
+        lightness.init(_originalArray, colorSpace(), _colorChannels, compactLightness, _cache);
+        analysis->aggregates.init(width(), height(), cellWidth, cellHeight, 0,
+                visMinVal(ColorChannelIndex), visMaxVal(ColorChannelIndex));
+        //fprintf(stderr, "starting background analysis of color aggregates\n");
+        defaultThreadPool().enqueue([analysis, lightness]() mutable {
+                analysis->aggregates.compute([&](int tx, int ty, size_t& x, size_t& y) {
+                        x = 0;
+                        y = 0;
+                        return lightness.floatTile(tx, ty);
+                    }, [&]() { return analysis->cancelled || defaultThreadPool().stopping(); });
+                analysis->done = true;
+            });
+    } else {
+        // an unknown histogram range is determined from the data, just like
+        // the range of histogram() is determined from the statistic
+        float histMinVal, histMaxVal;
+        knownHistogramRange(channelIndex, histMinVal, histMaxVal);
+        analysis->aggregates.init(width(), height(), cellWidth, cellHeight, channelIndex, histMinVal, histMaxVal);
+        TGD::ArrayContainer array = _originalArray;
+        //fprintf(stderr, "starting background analysis of channel %d aggregates\n", channelIndex);
+        defaultThreadPool().enqueue([analysis, array, cellWidth, cellHeight]() mutable {
+                SequentialScan scan(array);
+                analysis->aggregates.compute([&](int cx, int cy, size_t& x, size_t& y) {
+                        x = size_t(cx) * cellWidth;
+                        y = size_t(cy) * cellHeight;
+                        return array;
+                    }, [&]() { return analysis->cancelled || defaultThreadPool().stopping(); });
+                analysis->done = true;
+            });
+    }
+}
+
+void Frame::collectAnalysisResults()
+{
+    if (_channelAnalysis && _channelAnalysis->done) {
+        if (!_channelAnalysis->cancelled) {
+            for (int c = 0; c < channelCount(); c++) {
+                if (!_statistics[c].initialized() && _channelAnalysis->statistics[c].initialized()) {
+                    _statistics[c] = _channelAnalysis->statistics[c];
+                    _statistics[c].store(_cache, "statistic-" + std::to_string(c));
+                }
+                if (!_histograms[c].initialized() && _channelAnalysis->histograms[c].initialized()) {
+                    _histograms[c] = _channelAnalysis->histograms[c];
+                    _histograms[c].store(_cache, "histogram-" + std::to_string(c));
+                }
             }
+            if (!_valueCounts.initialized())
+                _valueCounts = _channelAnalysis->valueCounts;
+            _approxStatistics.clear();
+            _approxHistograms.clear();
         }
-        for (int y = copyableBlockMaxY - srcY + 1; y < int(q.dimension(1)); y++) {
-            for (int x = 0; x < copyableBlockMinX - srcX; x++) {
-                std::memcpy(q.get({ size_t(x), size_t(y) }),
-                        src.get({ size_t(0), size_t(height() - 1) }),
-                        q.elementSize());
+        _channelAnalysis.reset();
+    }
+    if (_colorAnalysis && _colorAnalysis->done) {
+        if (!_colorAnalysis->cancelled) {
+            if (!_colorStatistic.initialized()) {
+                _colorStatistic = _colorAnalysis->statistics[0];
+                _colorStatistic.store(_cache, "statistic-color");
             }
-            std::memcpy(q.get({ size_t(copyableBlockMinX - srcX), size_t(y) }),
-                    src.get({ size_t(copyableBlockMinX), size_t(height() - 1) }),
-                    (copyableBlockMaxX - copyableBlockMinX + 1) * q.elementSize());
-            for (int x = copyableBlockMaxX - srcX + 1; x < int(q.dimension(0)); x++) {
-                std::memcpy(q.get({ size_t(x), size_t(y) }),
-                        src.get({ size_t(width() - 1), size_t(height() - 1) }),
-                        q.elementSize());
+            if (!_colorHistogram.initialized()) {
+                _colorHistogram = _colorAnalysis->histograms[0];
+                _colorHistogram.store(_cache, "histogram-color");
             }
+            _approxColorStatistic.invalidate();
+            _approxColorHistogram.invalidate();
         }
+        _colorAnalysis.reset();
     }
-#if 0
-    for (size_t y = 0; y < q.dimension(1); y++) {
-        int sy = srcY + y;
-        if (sy < 0)
-            sy = 0;
-        else if (sy >= height())
-            sy = height() - 1;
-        for (size_t x = 0; x < q.dimension(0); x++) {
-            const void* quadElement = q.get({ x, y });
-            int sx = srcX + x;
-            if (sx < 0)
-                sx = 0;
-            else if (sx >= width())
-                sx = width() - 1;
-            const void* srcElement = src.get({ sx, sy });
-            assert(memcmp(quadElement, srcElement, q.elementSize()) == 0);
-            if (memcmp(quadElement, srcElement, q.elementSize()) != 0) {
-                fprintf(stderr, "FAIL\n");
+    if (_quantileAnalysis && _quantileAnalysis->done) {
+        if (!_quantileAnalysis->cancelled) {
+            if (_quantileAnalysis->channelIndex == ColorChannelIndex) {
+                _colorQuantiles = _quantileAnalysis->quantiles;
+                _colorQuantiles.store(_cache, "quantiles-color");
+            } else {
+                int c = _quantileAnalysis->channelIndex;
+                _quantiles[c] = _quantileAnalysis->quantiles;
+                _quantiles[c].store(_cache, "quantiles-" + std::to_string(c));
             }
         }
+        _quantileAnalysis.reset();
+    }
+    if (_aggregateAnalysis && _aggregateAnalysis->done) {
+        if (!_aggregateAnalysis->cancelled && _aggregateAnalysis->aggregates.computed()) {
+            if (_aggregateAnalysis->channelIndex == ColorChannelIndex)
+                _colorAggregates = _aggregateAnalysis->aggregates;
+            else
+                _aggregates[_aggregateAnalysis->channelIndex] = _aggregateAnalysis->aggregates;
+        }
+        _aggregateAnalysis.reset();
+    }
+    if (!_channelAnalysis && !_colorAnalysis && !_quantileAnalysis && !_aggregateAnalysis) {
+        _sampleArray = TGD::ArrayContainer();
+        _sampleLightness.reset();
+        _approxAggregates.clear();
+        _approxColorAggregates.reset();
     }
-#endif
 }
 
-void Frame::computeQuadOnLevel0(TGD::ArrayContainer& quad, int qx, int qy)
+bool Frame::analysisPending()
 {
-    assert(qx >= 0 && qx < quadTreeLevelWidth(0));
-    assert(qy >= 0 && qy < quadTreeLevelHeight(0));
-    //fprintf(stderr, "computing quad %d,%d,%d\n", 0, qx, qy);
-
-    if (_quadLevel0Description.componentType() == type()) {
-        // write results directly into quad
-        computeQuadOnLevel0Worker(quad, qx, qy);
-    } else {
-        // compute in original data type first
-        TGD::ArrayContainer quadLevel0Tmp(
-                _quadLevel0Description.dimensions(),
-                _quadLevel0Description.componentCount(),
-                type(), defaultAllocator());
-        computeQuadOnLevel0Worker(quadLevel0Tmp, qx, qy);
-        // convert
-        convert(quad, quadLevel0Tmp);
-    }
+    collectAnalysisResults();
+    return _channelAnalysis || _colorAnalysis || _quantileAnalysis || _aggregateAnalysis;
 }
 
-bool Frame::textureChannelIsS(int texChannel) const
+const Statistic& Frame::statisticOrEstimate(int channelIndex)
 {
-    return (channelCount() <= 4 && type() == TGD::uint8
-            && ((colorSpace() == ColorSpaceSGray && colorChannelIndex(0) == texChannel)
-                || (colorSpace() == ColorSpaceSRGB &&
-                    (colorChannelIndex(0) == texChannel
-                     || colorChannelIndex(1) == texChannel
-                     || colorChannelIndex(2) == texChannel))));
+    collectAnalysisResults();
+    if (!isBig())
+        return statistic(channelIndex);
+    if (channelIndex == ColorChannelIndex) {
+        if (_colorStatistic.initialized() || _colorStatistic.load(_cache, "statistic-color"))
+            return _colorStatistic;
+        startColorAnalysis();
+        if (!_approxColorStatistic.initialized()) {
+            //fprintf(stderr, "estimating color statistic\n");
+            Lightness sampleLightness;
+            sampleLightness.init(sampleArray(), colorSpace(), _colorChannels, false, FrameCache());
+            sampleLightness.forEachTile([&](const TGD::ArrayContainer& tile) { _approxColorStatistic.add(tile, 0); });
+            _approxColorStatistic.finish();
+            _approxColorStatistic.setApproximate(double(_originalArray.elementCount()) / sampleArray().elementCount());
+        }
+        return _approxColorStatistic;
+    } else {
+        if (_statistics[channelIndex].initialized()
+                || _statistics[channelIndex].load(_cache, "statistic-" + std::to_string(channelIndex)))
+            return _statistics[channelIndex];
+        startChannelAnalysis();
+        if (_approxStatistics.size() == 0) {
+            //fprintf(stderr, "estimating statistics of all channels\n");
+            _approxStatistics.resize(channelCount());
+            Statistic::init(sampleArray(), _approxStatistics);
+            for (int c = 0; c < channelCount(); c++)
+                _approxStatistics[c].setApproximate(double(_originalArray.elementCount()) / sampleArray().elementCount());
+        }
+        return _approxStatistics[channelIndex];
+    }
 }
 
-static void interpolate(TGD::ArrayContainer& dst,
-        size_t dstXOffset, size_t dstYOffset, size_t w, size_t h,
-        const TGD::ArrayContainer& src, size_t srcXOffset, size_t srcYOffset,
-        const bool isS[4])
+const Histogram& Frame::histogramOrEstimate(int channelIndex)
 {
-    if (dst.componentType() == TGD::uint8) {
-        TGD::Array<uint8_t> d = dst;
-        TGD::Array<uint8_t> s = src;
-        for (size_t y = 0; y < h; y++) {
-            for (size_t x = 0; x < w; x++) {
-                size_t dste = (dstYOffset + y) * dst.dimension(0) + (dstXOffset + x);
-                size_t srce0 = (srcYOffset + 2 * y + 0) * src.dimension(0) + (srcXOffset + 2 * x + 0);
-                size_t srce1 = (srcYOffset + 2 * y + 0) * src.dimension(0) + (srcXOffset + 2 * x + 1);
-                size_t srce2 = (srcYOffset + 2 * y + 1) * src.dimension(0) + (srcXOffset + 2 * x + 0);
-                size_t srce3 = (srcYOffset + 2 * y + 1) * src.dimension(0) + (srcXOffset + 2 * x + 1);
-                for (size_t c = 0; c < dst.componentCount(); c++) {
-                    float v;
-                    if (isS[c]) {
-                        v = toS((toLinear(s[srce0][c]) + toLinear(s[srce1][c]) + toLinear(s[srce2][c]) + toLinear(s[srce3][c])) * 0.25f);
-                    } else {
-                        v = (s[srce0][c] + s[srce1][c] + s[srce2][c] + s[srce3][c]) * 0.25f;
-                    }
-                    d[dste][c] = std::round(v);
-                }
-            }
+    collectAnalysisResults();
+    if (!isBig())
+        return histogram(channelIndex);
+    if (channelIndex == ColorChannelIndex) {
+        float histMinVal = visMinVal(ColorChannelIndex);
+        float histMaxVal = visMaxVal(ColorChannelIndex);
+        if (_colorHistogram.initialized() || _colorHistogram.load(_cache, "histogram-color", histMinVal, histMaxVal))
+            return _colorHistogram;
+        startColorAnalysis();
+        if (!_approxColorHistogram.initialized()) {
+            //fprintf(stderr, "estimating color histogram\n");
+            Lightness sampleLightness;
+            sampleLightness.init(sampleArray(), colorSpace(), _colorChannels, false, FrameCache());
+            sampleLightness.forEachTile([&](const TGD::ArrayContainer& tile) {
+                    _approxColorHistogram.add(tile, 0, histMinVal, histMaxVal); });
+            _approxColorHistogram.finish();
+            _approxColorHistogram.setApproximate();
         }
+        return _approxColorHistogram;
     } else {
-        TGD::Array<float> d = dst;
-        TGD::Array<float> s = src;
-        for (size_t y = 0; y < h; y++) {
-            for (size_t x = 0; x < w; x++) {
-                size_t dste = (dstYOffset + y) * dst.dimension(0) + (dstXOffset + x);
-                size_t srce0 = (srcYOffset + 2 * y + 0) * src.dimension(0) + (srcXOffset + 2 * x + 0);
-                size_t srce1 = (srcYOffset + 2 * y + 0) * src.dimension(0) + (srcXOffset + 2 * x + 1);
-                size_t srce2 = (srcYOffset + 2 * y + 1) * src.dimension(0) + (srcXOffset + 2 * x + 0);
-                size_t srce3 = (srcYOffset + 2 * y + 1) * src.dimension(0) + (srcXOffset + 2 * x + 1);
-                for (size_t c = 0; c < dst.componentCount(); c++) {
-                    d[dste][c] = (s[srce0][c] + s[srce1][c] + s[srce2][c] + s[srce3][c]) * 0.25f;
-                }
+        float histMinVal, histMaxVal;
+        knownHistogramRange(channelIndex, histMinVal, histMaxVal);
+        if (_histograms[channelIndex].initialized()
+                || (std::isfinite(histMinVal) && std::isfinite(histMaxVal)
+                    && _histograms[channelIndex].load(_cache, "histogram-" + std::to_string(channelIndex),
+                        histMinVal, histMaxVal)))
+            return _histograms[channelIndex];
+        startChannelAnalysis();
+        if (_approxHistograms.size() == 0) {
+            //fprintf(stderr, "estimating histograms of all channels\n");
+            std::vector<float> histMinVals(channelCount()), histMaxVals(channelCount());
+            for (int c = 0; c < channelCount(); c++) {
+                // without exact statistics, the estimated ones determine the range
+                const Statistic& S = statisticOrEstimate(c);
+                knownHistogramRange(c, histMinVals[c], histMaxVals[c]);
+                if (!std::isfinite(histMinVals[c]))
+                    histMinVals[c] = S.minVal();
+                if (!std::isfinite(histMaxVals[c]))
+                    histMaxVals[c] = S.maxVal();
             }
+            _approxHistograms.resize(channelCount());
+            Histogram::init(sampleArray(), _approxHistograms, histMinVals, histMaxVals);
+            for (int c = 0; c < channelCount(); c++)
+                _approxHistograms[c].setApproximate();
         }
+        return _approxHistograms[channelIndex];
     }
 }
 
-static void setInvalid(TGD::ArrayContainer& dst,
-        size_t dstXOffset, size_t dstYOffset, size_t w, size_t h)
+const Quantiles& Frame::quantilesOrEstimate(int channelIndex, float lowFraction, float highFraction)
 {
-    if (!defaultAllocator().clearsMemory()) {
-        for (size_t y = 0; y < h; y++) {
-            size_t dste = (y + dstYOffset) * dst.dimension(0) + dstXOffset;
-            std::memset(dst.get(dste), 0, w * dst.elementSize());
+    collectAnalysisResults();
+    if (!isBig())
+        return quantiles(channelIndex, lowFraction, highFraction);
+    if (channelIndex == ColorChannelIndex) {
+        if (_colorQuantiles.matches(lowFraction, highFraction)
+                || _colorQuantiles.load(_cache, "quantiles-color", lowFraction, highFraction))
+            return _colorQuantiles;
+        startQuantileAnalysis(channelIndex, lowFraction, highFraction);
+        if (!_approxColorQuantiles.matches(lowFraction, highFraction)) {
+            //fprintf(stderr, "estimating color quantiles\n");
+            Lightness sampleLightness;
+            sampleLightness.init(sampleArray(), colorSpace(), _colorChannels, false, FrameCache());
+            _approxColorQuantiles.init([&](const std::function<void (const TGD::ArrayContainer&)>& f) {
+                    sampleLightness.forEachTile(f); }, TGD::float32, 0, lowFraction, highFraction);
+            _approxColorQuantiles.setApproximate();
+        }
+        return _approxColorQuantiles;
+    } else {
+        // with value counts, the exact quantiles are cheap
+        if (_quantiles[channelIndex].matches(lowFraction, highFraction)
+                || _quantiles[channelIndex].load(_cache, "quantiles-" + std::to_string(channelIndex), lowFraction, highFraction)
+                || (ValueCounts::supports(type()) && _valueCounts.initialized()))
+            return quantiles(channelIndex, lowFraction, highFraction);
+        startQuantileAnalysis(channelIndex, lowFraction, highFraction);
+        if (_approxQuantiles.size() == 0)
+            _approxQuantiles.resize(channelCount());
+        if (!_approxQuantiles[channelIndex].matches(lowFraction, highFraction)) {
+            //fprintf(stderr, "estimating channel %d quantiles\n", channelIndex);
+            _approxQuantiles[channelIndex].init(sampleArray(), channelIndex, lowFraction, highFraction);
+            _approxQuantiles[channelIndex].setApproximate();
         }
+        return _approxQuantiles[channelIndex];
     }
 }
 
-void Frame::computeQuadOnLevel(TGD::ArrayContainer& q, int level, int qx, int qy) const
+void Frame::regionStatistic(int channelIndex, int x, int y, int w, int h,
+        Statistic& statistic, Histogram& histogram)
 {
-    assert(q.componentType() == TGD::uint8 || q.componentType() == TGD::float32);
-    assert(level >= 1);
-    //fprintf(stderr, "computing quad %d,%d,%d\n", level, qx, qy);
-
-    int q0Index = quadIndex(level - 1, 2 * qx + 0, 2 * qy + 0);
-    int q1Index = quadIndex(level - 1, 2 * qx + 1, 2 * qy + 0);
-    int q2Index = quadIndex(level - 1, 2 * qx + 0, 2 * qy + 1);
-    int q3Index = quadIndex(level - 1, 2 * qx + 1, 2 * qy + 1);
-    size_t srcXOffset = (level == 1 ? _quadLevel0BorderSize : 0);
-    size_t srcYOffset = (level == 1 ? _quadLevel0BorderSize : 0);
-    size_t w = quadWidth() / 2;
-    size_t h = quadHeight() / 2;
-    bool isS[4] = { textureChannelIsS(0), textureChannelIsS(1), textureChannelIsS(2), textureChannelIsS(3) };
-
-    size_t dstXOffset = 0;
-    size_t dstYOffset = 0;
-    if (q0Index >= 0) {
-        interpolate(q, dstXOffset, dstYOffset, w, h, _quads[q0Index], srcXOffset, srcYOffset, isS);
+    collectAnalysisResults();
+    int x0 = std::clamp(x, 0, width());
+    int y0 = std::clamp(y, 0, height());
+    int x1 = std::clamp(x + w, 0, width());
+    int y1 = std::clamp(y + h, 0, height());
+    bool color = (channelIndex == ColorChannelIndex);
+    size_t componentIndex = (color ? 0 : channelIndex);
+    // Frames that fit into a single quad are split into cells of the
+    // lightness tile size so that small regions remain cheap
+    int cellWidth = (!color && quadTreeLevels() > 1 ? quadWidth() : Lightness::tileSize);
+    int cellHeight = (!color && quadTreeLevels() > 1 ? quadHeight() : Lightness::tileSize);
+    Aggregates::CellSource source;
+    if (color) {
+        source = [this](int tx, int ty, size_t& x, size_t& y) {
+            x = 0;
+            y = 0;
+            return lightness().floatTile(tx, ty);
+        };
     } else {
-        setInvalid(q, dstXOffset, dstYOffset, w, h);
+        source = [&](int cx, int cy, size_t& x, size_t& y) {
+            x = size_t(cx) * cellWidth;
+            y = size_t(cy) * cellHeight;
+            return _originalArray;
+        };
     }
-
-    dstXOffset = w;
-    dstYOffset = 0;
-    if (q1Index >= 0) {
-        interpolate(q, dstXOffset, dstYOffset, w, h, _quads[q1Index], srcXOffset, srcYOffset, isS);
-    } else {
-        setInvalid(q, dstXOffset, dstYOffset, w, h);
+    Aggregates& A = (color ? _colorAggregates : _aggregates[channelIndex]);
+    if (!A.computed()) {
+        if (!isBig()) {
+            //fprintf(stderr, "init aggregates of channel %d\n", channelIndex);
+            A.init(width(), height(), cellWidth, cellHeight, componentIndex,
+                    color ? visMinVal(ColorChannelIndex) : type() == TGD::uint8 ?   0.0f : minVal(channelIndex),
+                    color ? visMaxVal(ColorChannelIndex) : type() == TGD::uint8 ? 255.0f : maxVal(channelIndex));
+            A.compute(source);
+        } else {
+            startAggregateAnalysis(channelIndex, cellWidth, cellHeight);
+        }
+    }
+    if (A.computed()) {
+        A.region(x0, y0, x1 - x0, y1 - y0, source, statistic, histogram);
+        return;
     }
 
-    dstXOffset = 0;
-    dstYOffset = h;
-    if (q2Index >= 0) {
-        interpolate(q, dstXOffset, dstYOffset, w, h, _quads[q2Index], srcXOffset, srcYOffset, isS);
+    // While the aggregates are computed in the background, rectangles that
+    // are not bigger than the subsample are looked at directly, and the others
+    // are estimated from the subsample
+    float histMinVal, histMaxVal;
+    if (color) {
+        histMinVal = visMinVal(ColorChannelIndex);
+        histMaxVal = visMaxVal(ColorChannelIndex);
     } else {
-        setInvalid(q, dstXOffset, dstYOffset, w, h);
+        knownHistogramRange(channelIndex, histMinVal, histMaxVal);
+        if (!std::isfinite(histMinVal))
+            histMinVal = statisticOrEstimate(channelIndex).minVal();
+        if (!std::isfinite(histMaxVal))
+            histMaxVal = statisticOrEstimate(channelIndex).maxVal();
     }
-
-    dstXOffset = w;
-    dstYOffset = h;
-    if (q3Index >= 0) {
-        interpolate(q, dstXOffset, dstYOffset, w, h, _quads[q3Index], srcXOffset, srcYOffset, isS);
+    if (size_t(x1 - x0) * size_t(y1 - y0) <= sampleArray().elementCount()) {
+        Aggregates direct;
+        direct.init(width(), height(), cellWidth, cellHeight, componentIndex, histMinVal, histMaxVal);
+        direct.region(x0, y0, x1 - x0, y1 - y0, source, statistic, histogram);
+        return;
+    }
+    int sampleWidth = sampleArray().dimension(0);
+    int sampleHeight = sampleArray().dimension(1);
+    Aggregates::CellSource sampleSource;
+    if (color) {
+        if (!_sampleLightness.initialized())
+            _sampleLightness.init(sampleArray(), colorSpace(), _colorChannels, false, FrameCache());
+        sampleSource = [this](int tx, int ty, size_t& x, size_t& y) {
+            x = 0;
+            y = 0;
+            return _sampleLightness.floatTile(tx, ty);
+        };
     } else {
-        setInvalid(q, dstXOffset, dstYOffset, w, h);
+        sampleSource = [this](int cx, int cy, size_t& x, size_t& y) {
+            x = size_t(cx) * Lightness::tileSize;
+            y = size_t(cy) * Lightness::tileSize;
+            return _sampleArray;
+        };
+    }
+    if (!color && _approxAggregates.size() == 0)
+        _approxAggregates.resize(channelCount());
+    Aggregates& E = (color ? _approxColorAggregates : _approxAggregates[channelIndex]);
+    if (!E.computed()) {
+        //fprintf(stderr, "estimating aggregates of channel %d\n", channelIndex);
+        E.init(sampleWidth, sampleHeight, Lightness::tileSize, Lightness::tileSize, componentIndex,
+                histMinVal, histMaxVal);
+        E.compute(sampleSource);
     }
+    // the subsample has the elements at multiples of sampleStep
+    int sx0 = std::min(x0 / int(sampleStep), sampleWidth - 1);
+    int sy0 = std::min(y0 / int(sampleStep), sampleHeight - 1);
+    int sx1 = std::clamp(int((x1 + sampleStep - 1) / sampleStep), sx0 + 1, sampleWidth);
+    int sy1 = std::clamp(int((y1 + sampleStep - 1) / sampleStep), sy0 + 1, sampleHeight);
+    E.region(sx0, sy0, sx1 - sx0, sy1 - sy0, sampleSource, statistic, histogram);
+    statistic.setApproximate(double(x1 - x0) * (y1 - y0) / (double(sx1 - sx0) * (sy1 - sy0)));
+    histogram.setApproximate();
+}
+
+void Frame::setChannelIndex(int index)
+{
+    if (index == ColorChannelIndex)
+        assert(colorSpace() != ColorSpaceNone);
+    else
+        assert(index >= 0 && index < channelCount());
+    _channelIndex = index;
+}
+
+bool Frame::channelIsS(int channelIndex) const
+{
+    return (type() == TGD::uint8
+            && ((colorSpace() == ColorSpaceSGray && colorChannelIndex(0) == channelIndex)
+                || (colorSpace() == ColorSpaceSRGB &&
+                    (colorChannelIndex(0) == channelIndex
+                     || colorChannelIndex(1) == channelIndex
+                     || colorChannelIndex(2) == channelIndex))));
+}
+
+int Frame::textureGroup(int channelIndex) const
+{
+    if (channelIndex == ColorChannelIndex)
+        return _colorTextureGroup;
+    else
+        return (channelCount() <= 4 ? 0 : channelIndex / 4);
+}
+
+int Frame::textureComponent(int channelIndex) const
+{
+    return (channelCount() <= 4 ? channelIndex : channelIndex % 4);
+}
+
+int Frame::colorTextureComponent(int colorSpaceIndex) const
+{
+    const std::vector<int>& group = _textureGroups[_colorTextureGroup];
+    return std::find(group.begin(), group.end(), colorChannelIndex(colorSpaceIndex)) - group.begin();
+}
+
+int Frame::alphaTextureComponent() const
+{
+    if (!hasAlpha())
+        return -1;
+    const std::vector<int>& group = _textureGroups[_colorTextureGroup];
+    return std::find(group.begin(), group.end(), alphaChannelIndex()) - group.begin();
 }
 
 static void uploadArrayToTexture(const TGD::ArrayContainer& array,
+        int x, int y, int width, int height,
         unsigned int texture,
         GLint internalFormat, GLenum format, GLenum type)
 {
+    // Uploads the given region of the array; the row length and skip
+    // parameters let OpenGL read it directly from the array data
     ASSERT_GLCHECK();
     auto gl = getGlFunctionsFromCurrentContext();
     size_t lineSize = array.dimension(0) * array.elementSize();
-    if (lineSize % 4 == 0)
+    size_t offset = x * array.elementSize();
+    if (lineSize % 4 == 0 && offset % 4 == 0)
         gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    else if (lineSize % 2 == 0)
+    else if (lineSize % 2 == 0 && offset % 2 == 0)
         gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
     else
         gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool isRegion = (width != int(array.dimension(0)) || height != int(array.dimension(1)));
+    if (isRegion) {
+        gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, array.dimension(0));
+        gl->glPixelStorei(GL_UNPACK_SKIP_PIXELS, x);
+        gl->glPixelStorei(GL_UNPACK_SKIP_ROWS, y);
+    }
     gl->glBindTexture(GL_TEXTURE_2D, texture);
     gl->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat,
-            array.dimension(0), array.dimension(1), 0,
+            width, height, 0,
             format, type, array.data());
+    if (isRegion) {
+        gl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        gl->glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        gl->glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    }
     gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -941,147 +1289,87 @@ static void uploadArrayToTexture(const TGD::ArrayContainer& array,
     ASSERT_GLCHECK();
 }
 
-void Frame::quadSubtreeNeedsRecomputing(int level, int qx, int qy)
-{
-    int qi = quadIndex(level, qx, qy);
-    if (qi < 0 || size_t(qi) >= _quadNeedsRecomputing.size())
-        return;
-    //fprintf(stderr, "quad %d,%d,%d needs recomputing\n", level, qx, qy);
-    _quadNeedsRecomputing[qi] = true;
-    if (level > 0) {
-        quadSubtreeNeedsRecomputing(level - 1, 2 * qx + 0, 2 * qy + 0);
-        quadSubtreeNeedsRecomputing(level - 1, 2 * qx + 1, 2 * qy + 0);
-        quadSubtreeNeedsRecomputing(level - 1, 2 * qx + 0, 2 * qy + 1);
-        quadSubtreeNeedsRecomputing(level - 1, 2 * qx + 1, 2 * qy + 1);
-    }
-}
-
 bool Frame::prepareQuadsForRendering(const std::vector<std::tuple<int, int, int>>& relevantQuads, bool refreshQuads)
 {
-    bool cacheRemainsValid = !_gotNewData;
     //fprintf(stderr, "%zu quads to render, with refresh = %d\n", relevantQuads.size(), refreshQuads ? 1 : 0);
+    releaseEvictedData();
     if (refreshQuads) {
-        for (size_t i = 0; i < relevantQuads.size(); i++) {
-            quadSubtreeNeedsRecomputing(
-                    std::get<0>(relevantQuads[i]),
-                    std::get<1>(relevantQuads[i]),
-                    std::get<2>(relevantQuads[i]));
+        // the data may have changed in memory; only changed quads are recomputed
+        if (updateQuadTrees(FrameCache())) {
+            // cached data does not apply anymore
+            _cache = FrameCache();
+            dropDerivedData();
+            determineColorSpace();
         }
-        _lightnessArray = TGD::Array<float>();
-        for (size_t i = 0; i < _minVals.size(); i++)
-            _minVals[i] = std::numeric_limits<float>::quiet_NaN();
-        for (size_t i = 0; i < _maxVals.size(); i++)
-            _maxVals[i] = std::numeric_limits<float>::quiet_NaN();
-        for (size_t i = 0; i < _statistics.size(); i++)
-            _statistics[i].invalidate();
-        _colorStatistic.invalidate();
-        for (size_t i = 0; i < _histograms.size(); i++)
-            _histograms[i].invalidate();
-        _colorHistogram.invalidate();
-        determineColorSpace();
-        cacheRemainsValid = false;
+        // Refreshed quads must show the new data right away
+        currentQuadTree().waitFor(relevantQuads);
+    } else {
+        currentQuadTree().request(relevantQuads);
     }
+    currentQuadTree().startBackgroundBuild();
+    bool cacheRemainsValid = !_gotNewData;
     _gotNewData = false;
     return cacheRemainsValid;
 }
 
-void Frame::uploadQuadToTexture(unsigned int tex, int level, int qx, int qy, int channelIndex)
+size_t Frame::quadTextureDataSize(int level) const
 {
-    //fprintf(stderr, "uploading quad %d,%d,%d to texture\n", level, qx, qy);
-
-    /* Optimization for the case of only a single quad */
-    if (_quadLevel0BorderSize == 0
-            && _quadLevel0Description.dimension(0) == _originalArray.dimension(0)
-            && _quadLevel0Description.dimension(1) == _originalArray.dimension(1)
-            && _quadLevel0Description.componentCount() == _originalArray.componentCount()
-            && _quadLevel0Description.componentType() == _originalArray.componentType()) {
-        if (_quads.size() == 0) {
-            _quads.resize(1);
-            _quads[0] = _originalArray;
-            _quadNeedsRecomputing.resize(1);
-        }
-        _quadNeedsRecomputing[0] = false;
-        //fprintf(stderr, "single quad optimization\n");
-    }
+    size_t w = quadWidth() + 2 * quadBorderSize(level);
+    size_t h = quadHeight() + 2 * quadBorderSize(level);
+    size_t components = _textureGroups[textureGroup(channelIndex())].size();
+    size_t bytesPerComponent = (_quadTrees[0]->levelIsHalfFloat(level) ? 2 : _texBytesPerComponent);
+    return w * h * components * bytesPerComponent;
+}
 
-    /* Create quads if not done yet */
-    if (_quads.size() == 0) {
-        // Reserve space for all quads
-        size_t level0Quads = quadTreeLevelWidth(0) * quadTreeLevelHeight(0);
-        size_t totalQuads = level0Quads;
-        for (int l = 1; l < quadTreeLevels(); l++) {
-            totalQuads += quadTreeLevelWidth(l) * quadTreeLevelHeight(l);
-        }
-        //fprintf(stderr, "Allocating %zu quads\n", totalQuads);
-        _quads.resize(totalQuads);
-        _quadNeedsRecomputing.resize(totalQuads);
-        // Allocate all quads
-        for (size_t i = 0; i < totalQuads; i++) {
-            if (i < level0Quads) {
-                _quads[i] = TGD::ArrayContainer(_quadLevel0Description, defaultAllocator());
-            } else {
-                _quads[i] = TGD::ArrayContainer(
-                        { size_t(quadWidth()), size_t(quadHeight()) },
-                        _quadLevel0Description.componentCount(),
-                        _quadLevel0Description.componentType(),
-                        defaultAllocator());
-            }
-            _quadNeedsRecomputing[i] = true;
-        }
+bool Frame::quadIsReady(int level, int qx, int qy) const
+{
+    return currentQuadTree().isReady(level, qx, qy);
+}
+
+unsigned long long Frame::quadVersion(int level, int qx, int qy, int textureGroup) const
+{
+    return _quadTrees[textureGroup]->version(level, qx, qy);
+}
+
+bool Frame::uploadQuadToTexture(unsigned int tex, int level, int qx, int qy, int textureGroup, bool allowPreview)
+{
+    //fprintf(stderr, "uploading quad %d,%d,%d of texture group %d to texture\n", level, qx, qy, textureGroup);
+    QuadTree& quadTree = *(_quadTrees[textureGroup]);
+    int components = _textureGroups[textureGroup].size();
+
+    /* Get the quad data. If the quad is not computed yet, either use the
+     * preview instead (only for the top level quad) or wait for it. */
+    bool isPreview = false;
+    if (allowPreview && level == quadTreeLevels() - 1 && !quadTree.isReady(level, qx, qy)) {
+        //fprintf(stderr, "using preview for quad %d,%d,%d\n", level, qx, qy);
+        isPreview = true;
+    }
+    /* Interior quads of level 0 are read directly from the original data. */
+    TGD::ArrayContainer quad;
+    int quadX = 0, quadY = 0;
+    int quadW, quadH;
+    if (!isPreview && quadTree.directQuad(level, qx, qy, quad, quadX, quadY)) {
+        quadW = quadWidth() + 2 * quadBorderSize(level);
+        quadH = quadHeight() + 2 * quadBorderSize(level);
+    } else {
+        quad = (isPreview ? quadTree.preview() : quadTree.quad(level, qx, qy));
+        quadW = quad.dimension(0);
+        quadH = quad.dimension(1);
     }
 
-    /* Get index of the requested quad */
-    int qi = quadIndex(level, qx, qy);
-
-    /* Recompute quads as necessary */
-    if (_quadNeedsRecomputing[qi]) {
-        //fprintf(stderr, "quad %d,%d,%d triggers recomputation of quads\n", level, qx, qy);
-        // Compute level 0 quads in parallel
-        #pragma omp parallel for schedule(dynamic)
-        for (int q = 0; q < quadTreeLevelHeight(0) * quadTreeLevelWidth(0); q++) {
-            if (_quadNeedsRecomputing[q]) {
-                int qy = q / quadTreeLevelWidth(0);
-                int qx = q % quadTreeLevelWidth(0);
-                computeQuadOnLevel0(_quads[q], qx, qy);
-                _quadNeedsRecomputing[q] = false;
-            }
-        }
-        int quadLevelBaseIndex = quadTreeLevelHeight(0) * quadTreeLevelWidth(0);
-        // Compute higher level quads, in parallel per level
-        for (int l = 1; l < quadTreeLevels(); l++) {
-            #pragma omp parallel for schedule(dynamic)
-            for (int q = 0; q < quadTreeLevelHeight(l) * quadTreeLevelWidth(l); q++) {
-                if (_quadNeedsRecomputing[quadLevelBaseIndex + q]) {
-                    int qy = q / quadTreeLevelWidth(l);
-                    int qx = q % quadTreeLevelWidth(l);
-                    computeQuadOnLevel(_quads[quadLevelBaseIndex + q], l, qx, qy);
-                    _quadNeedsRecomputing[quadLevelBaseIndex + q] = false;
-                }
-            }
-            quadLevelBaseIndex += quadTreeLevelHeight(l) * quadTreeLevelWidth(l);
-        }
+    /* Determine texture format: levels >= 1 may use half floats */
+    GLint texInternalFormat = _texInternalFormats[components - 1];
+    GLenum texType = _texType;
+    if (quadTree.levelIsHalfFloat(level)) {
+        GLint internalFormats[4] = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+        texInternalFormat = internalFormats[components - 1];
+        texType = GL_HALF_FLOAT;
     }
 
-    /* Upload requested quad data to texture */
+    /* Upload quad data to texture */
     auto gl = getGlFunctionsFromCurrentContext();
     ASSERT_GLCHECK();
-    if (channelCount() <= 4) {
-        // single texture
-        //fprintf(stderr, "single texture case: all channels\n");
-        uploadArrayToTexture(_quads[qi], tex,
-                _texInternalFormat, _texFormat, _texType);
-    } else {
-        // one texture per channel
-        if (_textureTransferArray.dimensionCount() == 0)
-            _textureTransferArray = TGD::Array<float>({ size_t(quadWidth()), size_t(quadHeight()) }, 1,
-                    TGD::Allocator() /* we want in-memory storage here */);
-        const TGD::Array<float> origQuad = _quads[qi];
-        //fprintf(stderr, "multi texture case: channel %d\n", channelIndex);
-        for (size_t e = 0; e < _textureTransferArray.elementCount(); e++)
-            _textureTransferArray.set<float>(e, 0, origQuad.get<float>(e, channelIndex));
-        uploadArrayToTexture(_textureTransferArray, tex,
-                _texInternalFormat, _texFormat, _texType);
-    }
+    uploadArrayToTexture(quad, quadX, quadY, quadW, quadH, tex, texInternalFormat, _texFormats[components - 1], texType);
     // generate mipmap only for the highest level
     if (level == quadTreeLevels() - 1) {
         gl->glBindTexture(GL_TEXTURE_2D, tex);
@@ -1094,11 +1382,21 @@ void Frame::uploadQuadToTexture(unsigned int tex, int level, int qx, int qy, int
         }
     }
     ASSERT_GLCHECK();
+    return !isPreview;
 }
 
-bool Frame::haveLightness() const
+void Frame::precompute(bool waitForQuads)
 {
-    return _lightnessArray.elementCount() > 0;
+    for (int c = 0; c < channelCount(); c++) {
+        minVal(c);
+        maxVal(c);
+    }
+    // the top level quad needs all levels below it, unless it is in the frame cache
+    std::vector<std::tuple<int, int, int>> topQuad = { std::make_tuple(quadTreeLevels() - 1, 0, 0) };
+    if (waitForQuads)
+        currentQuadTree().waitFor(topQuad);
+    else
+        currentQuadTree().request(topQuad);
 }
 
 bool Frame::haveStatistic(int channelIndex) const
@@ -36,18 +36,30 @@
 #include "color.hpp"
 #include "statistic.hpp"
 #include "histogram.hpp"
+#include "quantiles.hpp"
+#include "valuecounts.hpp"
+#include "aggregates.hpp"
+#include "lightness.hpp"
+#include "quadtree.hpp"
+#include "diskcache.hpp"
+#include "memorybudget.hpp"
 
 
 class Frame {
 private:
     /* data: */
     bool _gotNewData;
+    FrameCache _cache;
     TGD::ArrayContainer _originalArray;
-    TGD::Array<float> _lightnessArray; // perceptually linear lightness from CIELUV
+    std::shared_ptr<MemoryAllocation> _originalAllocation;
+    Lightness _lightness; // perceptually linear lightness from CIELUV, computed on demand
     /* per channel: */
     std::vector<float> _minVals, _maxVals;
     std::vector<Statistic> _statistics;
     std::vector<Histogram> _histograms;
+    std::vector<Quantiles> _quantiles;
+    ValueCounts _valueCounts; // only for 8 and 16 bit integer data
+    std::vector<Aggregates> _aggregates; // for region statistics, computed on demand
     /* color: */
     ColorSpace _colorSpace;
     int _colorChannels[3], _alphaChannel;
@@ -55,30 +67,56 @@ private:
     float _colorVisMinVal, _colorVisMaxVal;
     Statistic _colorStatistic;
     Histogram _colorHistogram;
+    Quantiles _colorQuantiles;
+    Aggregates _colorAggregates;
+    /* estimates from a subsample, and exact values computed in the background: */
+    struct Analysis;
+    TGD::ArrayContainer _sampleArray;
+    std::vector<Statistic> _approxStatistics;
+    std::vector<Histogram> _approxHistograms;
+    Statistic _approxColorStatistic;
+    Histogram _approxColorHistogram;
+    std::vector<Quantiles> _approxQuantiles;
+    Quantiles _approxColorQuantiles;
+    Lightness _sampleLightness;
+    std::vector<Aggregates> _approxAggregates;
+    Aggregates _approxColorAggregates;
+    std::shared_ptr<Analysis> _channelAnalysis;  // statistics and histograms of all channels
+    std::shared_ptr<Analysis> _colorAnalysis;    // color statistic and histogram
+    std::shared_ptr<Analysis> _quantileAnalysis; // quantiles of one channel or of color
+    std::shared_ptr<Analysis> _aggregateAnalysis; // region aggregates of one channel or of color
     /* current channel: */
     int _channelIndex;
-    /* quadtree: */
-    int _quadLevel0BorderSize;
-    TGD::ArrayDescription _quadLevel0Description;
-    std::vector<int> _quadTreeWidths;
-    std::vector<int> _quadTreeHeights;
-    std::vector<TGD::ArrayContainer> _quads;
-    std::vector<bool> _quadNeedsRecomputing;
-    /* textures: */
-    unsigned int _texInternalFormat;
-    unsigned int _texFormat;
+    /* texture groups, each with up to four channels: */
+    std::vector<std::vector<int>> _textureGroups;
+    int _colorTextureGroup;
+    /* quadtrees, one per texture group: */
+    std::vector<std::shared_ptr<QuadTree>> _quadTrees;
+    /* textures, with formats for 1-4 channels: */
+    unsigned int _texInternalFormats[4];
+    unsigned int _texFormats[4];
     unsigned int _texType;
-    TGD::Array<float> _textureTransferArray;
+    float _texValueFactor;
+    size_t _texBytesPerComponent;
 
     void determineColorSpace();
+    void determineColorChannels(); // only looks at the tags
+    void determineColorRange();    // requires the color channels
+    void dropDerivedData();
+    bool updateQuadTrees(const FrameCache& cache);
+    QuadTree& currentQuadTree() const { return *(_quadTrees[textureGroup(channelIndex())]); }
 
-    const TGD::Array<float>& lightnessArray();
-    int quadIndex(int level, int qx, int qy) const; // returns -1 if nonexistent
-    void computeQuadOnLevel0Worker(TGD::ArrayContainer& quad, int qx, int qy) const;
-    void computeQuadOnLevel0(TGD::ArrayContainer& quad, int qx, int qy);
-    void computeQuadOnLevel(TGD::ArrayContainer& quad, int l, int qx, int qy) const;
-    bool textureChannelIsS(int index) const;
-    void quadSubtreeNeedsRecomputing(int level, int qx, int qy);
+    Lightness& lightness();
+    const ValueCounts& valueCounts();
+    bool isBig() const;
+    void knownHistogramRange(int channelIndex, float& minVal, float& maxVal);
+    const TGD::ArrayContainer& sampleArray();
+    void startChannelAnalysis();
+    void startColorAnalysis();
+    void startQuantileAnalysis(int channelIndex, float lowFraction, float highFraction);
+    void startAggregateAnalysis(int channelIndex, int cellWidth, int cellHeight);
+    void collectAnalysisResults();
+    bool channelIsS(int channelIndex) const;
 
 public:
     // OpenGL is required to support at least the following as GL_MAX_TEXTURE_SIZE:
@@ -86,8 +124,20 @@ public:
 
     Frame();
 
-    void init(const TGD::ArrayContainer& a);
+    // Store pyramid levels >= 1 of float data as half floats (global setting)
+    static void setHalfFloatPyramid(bool enable);
+    // Store the lightness of integer data as 16 bit values (global setting)
+    static void setCompactLightness(bool enable);
+
+    void init(const TGD::ArrayContainer& a, const FrameCache& cache = FrameCache());
+    // Like init(), but keeps everything that does not depend on changed data
+    void update(const TGD::ArrayContainer& a, const FrameCache& cache = FrameCache());
+    // Take over the quads of the previous frame whose data did not change,
+    // after init(), without modifying the previous frame (see QuadTree::adopt())
+    void adoptQuads(const Frame& previous);
     void reset();
+    // Drop data that the memory budget evicted; it still counts as used until then
+    void releaseEvictedData();
 
     const TGD::ArrayContainer& array() const { return _originalArray; }
     TGD::Type type() const { return _originalArray.componentType(); }
@@ -118,22 +168,87 @@ public:
     const Statistic& currentStatistic() { return statistic(channelIndex()); }
     const Histogram& histogram(int channelIndex);
     const Histogram& currentHistogram() { return histogram(channelIndex()); }
+    // Exact quantiles of the finite values, e.g. for the fractions 0.005 and 0.995
+    const Quantiles& quantiles(int channelIndex, float lowFraction, float highFraction);
+    const Quantiles& currentQuantiles(float lowFraction, float highFraction)
+    {
+        return quantiles(channelIndex(), lowFraction, highFraction);
+    }
+
+    // Like statistic() and histogram(), but for big frames whose exact values
+    // are not known yet, these return an estimate from a subsample of about 1%
+    // of the data (see Statistic::approximate() and Histogram::approximate())
+    // and compute the exact values in the background
+    const Statistic& statisticOrEstimate(int channelIndex);
+    const Statistic& currentStatisticOrEstimate() { return statisticOrEstimate(channelIndex()); }
+    const Histogram& histogramOrEstimate(int channelIndex);
+    const Histogram& currentHistogramOrEstimate() { return histogramOrEstimate(channelIndex()); }
+    // Same for quantiles (see Quantiles::approximate())
+    const Quantiles& quantilesOrEstimate(int channelIndex, float lowFraction, float highFraction);
+    const Quantiles& currentQuantilesOrEstimate(float lowFraction, float highFraction)
+    {
+        return quantilesOrEstimate(channelIndex(), lowFraction, highFraction);
+    }
+    // Whether exact values are still being computed in the background
+    bool analysisPending();
+
+    // Statistic and histogram of the given rectangle, which is clamped to the
+    // frame. They are merged from a pyramid of aggregates per level 0 quad
+    // (per lightness tile for the color channel), which is computed on first
+    // use, so that only quads that are partially covered by the rectangle are
+    // looked at again. The histogram has Aggregates::binCount bins over the
+    // range of histogram(). For big frames, the aggregates are computed in the
+    // background; until then, small rectangles are looked at directly and the
+    // others are estimated from the subsample.
+    void regionStatistic(int channelIndex, int x, int y, int w, int h,
+            Statistic& statistic, Histogram& histogram);
 
     void setChannelIndex(int index);
     int channelIndex() const { return _channelIndex; }
 
-    // Quadtree representation for rendering
-    int quadBorderSize(int level) const { return (level == 0 ? _quadLevel0BorderSize : 0); }
-    int quadWidth() const { return _quadLevel0Description.dimension(0) - 2 * quadBorderSize(0); }
-    int quadHeight() const { return _quadLevel0Description.dimension(1) - 2 * quadBorderSize(0); }
-    int quadTreeLevels() const { return _quadTreeWidths.size(); }
-    int quadTreeLevelWidth(int level) const { return _quadTreeWidths[level]; }
-    int quadTreeLevelHeight(int level) const { return _quadTreeHeights[level]; }
+    // Texture groups: each texture holds up to four channels. The texture group
+    // for ColorChannelIndex holds the color channels, and the components of its
+    // texture are given by colorTextureComponent() and alphaTextureComponent().
+    int textureGroupCount() const { return _textureGroups.size(); }
+    int textureGroup(int channelIndex) const;
+    int textureComponent(int channelIndex) const;
+    int colorTextureComponent(int colorSpaceIndex) const;
+    int alphaTextureComponent() const; // -1 if there is no alpha channel
+
+    // Quadtree representation for rendering; all texture groups share the same geometry
+    int quadBorderSize(int level) const { return _quadTrees[0]->borderSize(level); }
+    int quadWidth() const { return _quadTrees[0]->quadWidth(); }
+    int quadHeight() const { return _quadTrees[0]->quadHeight(); }
+    int quadTreeLevels() const { return _quadTrees[0]->levels(); }
+    int quadTreeLevelWidth(int level) const { return _quadTrees[0]->levelWidth(level); }
+    int quadTreeLevelHeight(int level) const { return _quadTrees[0]->levelHeight(level); }
+    // Factor that maps texture values to data values (for normalized integer textures)
+    float textureValueFactor() const { return _texValueFactor; }
+    // Schedules the relevant quads of the current texture group for computation in the background
     bool prepareQuadsForRendering(const std::vector<std::tuple<int, int, int>>& relevantQuads, bool refreshQuads);
-    void uploadQuadToTexture(unsigned int tex, int level, int qx, int qy, int channelIndex);
+    bool quadIsReady(int level, int qx, int qy) const;
+    // Size of the texture data for one quad of the given level in the current texture group
+    size_t quadTextureDataSize(int level) const;
+    // Changes whenever the data of the quad changes
+    unsigned long long quadVersion(int level, int qx, int qy, int textureGroup) const;
+    // Returns false if only a preview of the quad was uploaded (requires allowPreview)
+    bool uploadQuadToTexture(unsigned int tex, int level, int qx, int qy, int textureGroup, bool allowPreview = false);
+    // Make the next prepareQuadsForRendering() report that textures prepared
+    // for rendering are invalid, e.g. when this frame replaces another one
+    void invalidateTextures() { _gotNewData = true; }
+
+    // Compute the minimum and maximum of all channels and the top level quad
+    // of the current texture group now, e.g. for a frame that is prefetched
+    // before it is displayed. If waitForQuads is false, the quad is only
+    // scheduled for computation in the background; see topQuadIsReady().
+    void precompute(bool waitForQuads = true);
+    // Whether the top level quad of the current texture group is ready, so
+    // that the frame can be displayed right away, at least at low resolution.
+    // Lower levels may still be missing, e.g. if the top quad was loaded from
+    // the frame cache; they are computed when they are needed.
+    bool topQuadIsReady() const { return quadIsReady(quadTreeLevels() - 1, 0, 0); }
 
     // Query whether some information is already computed or not yet
-    bool haveLightness() const;
     bool haveStatistic(int channelIndex) const;
     bool haveHistogram(int channelIndex) const;
 };
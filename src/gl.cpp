@@ -34,7 +34,10 @@
 bool isOpenGLES()
 {
     QOpenGLContext* ctx = QOpenGLContext::currentContext();
-    return (ctx && ctx->isOpenGLES());
+    if (ctx)
+        return ctx->isOpenGLES();
+    else
+        return (QOpenGLContext::openGLModuleType() == QOpenGLContext::LibGLES);
 }
 
 QOpenGLExtraFunctions* getGlFunctionsFromCurrentContext()
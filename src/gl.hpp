@@ -27,6 +27,21 @@
 
 #include <QOpenGLExtraFunctions>
 
+// 16 bit normalized formats are missing from OpenGL ES headers;
+// they are only used with desktop OpenGL
+#ifndef GL_R16
+# define GL_R16 0x822A
+# define GL_RG16 0x822C
+# define GL_RGB16 0x8054
+# define GL_RGBA16 0x805B
+#endif
+#ifndef GL_R16_SNORM
+# define GL_R16_SNORM 0x8F98
+# define GL_RG16_SNORM 0x8F99
+# define GL_RGB16_SNORM 0x8F9A
+# define GL_RGBA16_SNORM 0x8F9B
+#endif
+
 QOpenGLExtraFunctions* getGlFunctionsFromCurrentContext();
 
 bool isOpenGLES();
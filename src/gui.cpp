@@ -150,6 +150,12 @@ Gui::Gui(Set& set) : QMainWindow(),
     _framePrev100Action->setShortcuts({ Qt::Key_PageUp | Qt::ShiftModifier });
     connect(_framePrev100Action, SIGNAL(triggered()), this, SLOT(framePrev100()));
     addQVAction(_framePrev100Action, frameMenu);
+    frameMenu->addSeparator();
+    _frameTogglePlaybackAction = new QAction("Toggle &playback of the frames in this file, or of all files", this);
+    _frameTogglePlaybackAction->setShortcuts({ Qt::Key_P | Qt::ShiftModifier });
+    _frameTogglePlaybackAction->setCheckable(true);
+    connect(_frameTogglePlaybackAction, SIGNAL(triggered()), this, SLOT(frameTogglePlayback()));
+    addQVAction(_frameTogglePlaybackAction, frameMenu);
 
     QMenu* channelMenu = addQVMenu("&Channel");
     _channelToggleStatisticsAction = new QAction("Toggle &statistics overlay", this);
@@ -157,6 +163,11 @@ Gui::Gui(Set& set) : QMainWindow(),
     _channelToggleStatisticsAction->setCheckable(true);
     connect(_channelToggleStatisticsAction, SIGNAL(triggered()), this, SLOT(channelToggleStatistics()));
     addQVAction(_channelToggleStatisticsAction, channelMenu);
+    _channelToggleROIAction = new QAction("Toggle &region of interest mode for statistics and histogram", this);
+    _channelToggleROIAction->setShortcuts({ Qt::Key_R });
+    _channelToggleROIAction->setCheckable(true);
+    connect(_channelToggleROIAction, SIGNAL(triggered()), this, SLOT(channelToggleROI()));
+    addQVAction(_channelToggleROIAction, channelMenu);
     channelMenu->addSeparator();
     _channelColorAction = new QAction("Show color channels of this frame", this);
     _channelColorAction->setShortcuts({Qt::Key_C });
@@ -261,6 +272,11 @@ Gui::Gui(Set& set) : QMainWindow(),
     _rangeResetAction->setShortcuts({ Qt::Key_Backslash });
     connect(_rangeResetAction, SIGNAL(triggered()), this, SLOT(rangeReset()));
     addQVAction(_rangeResetAction, rangeMenu);
+    _rangeTogglePercentileAction = new QAction("Toggle visible range from &percentiles instead of minimum and maximum", this);
+    _rangeTogglePercentileAction->setCheckable(true);
+    _rangeTogglePercentileAction->setShortcuts({ Qt::Key_P });
+    connect(_rangeTogglePercentileAction, SIGNAL(triggered()), this, SLOT(rangeTogglePercentile()));
+    addQVAction(_rangeTogglePercentileAction, rangeMenu);
     rangeMenu->addSeparator();
     _rangeDRRToggleAction = new QAction("&Toggle Dynamic Range Reduction (DRR; simple tone mapping)", this);
     _rangeDRRToggleAction->setCheckable(true);
@@ -479,11 +495,21 @@ void Gui::framePrev100()
     _qv->adjustFrameIndex(-100);
 }
 
+void Gui::frameTogglePlayback()
+{
+    _qv->togglePlayback();
+}
+
 void Gui::channelToggleStatistics()
 {
     _qv->toggleOverlayStatistics();
 }
 
+void Gui::channelToggleROI()
+{
+    _qv->toggleROIMode();
+}
+
 void Gui::channelColor()
 {
     _qv->setChannelIndex(ColorChannelIndex);
@@ -579,6 +605,11 @@ void Gui::rangeReset()
     _qv->resetVisInterval();
 }
 
+void Gui::rangeTogglePercentile()
+{
+    _qv->togglePercentileRange();
+}
+
 void Gui::rangeDRRToggle()
 {
     _qv->toggleDRR();
@@ -731,8 +762,12 @@ void Gui::updateFromParameters()
     _framePrev10Action->setEnabled(canGoBackward);
     _frameNext100Action->setEnabled(canGoForward);
     _framePrev100Action->setEnabled(canGoBackward);
+    _frameTogglePlaybackAction->setEnabled(file && (file->frameCount(dummy) > 1 || _set.fileCount() > 1));
+    _frameTogglePlaybackAction->setChecked(_qv->playbackActive);
     _channelToggleStatisticsAction->setEnabled(frame);
     _channelToggleStatisticsAction->setChecked(_qv->overlayStatisticActive);
+    _channelToggleROIAction->setEnabled(frame);
+    _channelToggleROIAction->setChecked(_qv->roiModeActive);
     _channelColorAction->setEnabled(frame && frame->colorSpace() != ColorSpaceNone);
     _channelColorAction->setChecked(frame && frame->channelIndex() == ColorChannelIndex);
     _channel0Action->setEnabled(frame);
@@ -774,6 +809,8 @@ void Gui::updateFromParameters()
     _rangeShiftLeftAction->setEnabled(frame);
     _rangeShiftRightAction->setEnabled(frame);
     _rangeResetAction->setEnabled(frame);
+    _rangeTogglePercentileAction->setEnabled(frame);
+    _rangeTogglePercentileAction->setChecked(_qv->percentileRangeActive);
     _rangeDRRToggleAction->setEnabled(frame);
     _rangeDRRToggleAction->setChecked(p.dynamicRangeReduction);
     _rangeDRRDecBrightnessAction->setEnabled(frame);
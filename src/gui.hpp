@@ -61,7 +61,9 @@ private:
     QAction* _framePrev10Action;
     QAction* _frameNext100Action;
     QAction* _framePrev100Action;
+    QAction* _frameTogglePlaybackAction;
     QAction* _channelToggleStatisticsAction;
+    QAction* _channelToggleROIAction;
     QAction* _channelColorAction;
     QAction* _channel0Action;
     QAction* _channel1Action;
@@ -81,6 +83,7 @@ private:
     QAction* _rangeShiftLeftAction;
     QAction* _rangeShiftRightAction;
     QAction* _rangeResetAction;
+    QAction* _rangeTogglePercentileAction;
     QAction* _rangeDRRToggleAction;
     QAction* _rangeDRRDecBrightnessAction;
     QAction* _rangeDRRIncBrightnessAction;
@@ -128,7 +131,9 @@ private slots:
     void framePrev10();
     void frameNext100();
     void framePrev100();
+    void frameTogglePlayback();
     void channelToggleStatistics();
+    void channelToggleROI();
     void channelColor();
     void channel0();
     void channel1();
@@ -148,6 +153,7 @@ private slots:
     void rangeShiftLeft();
     void rangeShiftRight();
     void rangeReset();
+    void rangeTogglePercentile();
     void rangeDRRToggle();
     void rangeDRRDecBrightness();
     void rangeDRRIncBrightness();
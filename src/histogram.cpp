@@ -24,108 +24,278 @@
  * SOFTWARE.
  */
 
+#include <cstring>
 #include <cmath>
+#include <algorithm>
 
 #include <omp.h>
 
 #include "histogram.hpp"
 
 
-Histogram::Histogram() : _initialized(false)
+Histogram::Histogram() :
+    _initialized(false), _approximate(false),
+    _binCount(1), _adaptive(false),
+    _center(0.0f), _scale(1.0f), _tMin(0.0f), _tFactor(0.0f)
 {
 }
 
-static int binIndexHelper(float v, float minVal, float maxVal, int bins)
+void Histogram::setRange(float minVal, float maxVal, int binCount)
 {
-    int b = (v - minVal) / (maxVal - minVal) * bins;
-    if (b < 0)
-        b = 0;
-    else if (b >= bins)
-        b = bins - 1;
-    return b;
+    _minVal = minVal;
+    _maxVal = maxVal;
+    _binCount = binCount;
+    _adaptive = (binCount == adaptiveBinCount);
+    if (_adaptive) {
+        // Bins are linear in asinh((v - center) / scale): the bins close to
+        // the center have the width of linear bins for the full range, and
+        // their width grows proportionally to the distance from the center
+        _center = std::clamp(0.0f, minVal, maxVal);
+        _scale = std::max(maxVal - _center, _center - minVal) / binCount;
+        if (!(_scale > 0.0f))
+            _scale = 1.0f;
+        _tMin = std::asinh((minVal - _center) / _scale);
+        float tMax = std::asinh((maxVal - _center) / _scale);
+        _tFactor = (tMax > _tMin ? binCount / (tMax - _tMin) : 0.0f);
+    }
 }
 
-int Histogram::binIndex(float v) const
+double Histogram::binLowerBound(int index) const
 {
-    return binIndexHelper(v, _minVal, _maxVal, _bins.size());
+    if (index >= _binCount)
+        return _maxVal;
+    if (_adaptive) {
+        double t = _tMin + (_tFactor > 0.0f ? index / double(_tFactor) : 0.0);
+        return _center + _scale * std::sinh(t);
+    } else {
+        return _minVal + (double(_maxVal) - _minVal) * index / _binCount;
+    }
 }
 
+std::vector<float> Histogram::reduce(int binCount, float minVal, float maxVal) const
+{
+    std::vector<float> reduced(binCount, 0.0f);
+    double width = (double(maxVal) - minVal) / binCount;
+    for (int b = 0; b < int(_bins.size()); b++) {
+        if (_bins[b] == 0)
+            continue;
+        double lo = 0.0, hi = 0.0;
+        if (width > 0.0) {
+            lo = std::clamp((binLowerBound(b) - minVal) / width, 0.0, double(binCount));
+            hi = std::clamp((binLowerBound(b + 1) - minVal) / width, 0.0, double(binCount));
+        }
+        if (hi - lo < 1e-6) {
+            reduced[std::min(int(lo), binCount - 1)] += _bins[b];
+        } else {
+            for (int r = lo; r < binCount && r < hi; r++) {
+                double overlap = std::min(hi, r + 1.0) - std::max(lo, double(r));
+                reduced[r] += _bins[b] * (overlap / (hi - lo));
+            }
+        }
+    }
+    return reduced;
+}
+
+static int binCountForType(TGD::Type type)
+{
+    return (type == TGD::float32 || type == TGD::float64) ? Histogram::adaptiveBinCount
+        : (type == TGD::int8 || type == TGD::uint8) ? 256 : 1024;
+}
+
+/* Add the values of the given components of all elements to their bins, in a
+ * single pass over the data. Each thread uses its own bins to avoid
+ * contention. These private bins are allocated on first use and kept, so
+ * that passes over many small arrays (e.g. tiles) only need to merge them
+ * once at the end, see mergeHelper(). */
 template<typename T>
-static void initHelper(const TGD::Array<T> array, size_t componentIndex,
-        float _minVal, float _maxVal, size_t binCount,
-        std::vector<unsigned long long>& _bins, unsigned long long& _maxBinVal)
+static void addHelper(const TGD::ArrayContainer& array, const std::vector<size_t>& components,
+        const std::vector<const Histogram*>& histograms, size_t binCount,
+        std::vector<unsigned long long>& partBins)
 {
     size_t n = array.elementCount();
     size_t cc = array.componentCount();
-    const T* data = array[0];
+    size_t k = components.size();
+    const T* data = static_cast<const T*>(array.data());
 
-    int maxParts = omp_get_max_threads();
-    std::vector<unsigned long long> partBins(maxParts * binCount, 0);
-    int parts;
-    #pragma omp parallel
+    if (partBins.size() == 0)
+        partBins.resize(omp_get_max_threads() * k * binCount, 0);
+    int maxParts = partBins.size() / (k * binCount);
+    #pragma omp parallel num_threads(maxParts)
     {
-        parts = omp_get_num_threads();
-        size_t partSize = n / parts + (n % parts == 0 ? 0 : 1);
-        int p = omp_get_thread_num();
-
-        for (size_t pe = 0; pe < partSize; pe++) {
-            size_t e = p * partSize + pe;
-            if (e >= n)
-                break;
-            T val = data[e * cc + componentIndex];
-            if (std::isfinite(val)) {
-                partBins[p * binCount + binIndexHelper(val, _minVal, _maxVal, binCount)]++;
+        unsigned long long* pb = partBins.data() + omp_get_thread_num() * k * binCount;
+        #pragma omp for schedule(static)
+        for (size_t e = 0; e < n; e++) {
+            for (size_t i = 0; i < k; i++) {
+                T val = data[e * cc + components[i]];
+                if (std::isfinite(val))
+                    pb[i * binCount + histograms[i]->binIndex(val)]++;
             }
         }
     }
-
-    _bins.resize(binCount, 0);
-    for (int p = 0; p < parts; p++) {
-        for (size_t b = 0; b < binCount; b++)
-            _bins[b] += partBins[p * binCount + b];
-    }
-    _maxBinVal = _bins[0];
-    for (size_t b = 1; b < binCount; b++) {
-        if (_bins[b] > _maxBinVal)
-            _maxBinVal = _bins[b];
-    }
 }
 
-void Histogram::init(const TGD::ArrayContainer& array, size_t componentIndex, float minVal, float maxVal)
+static void addHelper(const TGD::ArrayContainer& array, const std::vector<size_t>& components,
+        const std::vector<const Histogram*>& histograms, size_t binCount,
+        std::vector<unsigned long long>& partBins)
 {
-    _minVal = minVal;
-    _maxVal = maxVal;
     switch (array.componentType()) {
     case TGD::int8:
-        initHelper<int8_t>(TGD::Array<int8_t>(array), componentIndex, _minVal, _maxVal, 256, _bins, _maxBinVal);
+        addHelper<int8_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::uint8:
-        initHelper<uint8_t>(TGD::Array<uint8_t>(array), componentIndex, _minVal, _maxVal, 256, _bins, _maxBinVal);
+        addHelper<uint8_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::int16:
-        initHelper<int16_t>(TGD::Array<int16_t>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<int16_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::uint16:
-        initHelper<uint16_t>(TGD::Array<uint16_t>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<uint16_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::int32:
-        initHelper<int32_t>(TGD::Array<int32_t>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<int32_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::uint32:
-        initHelper<uint32_t>(TGD::Array<uint32_t>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<uint32_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::int64:
-        initHelper<int64_t>(TGD::Array<int64_t>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<int64_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::uint64:
-        initHelper<uint64_t>(TGD::Array<uint64_t>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<uint64_t>(array, components, histograms, binCount, partBins);
         break;
     case TGD::float32:
-        initHelper<float>(TGD::Array<float>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<float>(array, components, histograms, binCount, partBins);
         break;
     case TGD::float64:
-        initHelper<double>(TGD::Array<double>(array), componentIndex, _minVal, _maxVal, 1024, _bins, _maxBinVal);
+        addHelper<double>(array, components, histograms, binCount, partBins);
         break;
     }
+}
+
+/* Merge the private bins of all threads into the bins of the k components */
+static void mergeHelper(std::vector<unsigned long long>& partBins, size_t binCount,
+        std::vector<std::vector<unsigned long long>*>& bins)
+{
+    size_t k = bins.size();
+    size_t parts = (k > 0 ? partBins.size() / (k * binCount) : 0);
+    for (size_t i = 0; i < k; i++) {
+        bins[i]->resize(binCount, 0);
+        for (size_t p = 0; p < parts; p++) {
+            const unsigned long long* pb = partBins.data() + (p * k + i) * binCount;
+            for (size_t b = 0; b < binCount; b++)
+                (*bins[i])[b] += pb[b];
+        }
+    }
+    std::vector<unsigned long long>().swap(partBins);
+}
+
+void Histogram::init(const TGD::ArrayContainer& array, size_t componentIndex, float minVal, float maxVal)
+{
+    _bins.clear();
+    add(array, componentIndex, minVal, maxVal);
+    finish();
+}
+
+void Histogram::init(const TGD::ArrayContainer& array, std::vector<Histogram>& histograms,
+        const std::vector<float>& minVals, const std::vector<float>& maxVals)
+{
+    std::vector<size_t> components;
+    std::vector<const Histogram*> componentHistograms;
+    std::vector<std::vector<unsigned long long>*> bins;
+    for (size_t c = 0; c < histograms.size(); c++) {
+        if (!histograms[c].initialized()) {
+            histograms[c]._bins.clear();
+            histograms[c].setRange(minVals[c], maxVals[c], binCountForType(array.componentType()));
+            components.push_back(c);
+            componentHistograms.push_back(&(histograms[c]));
+            bins.push_back(&(histograms[c]._bins));
+        }
+    }
+    size_t binCount = binCountForType(array.componentType());
+    std::vector<unsigned long long> partBins;
+    if (components.size() > 0) {
+        addHelper(array, components, componentHistograms, binCount, partBins);
+        mergeHelper(partBins, binCount, bins);
+    }
+    for (size_t i = 0; i < components.size(); i++)
+        histograms[components[i]].finish();
+}
+
+void Histogram::init(const ValueCounts& valueCounts, size_t componentIndex, float minVal, float maxVal)
+{
+    // Each value is mapped to its bin only once, so this is exact and cheap
+    setRange(minVal, maxVal, binCountForType(valueCounts.type()));
+    _bins.assign(_binCount, 0);
+    const std::vector<unsigned long long>& counts = valueCounts.counts(componentIndex);
+    for (size_t v = 0; v < counts.size(); v++) {
+        if (counts[v] > 0)
+            _bins[binIndex(valueCounts.value(v))] += counts[v];
+    }
+    finish();
+}
+
+void Histogram::add(const TGD::ArrayContainer& array, size_t componentIndex, float minVal, float maxVal)
+{
+    setRange(minVal, maxVal, binCountForType(array.componentType()));
+    std::vector<size_t> components(1, componentIndex);
+    std::vector<const Histogram*> histograms(1, this);
+    addHelper(array, components, histograms, _binCount, _partBins);
+}
+
+void Histogram::finish()
+{
+    if (_partBins.size() > 0) {
+        std::vector<std::vector<unsigned long long>*> bins(1, &_bins);
+        mergeHelper(_partBins, _binCount, bins);
+    }
+    _maxBinVal = _bins[0];
+    for (size_t b = 1; b < _bins.size(); b++) {
+        if (_bins[b] > _maxBinVal)
+            _maxBinVal = _bins[b];
+    }
     _initialized = true;
 }
+
+void Histogram::init(float minVal, float maxVal, const std::vector<unsigned long long>& bins)
+{
+    setRange(minVal, maxVal, bins.size());
+    _bins = bins;
+    finish();
+}
+
+/* Cached data: the range as two floats, followed by the bins */
+
+bool Histogram::load(const FrameCache& cache, const std::string& name, float minVal, float maxVal)
+{
+    std::vector<unsigned char> data;
+    if (!cache.load(name, data))
+        return false;
+    float range[2];
+    if (data.size() < sizeof(range) || (data.size() - sizeof(range)) % sizeof(unsigned long long) != 0)
+        return false;
+    std::memcpy(range, data.data(), sizeof(range));
+    if (range[0] != minVal || range[1] != maxVal)
+        return false;
+    _bins.resize((data.size() - sizeof(range)) / sizeof(unsigned long long));
+    if (_bins.size() == 0)
+        return false;
+    // the number of bins determines the mapping
+    setRange(minVal, maxVal, _bins.size());
+    std::memcpy(_bins.data(), data.data() + sizeof(range), _bins.size() * sizeof(unsigned long long));
+    _maxBinVal = _bins[0];
+    for (size_t b = 1; b < _bins.size(); b++) {
+        if (_bins[b] > _maxBinVal)
+            _maxBinVal = _bins[b];
+    }
+    _initialized = true;
+    return true;
+}
+
+void Histogram::store(const FrameCache& cache, const std::string& name) const
+{
+    float range[2] = { _minVal, _maxVal };
+    std::vector<unsigned char> data(sizeof(range) + _bins.size() * sizeof(unsigned long long));
+    std::memcpy(data.data(), range, sizeof(range));
+    std::memcpy(data.data() + sizeof(range), _bins.data(), _bins.size() * sizeof(unsigned long long));
+    cache.store(name, data.data(), data.size());
+}
@@ -28,27 +28,91 @@
 #define QV_HISTOGRAM_HPP
 
 #include <vector>
+#include <cmath>
 
 #include <tgd/array.hpp>
 
+#include "diskcache.hpp"
+#include "valuecounts.hpp"
+
 class Histogram {
+public:
+    // Float data uses this many bins, with adaptive widths: linear near zero
+    // (or near the end of the range that is closest to zero) and logarithmic
+    // further away, so that heavy tails do not squeeze most values into a few
+    // bins. Other data uses 256 (8 bit) or 1024 linear bins.
+    static constexpr int adaptiveBinCount = 65536;
+
 private:
     bool _initialized;
     float _minVal, _maxVal;
     std::vector<unsigned long long> _bins;
+    std::vector<unsigned long long> _partBins; // per-thread bins while add() is used
     unsigned long long _maxBinVal;
+    bool _approximate;
+    /* mapping of values to bins, see setRange(): */
+    int _binCount;
+    bool _adaptive;
+    float _center, _scale, _tMin, _tFactor;
+
+    void setRange(float minVal, float maxVal, int binCount);
+
+    static int clampBin(float f, int binCount)
+    {
+        // NaN (from an empty range) goes to the first bin
+        return (f >= binCount ? binCount - 1 : f > 0.0f ? int(f) : 0);
+    }
 
 public:
     Histogram();
     bool initialized() const { return _initialized; }
-    void invalidate() { _initialized = false; }
+    void invalidate() { _initialized = false; _approximate = false; _bins.clear(); _partBins.clear(); }
+    // Mark as an estimate computed from a subsample
+    void setApproximate() { _approximate = true; }
+    bool approximate() const { return _approximate; }
     void init(const TGD::ArrayContainer& array, size_t componentIndex, float minVal, float maxVal);
+    // Initialize the histograms of all components of the array that are not
+    // initialized yet, with the given ranges, in a single pass over the data
+    static void init(const TGD::ArrayContainer& array, std::vector<Histogram>& histograms,
+            const std::vector<float>& minVals, const std::vector<float>& maxVals);
+    // Alternative to init() for 8 and 16 bit integer data that does not look at the data again
+    void init(const ValueCounts& valueCounts, size_t componentIndex, float minVal, float maxVal);
+    // Alternative to init() for data that is split into several arrays, e.g.
+    // tiles: call add() with the same range for each array, then finish()
+    void add(const TGD::ArrayContainer& array, size_t componentIndex, float minVal, float maxVal);
+    void finish();
+    // Alternative to init() for linear bins that were counted elsewhere, see binIndex()
+    void init(float minVal, float maxVal, const std::vector<unsigned long long>& bins);
+    // alternative to init(); fails if the cached histogram has a different range
+    bool load(const FrameCache& cache, const std::string& name, float minVal, float maxVal);
+    void store(const FrameCache& cache, const std::string& name) const;
     float minVal() const { return _minVal; }
     float maxVal() const { return _maxVal; }
     float maxBinVal() const { return _maxBinVal; }
     int binCount() const { return _bins.size(); }
     int binVal(int index) const { return _bins[index]; }
-    int binIndex(float value) const;
+    bool adaptive() const { return _adaptive; }
+
+    int binIndex(float value) const
+    {
+        float f = (_adaptive
+                ? (std::asinh((value - _center) / _scale) - _tMin) * _tFactor
+                : (value - _minVal) / (_maxVal - _minVal) * _binCount);
+        return clampBin(f, _binCount);
+    }
+    // The smallest value of a bin; binLowerBound(binCount()) is maxVal()
+    double binLowerBound(int index) const;
+    // The bins redistributed to the given number of equally wide bins for
+    // the given range, e.g. one per pixel for display. Counts of bins that
+    // overlap several of the new bins are split proportionally, and values
+    // outside of the range count for the first or last bin.
+    std::vector<float> reduce(int binCount, float minVal, float maxVal) const;
+
+    // The linear bin of a value for the given range and number of bins
+    static int binIndex(float value, float minVal, float maxVal, int binCount)
+    {
+        return clampBin((value - minVal) / (maxVal - minVal) * binCount, binCount);
+    }
 };
 
 #endif
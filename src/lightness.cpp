@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "lightness.hpp"
+#include "alloc.hpp"
+
+
+Lightness::Lightness() :
+    _colorSpace(ColorSpaceNone), _colorChannels { -1, -1, -1 },
+    _compact(false), _tilesX(0), _tilesY(0)
+{
+}
+
+void Lightness::init(const TGD::ArrayContainer& originalArray, ColorSpace colorSpace,
+        const int colorChannels[3], bool compact, const FrameCache& cache)
+{
+    _originalArray = originalArray;
+    _colorSpace = colorSpace;
+    for (int i = 0; i < 3; i++)
+        _colorChannels[i] = colorChannels[i];
+    _cache = cache;
+    // only integer data has bounded lightness values
+    _compact = compact
+        && originalArray.componentType() != TGD::float32
+        && originalArray.componentType() != TGD::float64;
+    int w = originalArray.dimension(0);
+    int h = originalArray.dimension(1);
+    _tilesX = w / tileSize + (w % tileSize ? 1 : 0);
+    _tilesY = h / tileSize + (h % tileSize ? 1 : 0);
+    _tiles.clear();
+    _tiles.resize(_tilesX * _tilesY);
+    _tileAllocations.clear();
+    _tileAllocations.resize(_tilesX * _tilesY);
+}
+
+void Lightness::update(const TGD::ArrayContainer& originalArray, const FrameCache& cache)
+{
+    _originalArray = originalArray;
+    _cache = cache;
+}
+
+void Lightness::reset()
+{
+    *this = Lightness();
+}
+
+void Lightness::releaseEvictedTiles()
+{
+    for (size_t i = 0; i < _tiles.size(); i++) {
+        if (_tileAllocations[i] && _tileAllocations[i]->evicted()) {
+            //fprintf(stderr, "dropping lightness tile %zu\n", i);
+            _tiles[i] = TGD::ArrayContainer();
+            _tileAllocations[i].reset();
+        }
+    }
+}
+
+int Lightness::tileWidth(int tx) const
+{
+    return std::min(int(_originalArray.dimension(0)) - tx * tileSize, tileSize);
+}
+
+int Lightness::tileHeight(int ty) const
+{
+    return std::min(int(_originalArray.dimension(1)) - ty * tileSize, tileSize);
+}
+
+template<typename T>
+static float normalize(T value)
+{
+    // for integer types, convert original value range to [0,1]
+    // for floating point types, do nothing
+    float normalizedValue = value;
+    if (std::is_integral<T>::value) {
+        float minVal = std::numeric_limits<T>::min();
+        float maxVal = std::numeric_limits<T>::max();
+        normalizedValue = (value - minVal) / (maxVal - minVal);
+    }
+    return normalizedValue;
+}
+
+/* The lightness is computed line by line in three steps that the compiler can
+ * vectorize: gather the color channels into separate arrays of normalized
+ * linear values, combine them to Y, and convert Y to L*. Integer types with 8
+ * or 16 bits use lookup tables for the first step, which avoids both the
+ * normalization and the powf() of the sRGB transfer function. */
+
+template<typename T>
+static std::vector<float> makeLookupTable(bool s)
+{
+    std::vector<float> table(size_t(1) << (8 * sizeof(T)));
+    for (size_t i = 0; i < table.size(); i++) {
+        float v = normalize(T(i + std::numeric_limits<T>::min()));
+        table[i] = (s ? toLinear(v) : v);
+    }
+    return table;
+}
+
+template<typename T>
+static const float* lookupTable(bool s)
+{
+    // indexed by the value minus the minimum value of the type
+    static const std::vector<float> linearTable = makeLookupTable<T>(false);
+    static const std::vector<float> sTable = makeLookupTable<T>(true);
+    return (s ? sTable : linearTable).data();
+}
+
+template<typename T>
+static void linearLine(float* dst, size_t n, const T* src, int cc, int c, bool s)
+{
+    if constexpr (std::is_integral<T>::value && sizeof(T) <= 2) {
+        const float* table = lookupTable<T>(s);
+        for (size_t e = 0; e < n; e++)
+            dst[e] = table[int(src[e * cc + c]) - int(std::numeric_limits<T>::min())];
+    } else if (s) {
+        for (size_t e = 0; e < n; e++)
+            dst[e] = toLinear(normalize(src[e * cc + c]));
+    } else {
+        for (size_t e = 0; e < n; e++)
+            dst[e] = normalize(src[e * cc + c]);
+    }
+}
+
+/* Cube root for positive normal numbers: an initial guess from the exponent
+ * bits followed by two Newton iterations. The relative error is below 2e-6,
+ * which means an error below 2e-4 in L*. */
+static inline float fastCbrt(float x)
+{
+    uint32_t i;
+    std::memcpy(&i, &x, sizeof(i));
+    i = i / 3 + 709921077u;
+    float y;
+    std::memcpy(&y, &i, sizeof(y));
+    y = (2.0f / 3.0f) * y + x / (3.0f * y * y);
+    y = (2.0f / 3.0f) * y + x / (3.0f * y * y);
+    return y;
+}
+
+static void YToLLine(float* lightness, size_t n)
+{
+    // same as YToL(), in place
+    constexpr float one_over_d65_y = 0.01f;
+    constexpr float c0 = 0.00885645167904f;
+    constexpr float c1 = 903.296296296f;
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    for (size_t e = 0; e < n; e++) {
+        float ratio = one_over_d65_y * lightness[e];
+        float L = (ratio <= c0 ? c1 * ratio : 116.0f * fastCbrt(ratio) - 16.0f);
+        lightness[e] = (ratio == inf ? inf : L);
+    }
+}
+
+template<typename T>
+static void lightnessTileHelper(TGD::Array<float>& tile, const TGD::ArrayContainer& src, size_t x0, size_t y0,
+        ColorSpace colorSpace, const int colorChannels[3])
+{
+    size_t w = tile.dimension(0);
+    size_t h = tile.dimension(1);
+    int cc = src.componentCount();
+    bool s = (colorSpace == ColorSpaceSGray || colorSpace == ColorSpaceSRGB);
+    #pragma omp parallel for
+    for (size_t y = 0; y < h; y++) {
+        float* l = tile[{ 0, y }];
+        const T* line = static_cast<const T*>(src.get({ x0, y0 + y }));
+        float r[Lightness::tileSize], g[Lightness::tileSize], b[Lightness::tileSize];
+        switch (colorSpace) {
+        case ColorSpaceNone:
+            break;
+        case ColorSpaceLinearGray:
+        case ColorSpaceSGray:
+            linearLine(l, w, line, cc, colorChannels[0], s);
+            for (size_t e = 0; e < w; e++)
+                l[e] = rgbToY(l[e], l[e], l[e]);
+            YToLLine(l, w);
+            break;
+        case ColorSpaceLinearRGB:
+        case ColorSpaceSRGB:
+            linearLine(r, w, line, cc, colorChannels[0], s);
+            linearLine(g, w, line, cc, colorChannels[1], s);
+            linearLine(b, w, line, cc, colorChannels[2], s);
+            for (size_t e = 0; e < w; e++)
+                l[e] = rgbToY(r[e], g[e], b[e]);
+            YToLLine(l, w);
+            break;
+        case ColorSpaceY:
+        case ColorSpaceXYZ:
+            linearLine(l, w, line, cc, colorChannels[colorSpace == ColorSpaceY ? 0 : 1], false);
+            if (std::is_integral<T>::value)
+                for (size_t e = 0; e < w; e++)
+                    l[e] *= 100.0f;
+            YToLLine(l, w);
+            break;
+        }
+    }
+}
+
+void Lightness::computeTile(TGD::Array<float>& tile, int tx, int ty) const
+{
+    //fprintf(stderr, "computing lightness tile %d,%d\n", tx, ty);
+    size_t x0 = tx * tileSize;
+    size_t y0 = ty * tileSize;
+    switch (_originalArray.componentType()) {
+    case TGD::int8:
+        lightnessTileHelper<int8_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::uint8:
+        lightnessTileHelper<uint8_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::int16:
+        lightnessTileHelper<int16_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::uint16:
+        lightnessTileHelper<uint16_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::int32:
+        lightnessTileHelper<int32_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::uint32:
+        lightnessTileHelper<uint32_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::int64:
+        lightnessTileHelper<int64_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::uint64:
+        lightnessTileHelper<uint64_t>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::float32:
+        lightnessTileHelper<float>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    case TGD::float64:
+        lightnessTileHelper<double>(tile, _originalArray, x0, y0, _colorSpace, _colorChannels);
+        break;
+    }
+}
+
+/* Compact tiles store L* in [0,100] quantized to 16 bit */
+
+static const float compactFactor = 65535.0f / 100.0f;
+
+static uint16_t toCompact(float l)
+{
+    return std::round(std::min(std::max(l, 0.0f), 100.0f) * compactFactor);
+}
+
+static float fromCompact(uint16_t c)
+{
+    return c / compactFactor;
+}
+
+TGD::ArrayContainer Lightness::tile(int tx, int ty)
+{
+    int ti = ty * _tilesX + tx;
+    if (_tiles[ti].elementCount() == 0) {
+        std::vector<size_t> dims = { size_t(tileWidth(tx)), size_t(tileHeight(ty)) };
+        TGD::ArrayContainer t(dims, 1, _compact ? TGD::uint16 : TGD::float32, defaultAllocator());
+        std::string cacheName = std::string(_compact ? "lightness16-" : "lightness-")
+            + std::to_string(tx) + '-' + std::to_string(ty);
+        if (!_cache.load(cacheName, t)) {
+            // compact tiles are computed in a temporary float tile
+            TGD::Array<float> floatTile = (_compact ? TGD::Array<float>(dims, 1) : TGD::Array<float>(t));
+            computeTile(floatTile, tx, ty);
+            if (_compact) {
+                uint16_t* dst = static_cast<uint16_t*>(t.data());
+                for (size_t i = 0; i < floatTile.elementCount(); i++)
+                    dst[i] = toCompact(floatTile[i][0]);
+            }
+            _cache.store(cacheName, t);
+        }
+        _tiles[ti] = t;
+        _tileAllocations[ti] = defaultMemoryBudget().add(MemoryRAM, t.dataSize(), true);
+        defaultMemoryBudget().enforce();
+        releaseEvictedTiles();
+        return t;
+    } else {
+        _tileAllocations[ti]->touch();
+        return _tiles[ti];
+    }
+}
+
+float Lightness::value(int x, int y)
+{
+    TGD::ArrayContainer t = tile(x / tileSize, y / tileSize);
+    size_t tileX = x % tileSize;
+    size_t tileY = y % tileSize;
+    if (_compact)
+        return fromCompact(t.get<uint16_t>({ tileX, tileY }, 0));
+    else
+        return t.get<float>({ tileX, tileY }, 0);
+}
+
+TGD::ArrayContainer Lightness::floatTile(int tx, int ty)
+{
+    TGD::ArrayContainer t = tile(tx, ty);
+    if (_compact) {
+        TGD::Array<float> floatTile(t.dimensions(), 1, TGD::Allocator());
+        const uint16_t* src = static_cast<const uint16_t*>(t.data());
+        for (size_t i = 0; i < floatTile.elementCount(); i++)
+            floatTile[i][0] = fromCompact(src[i]);
+        return floatTile;
+    } else {
+        return t;
+    }
+}
+
+void Lightness::forEachTile(const std::function<void (const TGD::ArrayContainer&)>& f)
+{
+    for (int ty = 0; ty < _tilesY; ty++)
+        for (int tx = 0; tx < _tilesX; tx++)
+            f(floatTile(tx, ty));
+}
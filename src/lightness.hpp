@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_LIGHTNESS_HPP
+#define QV_LIGHTNESS_HPP
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <tgd/array.hpp>
+
+#include "color.hpp"
+#include "diskcache.hpp"
+#include "memorybudget.hpp"
+
+
+/* The perceptually linear lightness L* (from CIELUV) of the color channels of
+ * a frame. It is computed lazily in tiles, so that querying single values does
+ * not require computing the lightness of the whole frame. Tiles count against
+ * the RAM budget of the default memory budget and are computed again when
+ * needed after they were evicted.
+ *
+ * For integer data, L* is bounded to [0,100], and tiles can optionally be
+ * stored as 16 bit quantized values instead of floats to save memory. */
+class Lightness {
+private:
+    TGD::ArrayContainer _originalArray;
+    ColorSpace _colorSpace;
+    int _colorChannels[3];
+    FrameCache _cache;
+    bool _compact;
+    int _tilesX, _tilesY;
+    std::vector<TGD::ArrayContainer> _tiles;
+    std::vector<std::shared_ptr<MemoryAllocation>> _tileAllocations;
+
+    int tileWidth(int tx) const;
+    int tileHeight(int ty) const;
+    void computeTile(TGD::Array<float>& tile, int tx, int ty) const;
+    TGD::ArrayContainer tile(int tx, int ty);
+
+public:
+    static constexpr int tileSize = 512;
+
+    Lightness();
+
+    // The color channels must be valid for the given color space
+    void init(const TGD::ArrayContainer& originalArray, ColorSpace colorSpace,
+            const int colorChannels[3], bool compact, const FrameCache& cache);
+    // Replace the data with an array that has the same contents, keeping all tiles
+    void update(const TGD::ArrayContainer& originalArray, const FrameCache& cache);
+    void reset();
+    bool initialized() const { return _tiles.size() > 0; }
+
+    // Drop tiles that the memory budget evicted
+    void releaseEvictedTiles();
+
+    float value(int x, int y);
+    // The lightness of one tile, in float format
+    int tilesX() const { return _tilesX; }
+    int tilesY() const { return _tilesY; }
+    TGD::ArrayContainer floatTile(int tx, int ty);
+    // Call the given function for the lightness of each tile, in float format
+    void forEachTile(const std::function<void (const TGD::ArrayContainer&)>& f);
+};
+
+#endif
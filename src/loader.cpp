@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "loader.hpp"
+#include "alloc.hpp"
+#include "diskcache.hpp"
+#include "memorybudget.hpp"
+#include "mappedimport.hpp"
+
+
+static int loaderPrefetchDistance = 1;
+
+void Loader::setPrefetchDistance(int distance)
+{
+    loaderPrefetchDistance = distance;
+}
+
+int Loader::prefetchDistance()
+{
+    return loaderPrefetchDistance;
+}
+
+Loader::Loader() :
+    _stopping(false),
+    _requestId(0), _pending(false), _requestStarted(true), _dropImporter(false),
+    _nextPrefetchItem(0), _waitForQuads(true),
+    _haveResult(false)
+{
+    _thread = std::thread([this]() { work(); });
+}
+
+Loader::~Loader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_one();
+    _thread.join();
+}
+
+bool Loader::isWanted(const Item& item) const
+{
+    return (!_requestStarted && item == _request)
+        || std::find(_prefetchItems.begin(), _prefetchItems.end(), item) != _prefetchItems.end();
+}
+
+TGD::ArrayContainer Loader::read(const Item& item, bool dropImporter, std::string& errorMessage)
+{
+    // files that can be mapped do not need to be read
+    if (item.arrayIndex == 0) {
+        TGD::ArrayContainer array = mapArray(item.fileName, item.importerHints);
+        if (array.elementCount() > 0)
+            return array;
+    }
+    // keep the importer open when reading several arrays from the same file
+    if (dropImporter || _importer.fileName() != item.fileName)
+        _importer = TGD::Importer(item.fileName, item.importerHints);
+    TGD::Error tgdError = TGD::ErrorNone;
+    TGD::ArrayContainer array = _importer.readArray(&tgdError, item.arrayIndex, defaultAllocator());
+    //fprintf(stderr, "loader: read %s array %d\n", item.fileName.c_str(), item.arrayIndex);
+    if (tgdError != TGD::ErrorNone) {
+        errorMessage = item.fileName + ": " + TGD::strerror(tgdError);
+        _importer = TGD::Importer();
+        return TGD::ArrayContainer();
+    }
+    return array;
+}
+
+void Loader::work()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _cond.wait(lock, [this]() { return _stopping || !_requestStarted
+                || _nextPrefetchItem < _prefetchItems.size(); });
+        if (_stopping)
+            break;
+        bool dropImporter = _dropImporter;
+        _dropImporter = false;
+        if (!_requestStarted) {
+            _requestStarted = true;
+            unsigned long long requestId = _requestId;
+            Item item = _request;
+            auto it = std::find_if(_prefetched.begin(), _prefetched.end(),
+                    [&](const Prefetched& p) { return p.item == item; });
+            if (it != _prefetched.end()) {
+                _haveResult = true;
+                _resultFrame = it->frame;
+                _resultErrorMessage.clear();
+                _prefetched.erase(it);
+                continue;
+            }
+            lock.unlock();
+            std::string errorMessage;
+            TGD::ArrayContainer array = read(item, dropImporter, errorMessage);
+            lock.lock();
+            if (requestId == _requestId) {
+                _haveResult = true;
+                _resultArray = array;
+                _resultErrorMessage = errorMessage;
+            } else if (array.elementCount() > 0 && isWanted(item)) {
+                // superseded, but a neighbor of the new request
+                lock.unlock();
+                std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+                frame->init(array, defaultDiskCache().frameCache(item.fileName, item.arrayIndex));
+                lock.lock();
+                if (isWanted(item))
+                    _prefetched.push_back({ item, frame });
+            }
+        } else {
+            Item item = _prefetchItems[_nextPrefetchItem++];
+            bool waitForQuads = _waitForQuads;
+            if (std::find_if(_prefetched.begin(), _prefetched.end(),
+                        [&](const Prefetched& p) { return p.item == item; }) != _prefetched.end())
+                continue;
+            lock.unlock();
+            std::string errorMessage;
+            TGD::ArrayContainer array = read(item, dropImporter, errorMessage);
+            std::shared_ptr<Frame> frame;
+            bool haveRoom = (array.elementCount() == 0 || isMapped(array)
+                    || defaultMemoryBudget().hasRoom(MemoryRAM, array.dataSize()));
+            if (array.elementCount() > 0 && haveRoom) {
+                //fprintf(stderr, "loader: prefetching %s array %d\n", item.fileName.c_str(), item.arrayIndex);
+                frame = std::make_shared<Frame>();
+                frame->init(array, defaultDiskCache().frameCache(item.fileName, item.arrayIndex));
+                bool requestWaiting;
+                {
+                    std::lock_guard<std::mutex> lock2(_mutex);
+                    requestWaiting = !_requestStarted;
+                }
+                // do not let a new request wait for the expensive part
+                if (!requestWaiting)
+                    frame->precompute(waitForQuads);
+            }
+            lock.lock();
+            if (frame && isWanted(item))
+                _prefetched.push_back({ item, frame });
+            if (!haveRoom)
+                _nextPrefetchItem = _prefetchItems.size();
+            // errors are ignored here; they are reported when the array is requested
+        }
+    }
+}
+
+void Loader::request(const Item& item, const std::vector<Item>& prefetchItems)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requestId++;
+        _pending = true;
+        _requestStarted = false;
+        _request = item;
+        _haveResult = false;
+        _resultArray = TGD::ArrayContainer();
+        _resultFrame.reset();
+    }
+    prefetch(prefetchItems);
+}
+
+void Loader::prefetch(const std::vector<Item>& prefetchItems, bool waitForQuads)
+{
+    std::vector<Prefetched> dropped;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _prefetchItems = prefetchItems;
+        _nextPrefetchItem = 0;
+        _waitForQuads = waitForQuads;
+        for (size_t i = 0; i < _prefetched.size(); ) {
+            if (isWanted(_prefetched[i].item)) {
+                i++;
+            } else {
+                dropped.push_back(_prefetched[i]);
+                _prefetched.erase(_prefetched.begin() + i);
+            }
+        }
+    }
+    _cond.notify_one();
+    // the dropped frames are destroyed here, without the lock held
+}
+
+std::shared_ptr<Frame> Loader::takePrefetched(const Item& item)
+{
+    std::shared_ptr<Frame> frame;
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find_if(_prefetched.begin(), _prefetched.end(),
+            [&](const Prefetched& p) { return p.item == item; });
+    // the quadtree is thread-safe, so it can be queried here
+    if (it != _prefetched.end() && it->frame->topQuadIsReady()) {
+        frame = it->frame;
+        _prefetched.erase(it);
+    }
+    return frame;
+}
+
+void Loader::cancel()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _requestId++;
+    _pending = false;
+    _requestStarted = true;
+    _haveResult = false;
+    _resultArray = TGD::ArrayContainer();
+    _resultFrame.reset();
+}
+
+void Loader::reset()
+{
+    cancel();
+    std::vector<Prefetched> dropped;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _dropImporter = true;
+        _prefetchItems.clear();
+        _nextPrefetchItem = 0;
+        dropped.swap(_prefetched);
+    }
+}
+
+bool Loader::pending()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
+
+bool Loader::result(TGD::ArrayContainer& array, std::shared_ptr<Frame>& frame, std::string& errorMessage)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_pending || !_haveResult)
+        return false;
+    array = _resultArray;
+    frame = _resultFrame;
+    errorMessage = _resultErrorMessage;
+    _pending = false;
+    _haveResult = false;
+    _resultArray = TGD::ArrayContainer();
+    _resultFrame.reset();
+    return true;
+}
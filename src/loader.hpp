@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_LOADER_HPP
+#define QV_LOADER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <tgd/io.hpp>
+
+#include "frame.hpp"
+
+/* Reads arrays from files in a background thread so that the GUI stays
+ * responsive. Only the latest request matters: a new request replaces a
+ * request that was not started yet, and the result of a request that was
+ * superseded or canceled while its array was being read is dropped.
+ *
+ * While there is no request to serve, the neighbors of the latest request
+ * are prefetched: their frames are initialized and precomputed (see
+ * Frame::precompute()) and kept until they are requested or are no longer
+ * neighbors of the latest request. Prefetching stops while the RAM budget of
+ * the default memory budget is full. */
+class Loader {
+public:
+    // An array in a file
+    struct Item {
+        std::string fileName;
+        TGD::TagList importerHints;
+        int arrayIndex;
+
+        Item() : arrayIndex(-1) {}
+        Item(const std::string& f, const TGD::TagList& h, int i) : fileName(f), importerHints(h), arrayIndex(i) {}
+        bool operator==(const Item& other) const { return arrayIndex == other.arrayIndex && fileName == other.fileName; }
+    };
+
+private:
+    struct Prefetched {
+        Item item;
+        std::shared_ptr<Frame> frame;
+    };
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _stopping;
+    /* the latest request: */
+    unsigned long long _requestId;
+    bool _pending;
+    bool _requestStarted;
+    Item _request;
+    bool _dropImporter;
+    /* its neighbors, and the ones that were prefetched so far: */
+    std::vector<Item> _prefetchItems;
+    size_t _nextPrefetchItem;
+    bool _waitForQuads;
+    std::vector<Prefetched> _prefetched;
+    /* the result of the latest request, if available: */
+    bool _haveResult;
+    TGD::ArrayContainer _resultArray;
+    std::shared_ptr<Frame> _resultFrame;
+    std::string _resultErrorMessage;
+    /* only used by the background thread: */
+    TGD::Importer _importer;
+
+    bool isWanted(const Item& item) const;
+    void work();
+    TGD::ArrayContainer read(const Item& item, bool dropImporter, std::string& errorMessage);
+
+public:
+    Loader();
+    ~Loader();
+    Loader(const Loader&) = delete;
+    Loader& operator=(const Loader&) = delete;
+
+    // Number of frames and files before and after the current one to prefetch (global setting)
+    static void setPrefetchDistance(int distance);
+    static int prefetchDistance();
+
+    // Read the given array, superseding all previous requests, and prefetch
+    // the given neighbors afterwards, in the given order
+    void request(const Item& item, const std::vector<Item>& prefetchItems = std::vector<Item>());
+    // Only replace the neighbors to prefetch, e.g. after a frame was read
+    // synchronously. If waitForQuads is false, the top level quad of a
+    // prefetched frame is computed in the background while the next one is
+    // read (see Frame::precompute()).
+    void prefetch(const std::vector<Item>& prefetchItems, bool waitForQuads = true);
+    // Take a prefetched frame if it is available and its top level quad is
+    // ready (see Frame::topQuadIsReady()), without waiting
+    std::shared_ptr<Frame> takePrefetched(const Item& item);
+    // Drop the current request
+    void cancel();
+    // Drop the current request and all prefetched frames, and forget open
+    // files because they might have changed
+    void reset();
+    // Whether there is a request whose result was not collected yet
+    bool pending();
+    // Collect the result of the current request if it is available: either
+    // the array, or a prefetched frame (then the array is empty)
+    bool result(TGD::ArrayContainer& array, std::shared_ptr<Frame>& frame, std::string& errorMessage);
+};
+
+#endif
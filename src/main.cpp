@@ -48,7 +48,13 @@
 
 #include "version.hpp"
 #include "alloc.hpp"
+#include "diskcache.hpp"
+#include "memorybudget.hpp"
+#include "threadpool.hpp"
+#include "loader.hpp"
+#include "recentframes.hpp"
 #include "set.hpp"
+#include "frame.hpp"
 #include "gl.hpp"
 #include "gui.hpp"
 
@@ -67,6 +73,14 @@ int main(int argc, char* argv[])
     parser.addOptions({
             { { "i", "input" }, "Set tag for import (can be given more than once).", "KEY=VALUE" },
             { { "C", "cache-dir" }, "Set directory for cache files. ", "directory" },
+            { "cache-size", "Limit the cache for computed data to the given number of MiB (default 8192, 0 means no limit).", "SIZE" },
+            { "memory-budget", "Limit memory usage for frame data to the given number of MiB of RAM and of VRAM (0 means no limit).", "RAM[,VRAM]" },
+            { "half-float-pyramid", "Store coarse levels of float data as half floats to save memory." },
+            { "compact-lightness", "Store the lightness of integer color data with 16 bits to save memory." },
+            { "percentile-range", "Start with the visible range from the P and 100-P percentiles instead of minimum and maximum (e.g. 0.5).", "P" },
+            { "prefetch", "Prefetch the N previous and next frames and files in the background (default 1, 0 disables prefetching).", "N" },
+            { "recent-frames", "Keep up to N recently viewed frames in memory (default 8, 0 disables this).", "N" },
+            { "fps", "Set the target frames per second for playback (default 25).", "F" },
     });
     parser.process(app);
     QStringList posArgs = parser.positionalArguments();
@@ -84,6 +98,86 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Evaluate the --memory-budget option
+    size_t ramBudget = 0;
+    size_t vramBudget = 0;
+    if (parser.isSet("memory-budget")) {
+        QStringList budgets = parser.value("memory-budget").split(',');
+        bool ok = (budgets.size() <= 2);
+        unsigned long long ramMiB = (ok ? budgets[0].toULongLong(&ok) : 0);
+        unsigned long long vramMiB = 0;
+        if (ok && budgets.size() == 2)
+            vramMiB = budgets[1].toULongLong(&ok);
+        if (!ok) {
+            fprintf(stderr, "invalid argument for --memory-budget\n");
+            return 1;
+        }
+        ramBudget = ramMiB * 1024 * 1024;
+        vramBudget = vramMiB * 1024 * 1024;
+    }
+
+    // Evaluate the --half-float-pyramid option
+    Frame::setHalfFloatPyramid(parser.isSet("half-float-pyramid"));
+
+    // Evaluate the --compact-lightness option
+    Frame::setCompactLightness(parser.isSet("compact-lightness"));
+
+    // Evaluate the --percentile-range option
+    if (parser.isSet("percentile-range")) {
+        bool ok;
+        float percentile = parser.value("percentile-range").toFloat(&ok);
+        if (!ok || !(percentile >= 0.0f && percentile < 50.0f)) {
+            fprintf(stderr, "invalid argument for --percentile-range\n");
+            return 1;
+        }
+        QV::setPercentileRange(percentile);
+    }
+
+    // Evaluate the --prefetch option
+    if (parser.isSet("prefetch")) {
+        bool ok;
+        int distance = parser.value("prefetch").toInt(&ok);
+        if (!ok || distance < 0) {
+            fprintf(stderr, "invalid argument for --prefetch\n");
+            return 1;
+        }
+        Loader::setPrefetchDistance(distance);
+    }
+
+    // Evaluate the --recent-frames option
+    if (parser.isSet("recent-frames")) {
+        bool ok;
+        int n = parser.value("recent-frames").toInt(&ok);
+        if (!ok || n < 0) {
+            fprintf(stderr, "invalid argument for --recent-frames\n");
+            return 1;
+        }
+        RecentFrames::setMaxFrames(n);
+    }
+
+    // Evaluate the --fps option
+    if (parser.isSet("fps")) {
+        bool ok;
+        float fps = parser.value("fps").toFloat(&ok);
+        if (!ok || !(fps > 0.0f && fps <= 1000.0f)) {
+            fprintf(stderr, "invalid argument for --fps\n");
+            return 1;
+        }
+        QV::setPlaybackFps(fps);
+    }
+
+    // Evaluate the --cache-size option
+    size_t cacheSize = size_t(8192) * 1024 * 1024;
+    if (parser.isSet("cache-size")) {
+        bool ok;
+        unsigned long long cacheMiB = parser.value("cache-size").toULongLong(&ok);
+        if (!ok) {
+            fprintf(stderr, "invalid argument for --cache-size\n");
+            return 1;
+        }
+        cacheSize = cacheMiB * 1024 * 1024;
+    }
+
     // Initialize the TGD Allocator (must be done before initializing the set)
     std::string cacheDir;
     if (parser.isSet("cache-dir")) {
@@ -95,6 +189,15 @@ int main(int argc, char* argv[])
     }
     Allocator alloc(cacheDir);
 
+    // Initialize the persistent cache for computed data
+    DiskCache diskCache(cacheDir, cacheSize);
+
+    // Keep track of memory usage; must outlive the set and the worker threads
+    MemoryBudget memoryBudget(ramBudget, vramBudget);
+
+    // Start the worker threads for background computations
+    ThreadPool threadPool;
+
     // Build the set of files to view
     Set set;
     set.setImporterHints(importerHints);
@@ -108,11 +211,16 @@ int main(int argc, char* argv[])
                 for (auto& p: std::filesystem::directory_iterator(name))
                     paths.push_back(p.path().string());
                 std::sort(paths.begin(), paths.end());
-                for (size_t i = 0; i < paths.size(); i++) {
+                // Directories can be huge, so only the file that is shown
+                // first is checked now, and the others in the background
+                size_t i = 0;
+                while (set.fileCount() == 0 && i < paths.size()) {
                     if (!set.addFile(paths[i], errMsg)) {
                         fprintf(stderr, "ignoring %s\n", errMsg.c_str());
                     }
+                    i++;
                 }
+                set.addFilesUnchecked(std::vector<std::string>(paths.begin() + i, paths.end()));
             } else {
                 if (!set.addFile(name, errMsg)) {
                     err = true;
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if __has_include(<sys/mman.h>)
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define HAVE_MMAP 1
+#endif
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <filesystem>
+
+#include "mappedimport.hpp"
+
+
+static bool hostIsLittleEndian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+/* Read the next whitespace-separated token of a PFM header */
+static bool nextToken(const char* header, size_t headerSize, size_t& pos, std::string& token)
+{
+    while (pos < headerSize && std::isspace(static_cast<unsigned char>(header[pos])))
+        pos++;
+    token.clear();
+    while (pos < headerSize && !std::isspace(static_cast<unsigned char>(header[pos])))
+        token.push_back(header[pos++]);
+    return token.size() > 0 && pos < headerSize;
+}
+
+/* Determine the description of the array in a PFM file and the offset of its
+ * data, if the file can be mapped */
+static bool parsePFMHeader(const std::string& fileName, size_t fileSize,
+        TGD::ArrayDescription& description, size_t& dataOffset)
+{
+    char header[128];
+    FILE* f = std::fopen(fileName.c_str(), "rb");
+    if (!f)
+        return false;
+    size_t headerSize = std::fread(header, 1, sizeof(header), f);
+    std::fclose(f);
+
+    // PFM: "PF" (RGB) or "Pf" (gray), width, height, scale; the sign of
+    // the scale gives the byte order, and exactly one whitespace character
+    // follows it
+    size_t pos = 0;
+    std::string magic, width, height, scale;
+    if (!nextToken(header, headerSize, pos, magic) || (magic != "PF" && magic != "Pf")
+            || !nextToken(header, headerSize, pos, width)
+            || !nextToken(header, headerSize, pos, height)
+            || !nextToken(header, headerSize, pos, scale))
+        return false;
+    char* end;
+    long w = std::strtol(width.c_str(), &end, 10);
+    if (*end != '\0' || w < 1)
+        return false;
+    long h = std::strtol(height.c_str(), &end, 10);
+    if (*end != '\0' || h < 1)
+        return false;
+    float s = std::strtof(scale.c_str(), &end);
+    if (*end != '\0' || !std::isfinite(s) || s == 0.0f)
+        return false;
+    if ((s < 0.0f) != hostIsLittleEndian())
+        return false;
+    dataOffset = pos + 1;
+    // float data must be properly aligned in memory
+    if (dataOffset % sizeof(float) != 0)
+        return false;
+    size_t components = (magic == "PF" ? 3 : 1);
+    description = TGD::ArrayDescription({ size_t(w), size_t(h) }, components, TGD::float32);
+    // the file must contain exactly this one array
+    if (dataOffset + description.dataSize() != fileSize)
+        return false;
+    if (components == 3) {
+        description.componentTagList(0).set("INTERPRETATION", "RED");
+        description.componentTagList(1).set("INTERPRETATION", "GREEN");
+        description.componentTagList(2).set("INTERPRETATION", "BLUE");
+    } else {
+        description.componentTagList(0).set("INTERPRETATION", "GRAY");
+    }
+    return true;
+}
+
+/* Determine the description of the array in a raw file from the importer
+ * hints DIMENSIONS, COMPONENTS and TYPE, which the TGD importer requires for
+ * such files anyway. Raw data is stored in host byte order, starting at
+ * offset 0, exactly like TGD stores it. */
+static bool parseRawHints(const std::string& fileName, size_t fileSize, const TGD::TagList& hints,
+        TGD::ArrayDescription& description, size_t& dataOffset)
+{
+    std::string format = hints.value("FORMAT");
+    std::string dimensionsHint = hints.value("DIMENSIONS");
+    std::string componentsHint = hints.value("COMPONENTS");
+    std::string typeHint = hints.value("TYPE");
+    if (format.empty() && std::filesystem::path(fileName).extension() != ".raw")
+        return false;
+    if ((!format.empty() && format != "raw")
+            || dimensionsHint.empty() || componentsHint.empty() || typeHint.empty())
+        return false;
+    // any other hint may change how the data is interpreted
+    if (hints.size() != (format.empty() ? 3 : 4))
+        return false;
+
+    std::vector<size_t> dimensions;
+    const char* p = dimensionsHint.c_str();
+    char* end;
+    for (;;) {
+        long d = std::strtol(p, &end, 10);
+        if (end == p || d < 1)
+            return false;
+        dimensions.push_back(d);
+        if (*end == '\0')
+            break;
+        if (*end != ',' && *end != 'x')
+            return false;
+        p = end + 1;
+    }
+    if (dimensions.size() != 2)
+        return false;
+    long components = std::strtol(componentsHint.c_str(), &end, 10);
+    if (*end != '\0' || components < 1)
+        return false;
+    const TGD::Type types[] = { TGD::int8, TGD::uint8, TGD::int16, TGD::uint16, TGD::int32,
+        TGD::uint32, TGD::int64, TGD::uint64, TGD::float32, TGD::float64 };
+    int typeIndex = -1;
+    for (int i = 0; i < int(sizeof(types) / sizeof(types[0])); i++)
+        if (typeHint == TGD::typeToString(types[i]))
+            typeIndex = i;
+    if (typeIndex < 0)
+        return false;
+    description = TGD::ArrayDescription(dimensions, components, types[typeIndex]);
+    dataOffset = 0;
+    // the file must contain exactly this one array
+    return description.dataSize() == fileSize;
+}
+
+static bool parse(const std::string& fileName, const TGD::TagList& hints,
+        TGD::ArrayDescription& description, size_t& dataOffset, size_t& fileSize)
+{
+    std::error_code ec;
+    fileSize = std::filesystem::file_size(fileName, ec);
+    if (ec || fileSize == 0)
+        return false;
+    if (hints.size() == 0)
+        return parsePFMHeader(fileName, fileSize, description, dataOffset);
+    else
+        return parseRawHints(fileName, fileSize, hints, description, dataOffset);
+}
+
+/* The active mappings, so that mapped arrays can be recognized */
+struct Mapping {
+    size_t size;
+    int sequentialScans;
+    /* the identity of the file when it was mapped: */
+    std::string fileName;
+    std::filesystem::file_time_type mtime;
+};
+static std::mutex mappingsMutex;
+static std::map<const unsigned char*, Mapping> mappings;
+
+static std::map<const unsigned char*, Mapping>::iterator findMapping(const void* data)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    auto it = mappings.upper_bound(p);
+    if (it == mappings.begin())
+        return mappings.end();
+    --it;
+    return (p < it->first + it->second.size ? it : mappings.end());
+}
+
+bool isMappable(const std::string& fileName, const TGD::TagList& hints)
+{
+#ifdef HAVE_MMAP
+    TGD::ArrayDescription description;
+    size_t dataOffset, fileSize;
+    return parse(fileName, hints, description, dataOffset, fileSize);
+#else
+    return false;
+#endif
+}
+
+TGD::ArrayContainer mapArray(const std::string& fileName, const TGD::TagList& hints)
+{
+#ifdef HAVE_MMAP
+    TGD::ArrayDescription description;
+    size_t dataOffset, fileSize;
+    if (!parse(fileName, hints, description, dataOffset, fileSize))
+        return TGD::ArrayContainer();
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(fileName, ec);
+    if (ec)
+        return TGD::ArrayContainer();
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return TGD::ArrayContainer();
+    // The data is never written, so a read-only mapping suffices; unlike a
+    // writable private mapping, it is not charged against RAM and swap, so
+    // files of any size can be mapped
+    void* base = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return TGD::ArrayContainer();
+    unsigned char* bytes = static_cast<unsigned char*>(base);
+    {
+        std::lock_guard<std::mutex> lock(mappingsMutex);
+        mappings[bytes] = { fileSize, 0, fileName, mtime };
+    }
+    std::shared_ptr<void> mapping(base, [fileSize](void* p) {
+            std::lock_guard<std::mutex> lock(mappingsMutex);
+            mappings.erase(static_cast<const unsigned char*>(p));
+            munmap(p, fileSize); });
+    //fprintf(stderr, "mapped %s\n", fileName.c_str());
+    return TGD::ArrayContainer(description, bytes + dataOffset, mapping);
+#else
+    return TGD::ArrayContainer();
+#endif
+}
+
+bool isMapped(const TGD::ArrayContainer& array)
+{
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+    return array.elementCount() > 0 && findMapping(array.data()) != mappings.end();
+}
+
+bool mappedFileChanged(const TGD::ArrayContainer& array)
+{
+    std::string fileName;
+    size_t size;
+    std::filesystem::file_time_type mtime;
+    {
+        std::lock_guard<std::mutex> lock(mappingsMutex);
+        auto it = array.elementCount() > 0 ? findMapping(array.data()) : mappings.end();
+        if (it == mappings.end())
+            return false;
+        fileName = it->second.fileName;
+        size = it->second.size;
+        mtime = it->second.mtime;
+    }
+    std::error_code ec;
+    size_t newSize = std::filesystem::file_size(fileName, ec);
+    if (ec || newSize != size)
+        return true;
+    auto newMtime = std::filesystem::last_write_time(fileName, ec);
+    return ec || newMtime != mtime;
+}
+
+SequentialScan::SequentialScan(const TGD::ArrayContainer& array) : _mapping(nullptr)
+{
+#ifdef HAVE_MMAP
+    std::lock_guard<std::mutex> lock(mappingsMutex);
+    auto it = array.elementCount() > 0 ? findMapping(array.data()) : mappings.end();
+    if (it != mappings.end()) {
+        _mapping = it->first;
+        if (it->second.sequentialScans++ == 0)
+            madvise(const_cast<unsigned char*>(it->first), it->second.size, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+SequentialScan::~SequentialScan()
+{
+#ifdef HAVE_MMAP
+    if (_mapping) {
+        std::lock_guard<std::mutex> lock(mappingsMutex);
+        auto it = mappings.find(_mapping);
+        // the other users of the mapping may read it in any order
+        if (it != mappings.end() && --it->second.sequentialScans == 0)
+            madvise(const_cast<unsigned char*>(it->first), it->second.size, MADV_NORMAL);
+    }
+#endif
+}
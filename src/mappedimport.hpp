@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_MAPPEDIMPORT_HPP
+#define QV_MAPPEDIMPORT_HPP
+
+#include <string>
+
+#include <tgd/array.hpp>
+
+/* Zero-copy import of files that contain a single array whose data is stored
+ * exactly as a TGD::ArrayContainer stores it. Such files are mapped into
+ * memory instead of being read, so that opening even huge files is
+ * instantaneous and the data is only paged in when it is used. The mapping
+ * is read-only; nothing in qv writes to the original data of a frame.
+ * Since the data is not copied, changes that other programs make to the file
+ * are visible, and accessing the data of a file that was truncated crashes.
+ * Mapped files must therefore be checked with mappedFileChanged() before
+ * their data is accessed, and read again if they changed.
+ *
+ * Currently this applies to PFM files in host byte order whose data starts
+ * at a multiple of four bytes (their rows are stored bottom-up, like TGD
+ * stores them), and to raw files whose type and geometry are given by the
+ * importer hints TYPE, DIMENSIONS and COMPONENTS. Files in other formats,
+ * and files that need other importer hints, are read by the TGD importer as
+ * usual. */
+
+// Whether mapArray() would succeed; only the header of the file is read
+bool isMappable(const std::string& fileName, const TGD::TagList& hints);
+// Map the array in the file; returns an empty array if that is not possible
+TGD::ArrayContainer mapArray(const std::string& fileName, const TGD::TagList& hints);
+// Whether the data of the array was mapped by mapArray()
+bool isMapped(const TGD::ArrayContainer& array);
+// Whether the file of a mapped array changed since it was mapped, so that the
+// array must not be accessed anymore; always false for other arrays
+bool mappedFileChanged(const TGD::ArrayContainer& array);
+
+/* Tell the system that the data of a mapped array is read front to back
+ * while this object exists, so that it reads ahead aggressively. This has no
+ * effect for arrays that are not mapped. */
+class SequentialScan {
+private:
+    const unsigned char* _mapping;
+public:
+    SequentialScan(const TGD::ArrayContainer& array);
+    ~SequentialScan();
+    SequentialScan(const SequentialScan&) = delete;
+    SequentialScan& operator=(const SequentialScan&) = delete;
+};
+
+#endif
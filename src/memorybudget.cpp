@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <vector>
+
+#include "memorybudget.hpp"
+
+static MemoryBudget* memoryBudget;
+
+MemoryAllocation::MemoryAllocation(MemoryType type, size_t size, bool evictable, const std::function<void ()>& evict) :
+    _type(type), _size(size), _evictable(evictable), _evict(evict), _evicted(false)
+{
+}
+
+MemoryAllocation::~MemoryAllocation()
+{
+    if (memoryBudget)
+        memoryBudget->remove(this);
+}
+
+void MemoryAllocation::touch()
+{
+    if (memoryBudget)
+        memoryBudget->touch(this);
+}
+
+MemoryBudget::MemoryBudget(size_t ramBudget, size_t vramBudget) :
+    _budgets { ramBudget, vramBudget }, _usages { 0, 0 }, _evictedUsages { 0, 0 }
+{
+    memoryBudget = this;
+}
+
+MemoryBudget::~MemoryBudget()
+{
+    memoryBudget = nullptr;
+}
+
+size_t MemoryBudget::usage(MemoryType type)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _usages[type];
+}
+
+bool MemoryBudget::hasRoom(MemoryType type, size_t size)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _budgets[type] == 0 || _usages[type] + size <= _budgets[type];
+}
+
+std::shared_ptr<MemoryAllocation> MemoryBudget::add(MemoryType type, size_t size, bool evictable,
+        const std::function<void ()>& evict)
+{
+    std::shared_ptr<MemoryAllocation> allocation = std::make_shared<MemoryAllocation>(type, size, evictable, evict);
+    std::lock_guard<std::mutex> lock(_mutex);
+    allocation->_lruIterator = _lru.insert(_lru.end(), allocation.get());
+    _usages[type] += size;
+    return allocation;
+}
+
+void MemoryBudget::remove(MemoryAllocation* allocation)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (allocation->_evicted)
+        _evictedUsages[allocation->_type] -= allocation->_size;
+    else
+        _lru.erase(allocation->_lruIterator);
+    _usages[allocation->_type] -= allocation->_size;
+}
+
+void MemoryBudget::touch(MemoryAllocation* allocation)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!allocation->_evicted)
+        _lru.splice(_lru.end(), _lru, allocation->_lruIterator);
+}
+
+void MemoryBudget::enforce()
+{
+    std::vector<std::function<void ()>> evictFunctions;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _lru.begin(); it != _lru.end(); ) {
+            MemoryAllocation* allocation = *it;
+            MemoryType type = allocation->_type;
+            // data that is already evicted will be dropped soon
+            if (_budgets[type] == 0 || _usages[type] - _evictedUsages[type] <= _budgets[type]
+                    || !allocation->_evictable) {
+                ++it;
+                continue;
+            }
+            //fprintf(stderr, "evicting %zu bytes\n", allocation->_size);
+            allocation->_evicted = true;
+            _evictedUsages[type] += allocation->_size;
+            if (allocation->_evict)
+                evictFunctions.push_back(allocation->_evict);
+            it = _lru.erase(it);
+        }
+    }
+    // The owners may be busy with the data, so call them without holding our lock
+    for (size_t i = 0; i < evictFunctions.size(); i++)
+        evictFunctions[i]();
+}
+
+MemoryBudget& defaultMemoryBudget()
+{
+    return *memoryBudget;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_MEMORYBUDGET_HPP
+#define QV_MEMORYBUDGET_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+
+enum MemoryType {
+    MemoryRAM = 0,
+    MemoryVRAM = 1
+};
+
+class MemoryBudget;
+
+/* An allocation that counts against the memory budget. It is removed from
+ * the budget when this object is destroyed, so the owner must destroy it
+ * together with the data. */
+class MemoryAllocation {
+private:
+    friend class MemoryBudget;
+    MemoryType _type;
+    size_t _size;
+    bool _evictable;
+    std::function<void ()> _evict;
+    std::atomic<bool> _evicted;
+    std::list<MemoryAllocation*>::iterator _lruIterator;
+
+public:
+    MemoryAllocation(MemoryType type, size_t size, bool evictable, const std::function<void ()>& evict);
+    ~MemoryAllocation();
+    MemoryAllocation(const MemoryAllocation&) = delete;
+    MemoryAllocation& operator=(const MemoryAllocation&) = delete;
+
+    size_t size() const { return _size; }
+    // Mark this allocation as recently used
+    void touch();
+    // Whether the budget asked the owner to drop the data
+    bool evicted() const { return _evicted; }
+};
+
+/* Keeps track of the memory used for frame data, such as the original arrays
+ * and quads in RAM and textures in VRAM. When a budget is exceeded, the least
+ * recently used evictable allocations are evicted: they are marked as evicted
+ * and their evict function, if any, is called (from an arbitrary thread,
+ * without any lock held). The owner is expected to drop the data, either in
+ * the evict function or when it next checks MemoryAllocation::evicted(), and
+ * to recompute it on demand. Evicted data counts as used until the owner
+ * drops it, but it is not evicted again. A budget of 0 means no limit. All
+ * functions are thread-safe. */
+class MemoryBudget {
+private:
+    friend class MemoryAllocation;
+    std::mutex _mutex;
+    size_t _budgets[2];
+    size_t _usages[2];
+    size_t _evictedUsages[2]; // the part of _usages that is evicted but not dropped yet
+    std::list<MemoryAllocation*> _lru; // least recently used first
+
+    void remove(MemoryAllocation* allocation);
+    void touch(MemoryAllocation* allocation);
+
+public:
+    MemoryBudget(size_t ramBudget = 0, size_t vramBudget = 0);
+    ~MemoryBudget();
+
+    size_t budget(MemoryType type) const { return _budgets[type]; }
+    size_t usage(MemoryType type);
+    // Whether an allocation of the given size fits without evicting anything
+    bool hasRoom(MemoryType type, size_t size);
+
+    // Track a new allocation. The evict function is optional.
+    std::shared_ptr<MemoryAllocation> add(MemoryType type, size_t size, bool evictable,
+            const std::function<void ()>& evict = std::function<void ()>());
+    // Evict least recently used allocations until the budgets are met
+    void enforce();
+};
+
+MemoryBudget& defaultMemoryBudget();
+
+#endif
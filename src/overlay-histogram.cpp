@@ -26,6 +26,8 @@
 
 #include <cmath>
 #include <limits>
+#include <vector>
+#include <algorithm>
 
 #include <QImage>
 #include <QPainter>
@@ -48,12 +50,19 @@ static float logtransf(float x)
     return clamp(std::log(1.0f + x * (base - 1.0f)) / std::log(base), 0.0f, 1.0f);
 }
 
-void OverlayHistogram::update(unsigned int tex, int widthInPixels, const QPoint& arrayCoordinates, Set& set)
+void OverlayHistogram::update(unsigned int tex, int widthInPixels, const QPoint& arrayCoordinates, Set& set,
+        const QRect& region)
 {
     prepare(widthInPixels, 64 * _scaleFactor);
 
     Frame* frame = set.currentFile()->currentFrame();
-    const Histogram& H = frame->currentHistogram();
+    Statistic regionStatistic;
+    Histogram regionHistogram;
+    if (!region.isNull()) {
+        frame->regionStatistic(frame->channelIndex(), region.x(), region.y(), region.width(), region.height(),
+                regionStatistic, regionHistogram);
+    }
+    const Histogram& H = (region.isNull() ? frame->currentHistogramOrEstimate() : regionHistogram);
 
     // Border
     const int borderSize = 5;
@@ -72,6 +81,11 @@ void OverlayHistogram::update(unsigned int tex, int widthInPixels, const QPoint&
     // Vis Interval
     float visMin = set.currentParameters()->visMinVal(frame->channelIndex());
     float visMax = set.currentParameters()->visMaxVal(frame->channelIndex());
+    if (!std::isfinite(visMin) || !std::isfinite(visMax)) {
+        // the visible range is based on an estimate until the exact quantiles are known
+        visMin = frame->currentVisMinVal();
+        visMax = frame->currentVisMaxVal();
+    }
     float normalizedVisMin = (visMin - H.minVal()) / (H.maxVal() - H.minVal());
     float normalizedVisMax = (visMax - H.minVal()) / (H.maxVal() - H.minVal());
     int visX0 = borderSize + normalizedVisMin * (widthInPixels - 2 * borderSize);
@@ -86,27 +100,32 @@ void OverlayHistogram::update(unsigned int tex, int widthInPixels, const QPoint&
             || arrayCoordinates.x() >= frame->width() || arrayCoordinates.y() >= frame->height());
     float value = (outside ? 0.0f : frame->value(arrayCoordinates.x(), arrayCoordinates.y(), frame->channelIndex()));
     int availableWidth = widthInPixels - 2 * borderSize;
-    float binWidth = float(availableWidth) / H.binCount();
     int availableHeight = heightInPixels() - 2 * borderSize;
     int binY = heightInPixels() - borderSize;
-    for (int bin = 0; bin < H.binCount(); bin++) {
-        int binX = borderSize + std::round(bin * binWidth);
-        if (binX >= borderX1)
-            binX = borderX1 - 1;
-        int nextBinX = borderSize + std::round((bin + 1) * binWidth);
-        int thisBinWidth = nextBinX - binX;
-        if (thisBinWidth < 1 || binX == borderX1 - 1)
-            thisBinWidth = 1;
-        float normalizedBinHeight = float(H.binVal(bin)) / H.maxBinVal();
+    // one bin per pixel column, reduced from the (possibly much finer) histogram bins
+    std::vector<float> bins = H.reduce(availableWidth, H.minVal(), H.maxVal());
+    float maxBinVal = *std::max_element(bins.begin(), bins.end());
+    // the columns covered by the histogram bin of the current value
+    int valueX0 = -1, valueX1 = -1;
+    if (!outside && H.maxVal() > H.minVal()) {
+        int valueBin = H.binIndex(value);
+        float columnWidth = (H.maxVal() - H.minVal()) / availableWidth;
+        valueX0 = std::floor((H.binLowerBound(valueBin) - H.minVal()) / columnWidth);
+        valueX1 = std::max(valueX0 + 1, int(std::ceil((H.binLowerBound(valueBin + 1) - H.minVal()) / columnWidth)));
+    }
+    // estimated histograms are drawn in gray until the exact one is available
+    QColor binColor = QColor(H.approximate() ? Qt::lightGray : Qt::white);
+    for (int x = 0; x < availableWidth; x++) {
+        float normalizedBinHeight = (maxBinVal > 0.0f ? bins[x] / maxBinVal : 0.0f);
         if (frame->type() != TGD::int8 && frame->type() != TGD::uint8) {
             normalizedBinHeight = logtransf(normalizedBinHeight);
         }
         int binHeight = std::round(normalizedBinHeight * availableHeight);
-        if (!outside && H.binIndex(value) == bin) {
-            _painter->fillRect(binX, borderSize, thisBinWidth, availableHeight, QColor(Qt::green));
-            _painter->fillRect(binX, binY, thisBinWidth, -binHeight, QColor(Qt::green));
+        if (x >= valueX0 && x < valueX1) {
+            _painter->fillRect(borderSize + x, borderSize, 1, availableHeight, QColor(Qt::green));
+            _painter->fillRect(borderSize + x, binY, 1, -binHeight, QColor(Qt::green));
         } else {
-            _painter->fillRect(binX, binY, thisBinWidth, -binHeight, QColor(Qt::white));
+            _painter->fillRect(borderSize + x, binY, 1, -binHeight, binColor);
         }
     }
 
@@ -27,13 +27,17 @@
 #ifndef QV_OVERLAY_HISTOGRAM_HPP
 #define QV_OVERLAY_HISTOGRAM_HPP
 
+#include <QRect>
+
 #include "set.hpp"
 #include "overlay.hpp"
 
 class OverlayHistogram: public Overlay
 {
 public:
-    void update(unsigned int tex, int widthInPixels, const QPoint& arrayCoordinates, Set& set);
+    // If the region is not null, the histogram of that region of the frame is shown
+    void update(unsigned int tex, int widthInPixels, const QPoint& arrayCoordinates, Set& set,
+            const QRect& region = QRect());
 };
 
 #endif
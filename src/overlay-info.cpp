@@ -67,7 +67,7 @@ static QStringList createList(const TGD::TagList& tl, QString& interpretation)
     return list;
 }
 
-void OverlayInfo::update(unsigned int tex, int widthInPixels, Set& set)
+void OverlayInfo::update(unsigned int tex, int widthInPixels, Set& set, const std::string& status)
 {
     File* file = set.currentFile();
     Frame* frame = file->currentFrame();
@@ -98,6 +98,8 @@ void OverlayInfo::update(unsigned int tex, int widthInPixels, Set& set)
     }
     sl << line;
     sl << QString(" current channel: %1").arg(frame->currentChannelName().c_str());
+    if (status.size() > 0)
+        sl << QString(" ") + status.c_str();
     if (array.globalTagList().size() > 0) {
         QString line = " global: ";
         QString interpretation;
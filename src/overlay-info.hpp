@@ -33,7 +33,8 @@
 class OverlayInfo : public Overlay
 {
 public:
-    void update(unsigned int tex, int widthInPixels, Set& set);
+    // The status line, if any, is shown in addition to the frame information
+    void update(unsigned int tex, int widthInPixels, Set& set, const std::string& status = std::string());
 };
 
 #endif
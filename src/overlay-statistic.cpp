@@ -30,7 +30,7 @@
 #include "overlay-statistic.hpp"
 
 
-void OverlayStatistic::update(unsigned int tex, int widthInPixels, Set& set)
+void OverlayStatistic::update(unsigned int tex, int widthInPixels, Set& set, const QRect& region)
 {
     prepare(widthInPixels, _painter->fontInfo().pixelSize() * 1.5f);
 
@@ -40,14 +40,25 @@ void OverlayStatistic::update(unsigned int tex, int widthInPixels, Set& set)
         s += "lightness";
     else
         s += frame->currentChannelName().c_str();
-    const Statistic& S = frame->currentStatistic();
+    Statistic regionStatistic;
+    Histogram regionHistogram;
+    long long values = (long long)frame->width() * frame->height();
+    if (!region.isNull()) {
+        frame->regionStatistic(frame->channelIndex(), region.x(), region.y(), region.width(), region.height(),
+                regionStatistic, regionHistogram);
+        values = (long long)region.width() * region.height();
+        s += QString(" region=%1,%2+%3x%4").arg(region.x()).arg(region.y()).arg(region.width()).arg(region.height());
+    }
+    const Statistic& S = (region.isNull() ? frame->currentStatisticOrEstimate() : regionStatistic);
     s += QString(" min=%1 max=%2 mean=%3 var=%4 dev=%5 invalid=%6")
         .arg(S.minVal())
         .arg(S.maxVal())
         .arg(S.sampleMean())
         .arg(S.sampleVariance())
         .arg(S.sampleDeviation())
-        .arg(frame->width() * frame->height() - S.finiteValues());
+        .arg(values - (long long)S.finiteValues());
+    if (S.approximate())
+        s += " (estimated, computing...)";
     float xOffset = 0.0f;
     float yOffset = 1.25f * _painter->fontInfo().pixelSize();
     _painter->drawText(xOffset, yOffset, s);
@@ -27,13 +27,16 @@
 #ifndef QV_OVERLAY_STATISTIC_HPP
 #define QV_OVERLAY_STATISTIC_HPP
 
+#include <QRect>
+
 #include "set.hpp"
 #include "overlay.hpp"
 
 class OverlayStatistic : public Overlay
 {
 public:
-    void update(unsigned int tex, int widthInPixels, Set& set);
+    // If the region is not null, the statistic of that region of the frame is shown
+    void update(unsigned int tex, int widthInPixels, Set& set, const QRect& region = QRect());
 };
 
 #endif
@@ -82,3 +82,11 @@ void Parameters::setVisMaxVal(int channelIndex, float v)
         _visMaxVals[channelIndex] = v;
     }
 }
+
+void Parameters::resetVisIntervals()
+{
+    _visMinVals.clear();
+    _visMaxVals.clear();
+    _colorVisMinVal = std::numeric_limits<float>::quiet_NaN();
+    _colorVisMaxVal = std::numeric_limits<float>::quiet_NaN();
+}
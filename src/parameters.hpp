@@ -58,6 +58,7 @@ public:
     void setVisMinVal(int channelIndex, float v);
     float visMaxVal(int channelIndex);
     void setVisMaxVal(int channelIndex, float v);
+    void resetVisIntervals(); // for all channels
     ColorMap& colorMap() { return _colorMap; }
 };
 
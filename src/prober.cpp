@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "prober.hpp"
+
+
+Prober::Prober(const std::vector<std::string>& fileNames, const TGD::TagList& importerHints,
+        const std::vector<std::shared_ptr<FileProbe>>& probes) :
+    _stopping(false), _finished(false)
+{
+    _thread = std::thread([this, fileNames, importerHints, probes]() {
+            work(fileNames, importerHints, probes); });
+}
+
+Prober::~Prober()
+{
+    _stopping = true;
+    _thread.join();
+}
+
+void Prober::work(const std::vector<std::string>& fileNames, const TGD::TagList& importerHints,
+        const std::vector<std::shared_ptr<FileProbe>>& probes)
+{
+    // Opening a file is mostly waiting for I/O, so many files are opened
+    // in parallel; the files are probed roughly in order, so that the
+    // first files in a set are known first
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < fileNames.size(); i++) {
+        if (_stopping)
+            continue;
+        FileProbe& probe = *(probes[i]);
+        TGD::Importer importer(fileNames[i], importerHints);
+        TGD::Error tgdError = importer.checkAccess();
+        if (tgdError != TGD::ErrorNone) {
+            probe.errorMessage = fileNames[i] + ": " + TGD::strerror(tgdError);
+            probe.state = FileProbe::Failed;
+        } else {
+            probe.arrayCount = importer.arrayCount();
+            probe.state = FileProbe::Accessible;
+        }
+    }
+    //fprintf(stderr, "prober: probed %zu files\n", fileNames.size());
+    _finished = true;
+}
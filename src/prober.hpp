@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_PROBER_HPP
+#define QV_PROBER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include <tgd/io.hpp>
+
+/* What is known about a file that was added to a set without checking it
+ * (see Set::addFilesUnchecked()). The state is set last, so the other
+ * members are valid once it is not Unknown anymore. */
+struct FileProbe {
+    enum State { Unknown, Accessible, Failed };
+    std::atomic<int> state;
+    int arrayCount;           // if Accessible: see TGD::Importer::arrayCount()
+    std::string errorMessage; // if Failed
+
+    FileProbe() : state(Unknown), arrayCount(-1) {}
+};
+
+/* Checks access to files and determines their number of arrays in a
+ * background thread, with one importer per file, for many files in
+ * parallel. */
+class Prober {
+private:
+    std::thread _thread;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _finished;
+
+    void work(const std::vector<std::string>& fileNames, const TGD::TagList& importerHints,
+            const std::vector<std::shared_ptr<FileProbe>>& probes);
+
+public:
+    Prober(const std::vector<std::string>& fileNames, const TGD::TagList& importerHints,
+            const std::vector<std::shared_ptr<FileProbe>>& probes);
+    ~Prober();
+    Prober(const Prober&) = delete;
+    Prober& operator=(const Prober&) = delete;
+
+    bool finished() const { return _finished; }
+};
+
+#endif
@@ -0,0 +1,1122 @@
+/*
+ * Copyright (C) 2019, 2020, 2021, 2022
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ * Copyright (C) 2023, 2024, 2025
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+#include "quadtree.hpp"
+#include "color.hpp"
+#include "alloc.hpp"
+#include "threadpool.hpp"
+#include "memorybudget.hpp"
+
+
+QuadTree::QuadTree(const TGD::ArrayContainer& originalArray, const std::vector<int>& channels,
+        const TGD::ArrayDescription& level0Description, int level0BorderSize,
+        const bool isS[4], bool halfFloat, const FrameCache& cache, const std::string& cacheName) :
+    _originalArray(originalArray),
+    _width(originalArray.dimension(0)),
+    _height(originalArray.dimension(1)),
+    _channels(channels),
+    _channelsAreIdentity(channels.size() == originalArray.componentCount()),
+    _cache(cache),
+    _cacheName(cacheName),
+    _halfFloat(halfFloat),
+    _level0BorderSize(level0BorderSize),
+    _level0Description(level0Description),
+    _singleQuadIsOriginal(false),
+    _level0CanBeDirect(false),
+    _backgroundQueueIndex(-1),
+    _workers(0)
+{
+    assert(channels.size() == level0Description.componentCount());
+    for (size_t i = 0; i < channels.size(); i++)
+        if (channels[i] != int(i))
+            _channelsAreIdentity = false;
+    for (int i = 0; i < 4; i++)
+        _isS[i] = isS[i];
+    int quadsX = std::max(width() / quadWidth() + (width() % quadWidth() ? 1 : 0), 1);
+    int quadsY = std::max(height() / quadHeight() + (height() % quadHeight() ? 1 : 0), 1);
+    int totalQuads = 0;
+    _levelWidths.push_back(quadsX);
+    _levelHeights.push_back(quadsY);
+    _levelBaseIndices.push_back(totalQuads);
+    totalQuads += quadsX * quadsY;
+    while (quadsX > 1 || quadsY > 1) {
+        quadsX = quadsX / 2 + quadsX % 2;
+        quadsY = quadsY / 2 + quadsY % 2;
+        _levelWidths.push_back(quadsX);
+        _levelHeights.push_back(quadsY);
+        _levelBaseIndices.push_back(totalQuads);
+        totalQuads += quadsX * quadsY;
+    }
+    _quads.resize(totalQuads);
+    _quadStates.resize(totalQuads, QuadMissing);
+    _quadQueued.resize(totalQuads, false);
+    _quadMemory.resize(totalQuads);
+    _quadVersions.resize(totalQuads, 0);
+    _quadAllocations.resize(totalQuads);
+
+    /* Optimization for the case of only a single quad */
+    if (_level0BorderSize == 0 && _channelsAreIdentity
+            && _level0Description.dimension(0) == _originalArray.dimension(0)
+            && _level0Description.dimension(1) == _originalArray.dimension(1)
+            && _level0Description.componentCount() == _originalArray.componentCount()
+            && _level0Description.componentType() == _originalArray.componentType()) {
+        //fprintf(stderr, "single quad optimization\n");
+        _quads[0] = _originalArray;
+        _quadStates[0] = QuadReady;
+        _singleQuadIsOriginal = true;
+    }
+    /* Level 0 quads that would be verbatim copies of a part of the original data
+     * are never stored; they are always ready */
+    if (!_singleQuadIsOriginal && _channelsAreIdentity
+            && _level0Description.componentType() == _originalArray.componentType()) {
+        _level0CanBeDirect = true;
+        for (int qy = 0; qy < levelHeight(0); qy++)
+            for (int qx = 0; qx < levelWidth(0); qx++)
+                if (level0QuadIsDirect(qx, qy))
+                    _quadStates[quadIndex(0, qx, qy)] = QuadReady;
+    }
+}
+
+bool QuadTree::level0QuadIsDirect(int qx, int qy) const
+{
+    // Only quads whose border does not need to be clamped qualify
+    int x = qx * quadWidth() - borderSize(0);
+    int y = qy * quadHeight() - borderSize(0);
+    return _level0CanBeDirect && x >= 0 && y >= 0
+        && x + int(_level0Description.dimension(0)) <= width()
+        && y + int(_level0Description.dimension(1)) <= height();
+}
+
+int QuadTree::quadIndex(int level, int qx, int qy) const // returns -1 if nonexistent
+{
+    int i = -1;
+    if (qx >= 0 && qx < levelWidth(level)
+            && qy >= 0 && qy < levelHeight(level)) {
+        i = _levelBaseIndices[level] + qy * levelWidth(level) + qx;
+    }
+    return i;
+}
+
+void QuadTree::quadCoordinates(int qi, int& level, int& qx, int& qy) const
+{
+    level = 0;
+    while (level < levels() - 1 && qi >= _levelBaseIndices[level + 1])
+        level++;
+    int q = qi - _levelBaseIndices[level];
+    qy = q / levelWidth(level);
+    qx = q % levelWidth(level);
+}
+
+void QuadTree::collectMissingQuads(int level, int qx, int qy, std::vector<std::vector<int>>& quadsPerLevel) const
+{
+    // A quad that is not missing does not have missing quads in its subtree:
+    // either it is ready, or some thread is computing it including its subtree.
+    int qi = quadIndex(level, qx, qy);
+    if (qi < 0 || _quadStates[qi] != QuadMissing)
+        return;
+    if (!_quadQueued[qi])
+        quadsPerLevel[level].push_back(qi);
+    if (level > 0) {
+        collectMissingQuads(level - 1, 2 * qx + 0, 2 * qy + 0, quadsPerLevel);
+        collectMissingQuads(level - 1, 2 * qx + 1, 2 * qy + 0, quadsPerLevel);
+        collectMissingQuads(level - 1, 2 * qx + 0, 2 * qy + 1, quadsPerLevel);
+        collectMissingQuads(level - 1, 2 * qx + 1, 2 * qy + 1, quadsPerLevel);
+    }
+}
+
+void QuadTree::request(const std::vector<std::tuple<int, int, int>>& quads)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Queue the missing quads that the requested quads depend on, bottom up,
+    // so that the workers can compute them in parallel
+    std::vector<std::vector<int>> quadsPerLevel(levels());
+    for (size_t i = 0; i < quads.size(); i++) {
+        collectMissingQuads(std::get<0>(quads[i]), std::get<1>(quads[i]), std::get<2>(quads[i]),
+                quadsPerLevel);
+    }
+    for (int l = 0; l < levels(); l++) {
+        for (size_t i = 0; i < quadsPerLevel[l].size(); i++) {
+            _requestQueue.push_back(quadsPerLevel[l][i]);
+            _quadQueued[quadsPerLevel[l][i]] = true;
+        }
+    }
+    startWorkers();
+}
+
+void QuadTree::startBackgroundBuild()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    // quad indices are sorted by level, so this builds bottom up
+    if (_backgroundQueueIndex < 0)
+        _backgroundQueueIndex = 0;
+    // The workers stop when the memory budget is exhausted; since this is
+    // called for every rendered frame, they continue once there is room again
+    startWorkers();
+}
+
+void QuadTree::invalidateSubtree(int level, int qx, int qy)
+{
+    int qi = quadIndex(level, qx, qy);
+    if (qi < 0)
+        return;
+    //fprintf(stderr, "quad %d,%d,%d needs recomputing\n", level, qx, qy);
+    _quadVersions[qi]++;
+    if (_quadStates[qi] == QuadReady)
+        _quadStates[qi] = QuadMissing;
+    else if (_quadStates[qi] == QuadComputing)
+        _quadStates[qi] = QuadComputingStale;
+    if (level > 0) {
+        invalidateSubtree(level - 1, 2 * qx + 0, 2 * qy + 0);
+        invalidateSubtree(level - 1, 2 * qx + 1, 2 * qy + 0);
+        invalidateSubtree(level - 1, 2 * qx + 0, 2 * qy + 1);
+        invalidateSubtree(level - 1, 2 * qx + 1, 2 * qy + 1);
+    }
+}
+
+void QuadTree::invalidateAncestors(int level, int qx, int qy)
+{
+    // A quad that needs recomputing invalidates all quads that were derived from it.
+    for (int l = level + 1; l < levels(); l++) {
+        qx /= 2;
+        qy /= 2;
+        int qi = quadIndex(l, qx, qy);
+        _quadVersions[qi]++;
+        if (_quadStates[qi] == QuadReady)
+            _quadStates[qi] = QuadMissing;
+        else if (_quadStates[qi] == QuadComputing)
+            _quadStates[qi] = QuadComputingStale;
+    }
+}
+
+static inline uint64_t rotateLeft(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t hashBytes(uint64_t h, const unsigned char* data, size_t n)
+{
+    // The 64 bit round function of xxHash
+    const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+    const uint64_t prime4 = 0x85ebca77c2b2ae63ULL;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, data + i, sizeof(v));
+        h ^= rotateLeft(v * prime2, 31) * prime1;
+        h = rotateLeft(h, 27) * prime1 + prime4;
+    }
+    for (; i < n; i++) {
+        h ^= data[i] * prime1;
+        h = rotateLeft(h, 11) * prime2;
+    }
+    return h;
+}
+
+uint64_t QuadTree::hashLevel0Source(const TGD::ArrayContainer& array, int qx, int qy) const
+{
+    // Hash the data that the level 0 quad is computed from, including its border
+    int minX = std::max(qx * quadWidth() - borderSize(0), 0);
+    int minY = std::max(qy * quadHeight() - borderSize(0), 0);
+    int maxX = std::min((qx + 1) * quadWidth() + borderSize(0), width()) - 1;
+    int maxY = std::min((qy + 1) * quadHeight() + borderSize(0), height()) - 1;
+    uint64_t h = 0x27d4eb2f165667c5ULL;
+    for (int y = minY; y <= maxY; y++) {
+        h = hashBytes(h, static_cast<const unsigned char*>(array.get({ size_t(minX), size_t(y) })),
+                (maxX - minX + 1) * array.elementSize());
+    }
+    return h;
+}
+
+std::vector<uint64_t> QuadTree::level0Hashes(const TGD::ArrayContainer& array) const
+{
+    std::vector<uint64_t> hashes(levelWidth(0) * levelHeight(0));
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t qi = 0; qi < hashes.size(); qi++) {
+        hashes[qi] = hashLevel0Source(array, qi % levelWidth(0), qi / levelWidth(0));
+    }
+    return hashes;
+}
+
+void QuadTree::adopt(QuadTree& other, const std::vector<uint64_t>& hashes)
+{
+    if (&other == this)
+        return;
+    {
+        std::scoped_lock lock(_mutex, other._mutex);
+        _level0Hashes = hashes;
+        if (other._level0Hashes.size() != hashes.size() || other._quads.size() != _quads.size())
+            return;
+        // A quad is unchanged if its level 0 descendants are
+        std::vector<bool> unchanged(_quads.size());
+        for (size_t qi = 0; qi < hashes.size(); qi++)
+            unchanged[qi] = (other._level0Hashes[qi] == hashes[qi]);
+        for (int l = 1; l < levels(); l++) {
+            for (int qy = 0; qy < levelHeight(l); qy++) {
+                for (int qx = 0; qx < levelWidth(l); qx++) {
+                    bool u = true;
+                    for (int i = 0; i < 4; i++) {
+                        int ci = quadIndex(l - 1, 2 * qx + i % 2, 2 * qy + i / 2);
+                        if (ci >= 0 && !unchanged[ci])
+                            u = false;
+                    }
+                    unchanged[quadIndex(l, qx, qy)] = u;
+                }
+            }
+        }
+        for (size_t qi = 0; qi < _quads.size(); qi++) {
+            if (unchanged[qi] && _quadStates[qi] == QuadMissing
+                    && other._quadStates[qi] == QuadReady && other._quads[qi].elementCount() > 0) {
+                //fprintf(stderr, "adopting quad %zu\n", qi);
+                _quads[qi] = other._quads[qi];
+                _quadMemory[qi] = other._quadMemory[qi];
+                _quadStates[qi] = QuadReady;
+                // counted for both trees, since either may drop it first
+                trackQuad(qi);
+            }
+        }
+    }
+    defaultMemoryBudget().enforce();
+}
+
+bool QuadTree::update(const TGD::ArrayContainer& array, const FrameCache& cache)
+{
+    return update(array, cache, level0Hashes(array));
+}
+
+bool QuadTree::update(const TGD::ArrayContainer& array, const FrameCache& cache,
+        const std::vector<uint64_t>& hashes)
+{
+    assert(array.dimension(0) == size_t(width()) && array.dimension(1) == size_t(height()));
+    assert(array.componentCount() == _originalArray.componentCount());
+    assert(array.componentType() == _originalArray.componentType());
+    assert(hashes.size() == size_t(levelWidth(0) * levelHeight(0)));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _originalArray = array;
+    _cache = cache;
+    bool changed = false;
+    for (size_t qi = 0; qi < hashes.size(); qi++) {
+        // Without previous hashes, all quads must be assumed to have changed
+        if (_level0Hashes.size() == 0 || _level0Hashes[qi] != hashes[qi]) {
+            //fprintf(stderr, "level 0 quad %zu changed\n", qi);
+            invalidateSubtree(0, qi % levelWidth(0), qi / levelWidth(0));
+            invalidateAncestors(0, qi % levelWidth(0), qi / levelWidth(0));
+            if (level0QuadIsDirect(qi % levelWidth(0), qi / levelWidth(0)))
+                _quadStates[qi] = QuadReady; // always up to date, but the version changed
+            changed = true;
+        }
+    }
+    _level0Hashes = hashes;
+    if (_singleQuadIsOriginal) {
+        _quads[0] = _originalArray;
+        _quadStates[0] = QuadReady; // always up to date
+    }
+    if (changed) {
+        if (_backgroundQueueIndex > 0) {
+            _backgroundQueueIndex = 0;
+            startWorkers();
+        }
+        _preview = TGD::ArrayContainer();
+    }
+    return changed;
+}
+
+unsigned long long QuadTree::version(int level, int qx, int qy)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _quadVersions[quadIndex(level, qx, qy)];
+}
+
+void QuadTree::waitFor(const std::vector<std::tuple<int, int, int>>& quads)
+{
+    // Let the workers start on the subtrees, and help them
+    request(quads);
+    for (size_t i = 0; i < quads.size(); i++) {
+        int qi = quadIndex(std::get<0>(quads[i]), std::get<1>(quads[i]), std::get<2>(quads[i]));
+        buildQuad(qi);
+    }
+}
+
+bool QuadTree::isReady(int level, int qx, int qy)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _quadStates[quadIndex(level, qx, qy)] == QuadReady;
+}
+
+TGD::ArrayContainer QuadTree::quad(int level, int qx, int qy)
+{
+    int qi = quadIndex(level, qx, qy);
+    TGD::ArrayContainer originalArray;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_quadStates[qi] == QuadReady) {
+                if (_quadAllocations[qi])
+                    _quadAllocations[qi]->touch();
+                if (level != 0 || !level0QuadIsDirect(qx, qy))
+                    return _quads[qi];
+                originalArray = _originalArray;
+            }
+        }
+        if (originalArray.elementCount() > 0) {
+            // the quad is not stored, so the caller gets a copy
+            TGD::ArrayContainer q(_level0Description, defaultAllocator());
+            computeQuadOnLevel0(q, originalArray, qx, qy);
+            return q;
+        }
+        // the quad was not computed yet or was evicted meanwhile
+        buildQuad(qi);
+    }
+}
+
+bool QuadTree::directQuad(int level, int qx, int qy, TGD::ArrayContainer& array, int& x, int& y)
+{
+    if (level != 0 || !level0QuadIsDirect(qx, qy))
+        return false;
+    std::lock_guard<std::mutex> lock(_mutex);
+    array = _originalArray;
+    x = qx * quadWidth() - borderSize(0);
+    y = qy * quadHeight() - borderSize(0);
+    return true;
+}
+
+void QuadTree::startWorkers()
+{
+    // _mutex must be locked
+    int pendingQuads = _requestQueue.size();
+    if (_backgroundQueueIndex >= 0
+            && defaultMemoryBudget().hasRoom(MemoryRAM, _level0Description.dataSize()))
+        pendingQuads += _quadStates.size() - _backgroundQueueIndex;
+    while (_workers < defaultThreadPool().size() && _workers < pendingQuads) {
+        _workers++;
+        std::weak_ptr<QuadTree> weakTree = weak_from_this();
+        defaultThreadPool().enqueue([weakTree]() { work(weakTree); });
+    }
+}
+
+bool QuadTree::nextQueuedQuad(int& qi)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (!_requestQueue.empty()) {
+        int q = _requestQueue.front();
+        _requestQueue.pop_front();
+        _quadQueued[q] = false;
+        if (_quadStates[q] == QuadMissing) {
+            qi = q;
+            return true;
+        }
+    }
+    if (_backgroundQueueIndex >= 0) {
+        // Do not compute quads in advance if they would only push other
+        // data out of the memory budget
+        while (_backgroundQueueIndex < int(_quadStates.size())
+                && defaultMemoryBudget().hasRoom(MemoryRAM, _level0Description.dataSize())) {
+            int q = _backgroundQueueIndex++;
+            if (_quadStates[q] == QuadMissing) {
+                qi = q;
+                return true;
+            }
+        }
+    }
+    _workers--;
+    return false;
+}
+
+void QuadTree::work(std::weak_ptr<QuadTree> weakTree)
+{
+    // Only keep the tree alive while computing a quad, so that
+    // dropping a frame also stops the work on its quads.
+    for (;;) {
+        std::shared_ptr<QuadTree> tree = weakTree.lock();
+        if (!tree || defaultThreadPool().stopping())
+            break;
+        int qi;
+        if (!tree->nextQueuedQuad(qi))
+            break;
+        tree->buildQuad(qi);
+    }
+}
+
+void QuadTree::buildQuad(int qi)
+{
+    int level, qx, qy;
+    quadCoordinates(qi, level, qx, qy);
+    FrameCache cache;
+    TGD::ArrayContainer originalArray;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_quadStates[qi] == QuadComputing || _quadStates[qi] == QuadComputingStale)
+            _quadFinished.wait(lock);
+        if (_quadStates[qi] == QuadReady)
+            return;
+        _quadStates[qi] = QuadComputing;
+        cache = _cache;
+        originalArray = _originalArray;
+    }
+    // Reuse the memory of outdated data, but only if nobody else reads it
+    // anymore: the rendering thread, workers on the level above, or another
+    // tree (see adopt()) may still hold copies of the quad. Each copy holds a
+    // reference to the memory, in addition to _quads and _quadMemory.
+    TGD::ArrayContainer q;
+    std::shared_ptr<void> memory;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_quadMemory[qi] && _quadMemory[qi].use_count() == 2) {
+            q = _quads[qi];
+            memory = _quadMemory[qi];
+        }
+    }
+    if (q.elementCount() == 0)
+        q = newQuad(level, memory);
+    std::string cacheName = (levelIsHalfFloat(level) ? "half" : "") + _cacheName + '-'
+        + std::to_string(level) + '-' + std::to_string(qx) + '-' + std::to_string(qy);
+    if (level > 0 && cache.load(cacheName, q)) {
+        // no need to compute the subtree
+        finishQuad(qi, q, memory);
+        return;
+    }
+    if (level == 0) {
+        computeQuadOnLevel0(q, originalArray, qx, qy);
+    } else {
+        // Make sure the quads this one depends on are ready. Some of
+        // them might be computed by other threads at the same time, and
+        // some might get evicted again before we get hold of them.
+        // Children that are taken directly from the original array are
+        // read from there, at their position.
+        TGD::ArrayContainer children[4];
+        size_t childXOffsets[4], childYOffsets[4];
+        for (int i = 0; i < 4; i++) {
+            int cx = 2 * qx + i % 2;
+            int cy = 2 * qy + i / 2;
+            if (level == 1 && quadIndex(0, cx, cy) >= 0 && level0QuadIsDirect(cx, cy)) {
+                children[i] = originalArray;
+                childXOffsets[i] = cx * quadWidth();
+                childYOffsets[i] = cy * quadHeight();
+            } else {
+                childXOffsets[i] = borderSize(level - 1);
+                childYOffsets[i] = borderSize(level - 1);
+            }
+        }
+        for (;;) {
+            for (int i = 0; i < 4; i++) {
+                int ci = quadIndex(level - 1, 2 * qx + i % 2, 2 * qy + i / 2);
+                if (ci >= 0 && children[i].elementCount() == 0)
+                    buildQuad(ci);
+            }
+            bool haveAllChildren = true;
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (int i = 0; i < 4; i++) {
+                int ci = quadIndex(level - 1, 2 * qx + i % 2, 2 * qy + i / 2);
+                // outdated children may be overwritten while we read them
+                if (ci >= 0 && children[i].elementCount() == 0 && _quadStates[ci] == QuadReady) {
+                    children[i] = _quads[ci];
+                    if (children[i].elementCount() == 0)
+                        haveAllChildren = false;
+                }
+            }
+            if (haveAllChildren)
+                break;
+        }
+        computeQuadOnLevel(q, level, qx, qy, children, childXOffsets, childYOffsets);
+        bool isStale;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            isStale = (_quadStates[qi] == QuadComputingStale);
+        }
+        if (!isStale)
+            cache.store(cacheName, q);
+    }
+    finishQuad(qi, q, memory);
+}
+
+TGD::ArrayContainer QuadTree::newQuad(int level, std::shared_ptr<void>& memory) const
+{
+    TGD::ArrayDescription description = (level == 0 ? _level0Description
+            : TGD::ArrayDescription({ size_t(quadWidth()), size_t(quadHeight()) },
+                _level0Description.componentCount(),
+                levelIsHalfFloat(level) ? TGD::uint16 : _level0Description.componentType()));
+    // The memory is owned by a shared pointer that we keep, so that buildQuad()
+    // can find out whether a quad is still in use
+    const TGD::Allocator& allocator = defaultAllocator();
+    size_t size = description.dataSize();
+    memory = std::shared_ptr<void>(allocator.allocate(size),
+            [&allocator, size](void* p) { allocator.deallocate(p, size); });
+    return TGD::ArrayContainer(description, memory.get(), memory);
+}
+
+void QuadTree::finishQuad(int qi, const TGD::ArrayContainer& q, const std::shared_ptr<void>& memory)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quads[qi] = q;
+        _quadMemory[qi] = memory;
+        _quadStates[qi] = (_quadStates[qi] == QuadComputingStale ? QuadMissing : QuadReady);
+        trackQuad(qi);
+    }
+    _quadFinished.notify_all();
+    defaultMemoryBudget().enforce();
+}
+
+void QuadTree::trackQuad(int qi)
+{
+    // _mutex must be locked
+    if (!_quadAllocations[qi] || _quadAllocations[qi]->evicted()) {
+        std::weak_ptr<QuadTree> weakTree = weak_from_this();
+        _quadAllocations[qi] = defaultMemoryBudget().add(MemoryRAM, _quads[qi].dataSize(), true,
+                [weakTree, qi]() {
+                    std::shared_ptr<QuadTree> tree = weakTree.lock();
+                    if (tree)
+                        tree->evictQuad(qi);
+                });
+    }
+}
+
+void QuadTree::evictQuad(int qi)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    // The allocation might have been replaced in the meantime
+    if (!_quadAllocations[qi] || !_quadAllocations[qi]->evicted())
+        return;
+    //fprintf(stderr, "evicting quad %d\n", qi);
+    _quadAllocations[qi].reset();
+    _quads[qi] = TGD::ArrayContainer();
+    _quadMemory[qi].reset();
+    if (_quadStates[qi] == QuadReady)
+        _quadStates[qi] = QuadMissing;
+}
+
+void QuadTree::copyElements(void* dst, const void* src, size_t n, const TGD::ArrayContainer& srcArray) const
+{
+    if (_channelsAreIdentity) {
+        std::memcpy(dst, src, n * srcArray.elementSize());
+    } else {
+        // gather the channels of this quadtree
+        size_t componentSize = srcArray.componentSize();
+        size_t srcElementSize = srcArray.elementSize();
+        size_t dstElementSize = _channels.size() * componentSize;
+        for (size_t e = 0; e < n; e++) {
+            const unsigned char* s = static_cast<const unsigned char*>(src) + e * srcElementSize;
+            unsigned char* d = static_cast<unsigned char*>(dst) + e * dstElementSize;
+            for (size_t c = 0; c < _channels.size(); c++)
+                std::memcpy(d + c * componentSize, s + _channels[c] * componentSize, componentSize);
+        }
+    }
+}
+
+void QuadTree::computeQuadOnLevel0Worker(TGD::ArrayContainer& q, const TGD::ArrayContainer& src, int qx, int qy) const
+{
+    int srcX = qx * quadWidth() - borderSize(0);
+    int srcY = qy * quadHeight() - borderSize(0);
+
+    if (srcX >= 0 && srcY >= 0
+            && srcX + int(q.dimension(0)) < width()
+            && srcY + int(q.dimension(1)) < height()) {
+        // case 1: copy the whole block
+        for (size_t y = 0; y < q.dimension(1); y++) {
+            copyElements(q.get({ 0, y }),
+                    src.get({ size_t(srcX), size_t(srcY + y) }),
+                    q.dimension(0), src);
+        }
+    } else {
+        // case 2: border coordinates need to be clamped
+        int copyableBlockMinX = srcX;
+        if (copyableBlockMinX < 0)
+            copyableBlockMinX = 0;
+        int copyableBlockMaxX = srcX + q.dimension(0) - 1;
+        if (copyableBlockMaxX >= width())
+            copyableBlockMaxX = width() - 1;
+        int copyableBlockMinY = srcY;
+        if (copyableBlockMinY < 0)
+            copyableBlockMinY = 0;
+        int copyableBlockMaxY = srcY + q.dimension(1) - 1;
+        if (copyableBlockMaxY >= height())
+            copyableBlockMaxY = height() - 1;
+        for (int y = 0; y < copyableBlockMinY - srcY; y++) {
+            for (int x = 0; x < copyableBlockMinX - srcX; x++) {
+                copyElements(q.get({ size_t(x), size_t(y) }),
+                        src.get({ size_t(0), size_t(0) }),
+                        1, src);
+            }
+            copyElements(q.get({ size_t(copyableBlockMinX - srcX), size_t(y) }),
+                    src.get({ size_t(copyableBlockMinX), size_t(0) }),
+                    copyableBlockMaxX - copyableBlockMinX + 1, src);
+            for (int x = copyableBlockMaxX - srcX + 1; x < int(q.dimension(0)); x++) {
+                copyElements(q.get({ size_t(x), size_t(y) }),
+                        src.get({ size_t(width() - 1), size_t(0) }),
+                        1, src);
+            }
+        }
+        for (int y = copyableBlockMinY - srcY; y <= copyableBlockMaxY - srcY; y++) {
+            for (int x = 0; x < copyableBlockMinX - srcX; x++) {
+                copyElements(q.get({ size_t(x), size_t(y) }),
+                        src.get({ size_t(0), size_t(srcY + y) }),
+                        1, src);
+            }
+            copyElements(q.get({ size_t(copyableBlockMinX - srcX), size_t(y) }),
+                    src.get({ size_t(copyableBlockMinX), size_t(srcY + y) }),
+                    copyableBlockMaxX - copyableBlockMinX + 1, src);
+            for (int x = copyableBlockMaxX - srcX + 1; x < int(q.dimension(0)); x++) {
+                copyElements(q.get({ size_t(x), size_t(y) }),
+                        src.get({ size_t(width() - 1), size_t(srcY + y) }),
+                        1, src);
+            }
+        }
+        for (int y = copyableBlockMaxY - srcY + 1; y < int(q.dimension(1)); y++) {
+            for (int x = 0; x < copyableBlockMinX - srcX; x++) {
+                copyElements(q.get({ size_t(x), size_t(y) }),
+                        src.get({ size_t(0), size_t(height() - 1) }),
+                        1, src);
+            }
+            copyElements(q.get({ size_t(copyableBlockMinX - srcX), size_t(y) }),
+                    src.get({ size_t(copyableBlockMinX), size_t(height() - 1) }),
+                    copyableBlockMaxX - copyableBlockMinX + 1, src);
+            for (int x = copyableBlockMaxX - srcX + 1; x < int(q.dimension(0)); x++) {
+                copyElements(q.get({ size_t(x), size_t(y) }),
+                        src.get({ size_t(width() - 1), size_t(height() - 1) }),
+                        1, src);
+            }
+        }
+    }
+#if 0
+    for (size_t y = 0; y < q.dimension(1); y++) {
+        int sy = srcY + y;
+        if (sy < 0)
+            sy = 0;
+        else if (sy >= height())
+            sy = height() - 1;
+        for (size_t x = 0; x < q.dimension(0); x++) {
+            const void* quadElement = q.get({ x, y });
+            int sx = srcX + x;
+            if (sx < 0)
+                sx = 0;
+            else if (sx >= width())
+                sx = width() - 1;
+            const void* srcElement = src.get({ sx, sy });
+            assert(memcmp(quadElement, srcElement, q.elementSize()) == 0);
+            if (memcmp(quadElement, srcElement, q.elementSize()) != 0) {
+                fprintf(stderr, "FAIL\n");
+            }
+        }
+    }
+#endif
+}
+
+void QuadTree::computeQuadOnLevel0(TGD::ArrayContainer& quad, const TGD::ArrayContainer& src, int qx, int qy) const
+{
+    assert(qx >= 0 && qx < levelWidth(0));
+    assert(qy >= 0 && qy < levelHeight(0));
+    //fprintf(stderr, "computing quad %d,%d,%d\n", 0, qx, qy);
+
+    if (_level0Description.componentType() == src.componentType()) {
+        // write results directly into quad
+        computeQuadOnLevel0Worker(quad, src, qx, qy);
+    } else {
+        // compute in original data type first
+        TGD::ArrayContainer quadLevel0Tmp(
+                _level0Description.dimensions(),
+                _level0Description.componentCount(),
+                src.componentType(), defaultAllocator());
+        computeQuadOnLevel0Worker(quadLevel0Tmp, src, qx, qy);
+        // convert
+        convert(quad, quadLevel0Tmp);
+    }
+}
+
+/* Tables for averaging 8-bit sRGB values in linear space without computing
+ * powf() for every sample */
+struct SRGBTables {
+    float toLinear[256];
+    // thresholds[i] is the linear value halfway between sRGB values i and i+1;
+    // the last entry is a sentinel
+    float thresholds[256];
+
+    SRGBTables()
+    {
+        for (int i = 0; i < 256; i++)
+            toLinear[i] = ::toLinear(i / 255.0f);
+        for (int i = 0; i < 255; i++)
+            thresholds[i] = ::toLinear((i + 0.5f) / 255.0f);
+        thresholds[255] = std::numeric_limits<float>::max();
+    }
+
+    uint8_t toS(float linearValue) const
+    {
+        // branchless binary search for the number of thresholds <= linearValue
+        int i = 0;
+        for (int step = 128; step > 0; step /= 2)
+            i += (thresholds[i + step - 1] <= linearValue ? step : 0);
+        return i;
+    }
+};
+
+static const SRGBTables& srgbTables()
+{
+    static const SRGBTables tables;
+    return tables;
+}
+
+/* Average 2x2 blocks of one source line pair into one destination line.
+ * Lines are processed with plain pointers so that the compiler can vectorize. */
+
+static void interpolateLineSRGB(uint8_t* d, const uint8_t* s0, const uint8_t* s1, size_t w, size_t cc, size_t c,
+        const SRGBTables& tables)
+{
+    for (size_t x = 0; x < w; x++) {
+        size_t i = 2 * x * cc + c;
+        float v = (tables.toLinear[s0[i]] + tables.toLinear[s0[i + cc]]
+                + tables.toLinear[s1[i]] + tables.toLinear[s1[i + cc]]) * 0.25f;
+        d[x * cc + c] = tables.toS(v);
+    }
+}
+
+static void interpolateLineUInt8(uint8_t* d, const uint8_t* s0, const uint8_t* s1, size_t w, size_t cc, size_t c)
+{
+    for (size_t x = 0; x < w; x++) {
+        size_t i = 2 * x * cc + c;
+        d[x * cc + c] = (s0[i] + s0[i + cc] + s1[i] + s1[i + cc] + 2) / 4;
+    }
+}
+
+template<typename T>
+static void interpolateLineInt(T* d, const T* s0, const T* s1, size_t w, size_t cc)
+{
+    for (size_t x = 0; x < w; x++) {
+        for (size_t c = 0; c < cc; c++) {
+            size_t i = 2 * x * cc + c;
+            int sum = s0[i] + s0[i + cc] + s1[i] + s1[i + cc];
+            d[x * cc + c] = std::round(sum * 0.25f);
+        }
+    }
+}
+
+template<typename T>
+static void interpolateInt(TGD::ArrayContainer& dst,
+        size_t dstXOffset, size_t dstYOffset, size_t w, size_t h,
+        const TGD::ArrayContainer& src, size_t srcXOffset, size_t srcYOffset)
+{
+    size_t cc = dst.componentCount();
+    size_t dstLineSize = dst.dimension(0) * cc;
+    size_t srcLineSize = src.dimension(0) * cc;
+    for (size_t y = 0; y < h; y++) {
+        T* d = static_cast<T*>(dst.data())
+            + (dstYOffset + y) * dstLineSize + dstXOffset * cc;
+        const T* s0 = static_cast<const T*>(src.data())
+            + (srcYOffset + 2 * y) * srcLineSize + srcXOffset * cc;
+        const T* s1 = s0 + srcLineSize;
+        interpolateLineInt(d, s0, s1, w, cc);
+    }
+}
+
+template<size_t CC>
+static void interpolateLineFloat(float* d, const float* s0, const float* s1, size_t w)
+{
+    for (size_t x = 0; x < w; x++) {
+        for (size_t c = 0; c < CC; c++) {
+            size_t i = 2 * x * CC + c;
+            d[x * CC + c] = (s0[i] + s0[i + CC] + s1[i] + s1[i + CC]) * 0.25f;
+        }
+    }
+}
+
+static void interpolateLineFloat(float* d, const float* s0, const float* s1, size_t w, size_t cc)
+{
+    switch (cc) {
+    case 1:
+        interpolateLineFloat<1>(d, s0, s1, w);
+        break;
+    case 2:
+        interpolateLineFloat<2>(d, s0, s1, w);
+        break;
+    case 3:
+        interpolateLineFloat<3>(d, s0, s1, w);
+        break;
+    case 4:
+        interpolateLineFloat<4>(d, s0, s1, w);
+        break;
+    default:
+        for (size_t x = 0; x < w; x++) {
+            for (size_t c = 0; c < cc; c++) {
+                size_t i = 2 * x * cc + c;
+                d[x * cc + c] = (s0[i] + s0[i + cc] + s1[i] + s1[i + cc]) * 0.25f;
+            }
+        }
+        break;
+    }
+}
+
+/* Conversion between float and IEEE half float (stored as uint16_t),
+ * with round-to-nearest-even and correct handling of denormals, Inf and NaN */
+
+static inline uint16_t floatToHalf(float value)
+{
+    const uint32_t f32Infinity = 255u << 23;
+    const uint32_t f16Max = (127u + 16u) << 23;
+    const uint32_t denormMagicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    uint32_t f;
+    std::memcpy(&f, &value, sizeof(f));
+    uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+    uint16_t h;
+    if (f >= f16Max) {
+        // Inf or NaN
+        h = (f > f32Infinity ? 0x7e00 : 0x7c00);
+    } else if (f < (113u << 23)) {
+        // denormal or zero: let the FPU do the rounding
+        float denormMagic, tmp;
+        std::memcpy(&denormMagic, &denormMagicBits, sizeof(denormMagic));
+        std::memcpy(&tmp, &f, sizeof(tmp));
+        tmp += denormMagic;
+        std::memcpy(&f, &tmp, sizeof(f));
+        h = f - denormMagicBits;
+    } else {
+        uint32_t mantissaOdd = (f >> 13) & 1;
+        f += ((15u - 127u) << 23) + 0xfff;
+        f += mantissaOdd;
+        h = f >> 13;
+    }
+    return h | (sign >> 16);
+}
+
+static inline float halfToFloat(uint16_t h)
+{
+    const uint32_t shiftedExponent = 0x7c00u << 13;
+    const uint32_t magicBits = 113u << 23;
+    uint32_t f = (h & 0x7fffu) << 13;
+    uint32_t exponent = shiftedExponent & f;
+    f += (127u - 15u) << 23;
+    if (exponent == shiftedExponent) {
+        // Inf or NaN
+        f += (128u - 16u) << 23;
+    } else if (exponent == 0) {
+        // denormal or zero: renormalize
+        float magic, tmp;
+        std::memcpy(&magic, &magicBits, sizeof(magic));
+        f += 1u << 23;
+        std::memcpy(&tmp, &f, sizeof(tmp));
+        tmp -= magic;
+        std::memcpy(&f, &tmp, sizeof(f));
+    }
+    f |= uint32_t(h & 0x8000u) << 16;
+    float value;
+    std::memcpy(&value, &f, sizeof(value));
+    return value;
+}
+
+static inline float sampleValue(float v) { return v; }
+static inline float sampleValue(uint16_t h) { return halfToFloat(h); }
+
+template<typename T>
+static void interpolateLineToHalf(uint16_t* d, const T* s0, const T* s1, size_t w, size_t cc)
+{
+    for (size_t x = 0; x < w; x++) {
+        for (size_t c = 0; c < cc; c++) {
+            size_t i = 2 * x * cc + c;
+            d[x * cc + c] = floatToHalf((sampleValue(s0[i]) + sampleValue(s0[i + cc])
+                        + sampleValue(s1[i]) + sampleValue(s1[i + cc])) * 0.25f);
+        }
+    }
+}
+
+template<typename T>
+static void interpolateToHalf(TGD::ArrayContainer& dst,
+        size_t dstXOffset, size_t dstYOffset, size_t w, size_t h,
+        const TGD::ArrayContainer& src, size_t srcXOffset, size_t srcYOffset)
+{
+    size_t cc = dst.componentCount();
+    size_t dstLineSize = dst.dimension(0) * cc;
+    size_t srcLineSize = src.dimension(0) * cc;
+    for (size_t y = 0; y < h; y++) {
+        uint16_t* d = static_cast<uint16_t*>(dst.data())
+            + (dstYOffset + y) * dstLineSize + dstXOffset * cc;
+        const T* s0 = static_cast<const T*>(src.data())
+            + (srcYOffset + 2 * y) * srcLineSize + srcXOffset * cc;
+        const T* s1 = s0 + srcLineSize;
+        interpolateLineToHalf(d, s0, s1, w, cc);
+    }
+}
+
+static void interpolate(TGD::ArrayContainer& dst,
+        size_t dstXOffset, size_t dstYOffset, size_t w, size_t h,
+        const TGD::ArrayContainer& src, size_t srcXOffset, size_t srcYOffset,
+        const bool isS[4], bool srcIsHalf, bool dstIsHalf)
+{
+    size_t cc = dst.componentCount();
+    size_t dstLineSize = dst.dimension(0) * cc;
+    size_t srcLineSize = src.dimension(0) * cc;
+    if (dstIsHalf) {
+        if (srcIsHalf)
+            interpolateToHalf<uint16_t>(dst, dstXOffset, dstYOffset, w, h, src, srcXOffset, srcYOffset);
+        else
+            interpolateToHalf<float>(dst, dstXOffset, dstYOffset, w, h, src, srcXOffset, srcYOffset);
+    } else if (dst.componentType() == TGD::uint8) {
+        const SRGBTables& tables = srgbTables();
+        for (size_t y = 0; y < h; y++) {
+            uint8_t* d = static_cast<uint8_t*>(dst.data())
+                + (dstYOffset + y) * dstLineSize + dstXOffset * cc;
+            const uint8_t* s0 = static_cast<const uint8_t*>(src.data())
+                + (srcYOffset + 2 * y) * srcLineSize + srcXOffset * cc;
+            const uint8_t* s1 = s0 + srcLineSize;
+            for (size_t c = 0; c < cc; c++) {
+                if (isS[c])
+                    interpolateLineSRGB(d, s0, s1, w, cc, c, tables);
+                else
+                    interpolateLineUInt8(d, s0, s1, w, cc, c);
+            }
+        }
+    } else if (dst.componentType() == TGD::int8) {
+        interpolateInt<int8_t>(dst, dstXOffset, dstYOffset, w, h, src, srcXOffset, srcYOffset);
+    } else if (dst.componentType() == TGD::int16) {
+        interpolateInt<int16_t>(dst, dstXOffset, dstYOffset, w, h, src, srcXOffset, srcYOffset);
+    } else if (dst.componentType() == TGD::uint16) {
+        interpolateInt<uint16_t>(dst, dstXOffset, dstYOffset, w, h, src, srcXOffset, srcYOffset);
+    } else {
+        for (size_t y = 0; y < h; y++) {
+            float* d = static_cast<float*>(dst.data())
+                + (dstYOffset + y) * dstLineSize + dstXOffset * cc;
+            const float* s0 = static_cast<const float*>(src.data())
+                + (srcYOffset + 2 * y) * srcLineSize + srcXOffset * cc;
+            const float* s1 = s0 + srcLineSize;
+            interpolateLineFloat(d, s0, s1, w, cc);
+        }
+    }
+}
+
+static void setInvalid(TGD::ArrayContainer& dst,
+        size_t dstXOffset, size_t dstYOffset, size_t w, size_t h)
+{
+    if (!defaultAllocator().clearsMemory()) {
+        for (size_t y = 0; y < h; y++) {
+            size_t dste = (y + dstYOffset) * dst.dimension(0) + dstXOffset;
+            std::memset(dst.get(dste), 0, w * dst.elementSize());
+        }
+    }
+}
+
+void QuadTree::computeQuadOnLevel(TGD::ArrayContainer& q, int level, int qx, int qy,
+        const TGD::ArrayContainer children[4],
+        const size_t childXOffsets[4], const size_t childYOffsets[4]) const
+{
+    assert(q.componentType() == TGD::int8 || q.componentType() == TGD::uint8
+            || q.componentType() == TGD::int16 || q.componentType() == TGD::uint16
+            || q.componentType() == TGD::float32);
+    assert(level >= 1);
+    //fprintf(stderr, "computing quad %d,%d,%d\n", level, qx, qy);
+
+    int q0Index = quadIndex(level - 1, 2 * qx + 0, 2 * qy + 0);
+    int q1Index = quadIndex(level - 1, 2 * qx + 1, 2 * qy + 0);
+    int q2Index = quadIndex(level - 1, 2 * qx + 0, 2 * qy + 1);
+    int q3Index = quadIndex(level - 1, 2 * qx + 1, 2 * qy + 1);
+    size_t w = quadWidth() / 2;
+    size_t h = quadHeight() / 2;
+    bool srcIsHalf = levelIsHalfFloat(level - 1);
+    bool dstIsHalf = levelIsHalfFloat(level);
+
+    size_t dstXOffset = 0;
+    size_t dstYOffset = 0;
+    if (q0Index >= 0) {
+        interpolate(q, dstXOffset, dstYOffset, w, h, children[0], childXOffsets[0], childYOffsets[0], _isS, srcIsHalf, dstIsHalf);
+    } else {
+        setInvalid(q, dstXOffset, dstYOffset, w, h);
+    }
+
+    dstXOffset = w;
+    dstYOffset = 0;
+    if (q1Index >= 0) {
+        interpolate(q, dstXOffset, dstYOffset, w, h, children[1], childXOffsets[1], childYOffsets[1], _isS, srcIsHalf, dstIsHalf);
+    } else {
+        setInvalid(q, dstXOffset, dstYOffset, w, h);
+    }
+
+    dstXOffset = 0;
+    dstYOffset = h;
+    if (q2Index >= 0) {
+        interpolate(q, dstXOffset, dstYOffset, w, h, children[2], childXOffsets[2], childYOffsets[2], _isS, srcIsHalf, dstIsHalf);
+    } else {
+        setInvalid(q, dstXOffset, dstYOffset, w, h);
+    }
+
+    dstXOffset = w;
+    dstYOffset = h;
+    if (q3Index >= 0) {
+        interpolate(q, dstXOffset, dstYOffset, w, h, children[3], childXOffsets[3], childYOffsets[3], _isS, srcIsHalf, dstIsHalf);
+    } else {
+        setInvalid(q, dstXOffset, dstYOffset, w, h);
+    }
+}
+
+const TGD::ArrayContainer& QuadTree::preview()
+{
+    if (_preview.elementCount() == 0) {
+        // The top level quad has no border. Each of its texels covers
+        // 2^topLevel data elements in each direction.
+        int topLevel = levels() - 1;
+        size_t step = size_t(1) << topLevel;
+        size_t previewWidth = quadWidth();
+        size_t previewHeight = quadHeight();
+        while (previewWidth > 1024 || previewHeight > 1024) {
+            previewWidth = previewWidth / 2 + previewWidth % 2;
+            previewHeight = previewHeight / 2 + previewHeight % 2;
+            step *= 2;
+        }
+        //fprintf(stderr, "computing %zux%zu preview with step %zu\n", previewWidth, previewHeight, step);
+        TGD::ArrayContainer tmp({ previewWidth, previewHeight },
+                _channels.size(), _originalArray.componentType(),
+                TGD::Allocator() /* we want in-memory storage here */);
+        #pragma omp parallel for
+        for (size_t y = 0; y < previewHeight; y++) {
+            size_t srcY = std::min(y * step + step / 2, size_t(height() - 1));
+            for (size_t x = 0; x < previewWidth; x++) {
+                size_t srcX = std::min(x * step + step / 2, size_t(width() - 1));
+                copyElements(tmp.get({ x, y }), _originalArray.get({ srcX, srcY }), 1, _originalArray);
+            }
+        }
+        if (_level0Description.componentType() == tmp.componentType()) {
+            _preview = tmp;
+        } else {
+            _preview = TGD::ArrayContainer({ previewWidth, previewHeight },
+                    _level0Description.componentCount(), _level0Description.componentType(),
+                    TGD::Allocator());
+            convert(_preview, tmp);
+        }
+        if (levelIsHalfFloat(topLevel)) {
+            TGD::ArrayContainer halfPreview({ previewWidth, previewHeight },
+                    _preview.componentCount(), TGD::uint16, TGD::Allocator());
+            const float* src = static_cast<const float*>(_preview.data());
+            uint16_t* dst = static_cast<uint16_t*>(halfPreview.data());
+            for (size_t i = 0; i < halfPreview.elementCount() * halfPreview.componentCount(); i++)
+                dst[i] = floatToHalf(src[i]);
+            _preview = halfPreview;
+        }
+    }
+    return _preview;
+}
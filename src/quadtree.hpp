@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2019, 2020, 2021, 2022
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ * Copyright (C) 2023, 2024, 2025
+ * Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_QUADTREE_HPP
+#define QV_QUADTREE_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <tuple>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include <tgd/array.hpp>
+
+#include "diskcache.hpp"
+#include "memorybudget.hpp"
+
+
+/* The quadtree representation of a frame, used for rendering.
+ *
+ * Quads are computed by the default thread pool in the background. Quads that
+ * are requested for rendering are computed first, followed by all remaining
+ * quads once the background build was started. All public functions are
+ * thread-safe.
+ *
+ * Quads on levels above 0 are stored in the frame cache, if any, so that they
+ * do not need to be computed again when the frame is opened the next time.
+ * Level 0 quads are cheaper to compute from the original data than to load.
+ * Level 0 quads that lie completely inside the original data (including their
+ * border) are not stored at all if they would only duplicate it; see
+ * directQuad().
+ *
+ * Computed quads count against the RAM budget of the default memory budget.
+ * Quads evicted from it are computed again (or loaded from the frame cache)
+ * when needed, and the background build pauses while the budget is full. */
+class QuadTree : public std::enable_shared_from_this<QuadTree> {
+private:
+    enum QuadState {
+        QuadMissing,        // needs to be computed
+        QuadComputing,      // is being computed by some thread
+        QuadComputingStale, // is being computed, but its data changed meanwhile
+        QuadReady           // is up to date
+    };
+
+    /* data: */
+    TGD::ArrayContainer _originalArray; // protected by _mutex
+    int _width, _height;
+    std::vector<int> _channels; // the channels of the original array that the quads hold
+    bool _channelsAreIdentity;
+    bool _isS[4];
+    FrameCache _cache; // protected by _mutex
+    std::string _cacheName;
+    bool _halfFloat;
+    /* geometry: */
+    int _level0BorderSize;
+    TGD::ArrayDescription _level0Description;
+    std::vector<int> _levelWidths;
+    std::vector<int> _levelHeights;
+    std::vector<int> _levelBaseIndices;
+    /* quads, protected by _mutex: */
+    std::mutex _mutex;
+    std::condition_variable _quadFinished;
+    std::vector<TGD::ArrayContainer> _quads;
+    std::vector<QuadState> _quadStates;
+    std::vector<bool> _quadQueued;
+    std::vector<std::shared_ptr<void>> _quadMemory; // owns the data of _quads, see newQuad()
+    std::vector<unsigned long long> _quadVersions; // incremented whenever a quad changes
+    std::vector<std::shared_ptr<MemoryAllocation>> _quadAllocations; // for the memory budget
+    std::vector<uint64_t> _level0Hashes; // hashes of the data of level 0 quads, see update()
+    bool _singleQuadIsOriginal;
+    bool _level0CanBeDirect; // level 0 quads can be taken directly from the original array
+    std::deque<int> _requestQueue;
+    int _backgroundQueueIndex; // -1 if the background build was not started
+    int _workers;
+    /* preview of the top level quad, only used by the rendering thread: */
+    TGD::ArrayContainer _preview;
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    void quadCoordinates(int qi, int& level, int& qx, int& qy) const;
+    bool level0QuadIsDirect(int qx, int qy) const;
+    void collectMissingQuads(int level, int qx, int qy, std::vector<std::vector<int>>& quadsPerLevel) const;
+    void invalidateSubtree(int level, int qx, int qy);
+    void invalidateAncestors(int level, int qx, int qy);
+    uint64_t hashLevel0Source(const TGD::ArrayContainer& array, int qx, int qy) const;
+    void startWorkers();
+    bool nextQueuedQuad(int& qi);
+    void buildQuad(int qi);
+    TGD::ArrayContainer newQuad(int level, std::shared_ptr<void>& memory) const;
+    void finishQuad(int qi, const TGD::ArrayContainer& q, const std::shared_ptr<void>& memory);
+    void trackQuad(int qi);
+    void evictQuad(int qi);
+    static void work(std::weak_ptr<QuadTree> weakTree);
+
+    void copyElements(void* dst, const void* src, size_t n, const TGD::ArrayContainer& srcArray) const;
+    void computeQuadOnLevel0Worker(TGD::ArrayContainer& quad, const TGD::ArrayContainer& src, int qx, int qy) const;
+    void computeQuadOnLevel0(TGD::ArrayContainer& quad, const TGD::ArrayContainer& src, int qx, int qy) const;
+    void computeQuadOnLevel(TGD::ArrayContainer& quad, int l, int qx, int qy,
+            const TGD::ArrayContainer children[4],
+            const size_t childXOffsets[4], const size_t childYOffsets[4]) const;
+
+public:
+    // The quads hold the given channels of the original array, in that order.
+    // Quadtrees for different channels of the same frame need different cache names.
+    QuadTree(const TGD::ArrayContainer& originalArray, const std::vector<int>& channels,
+            const TGD::ArrayDescription& level0Description, int level0BorderSize,
+            const bool isS[4], bool halfFloat = false, const FrameCache& cache = FrameCache(),
+            const std::string& cacheName = "quad");
+
+    int borderSize(int level) const { return (level == 0 ? _level0BorderSize : 0); }
+    int quadWidth() const { return _level0Description.dimension(0) - 2 * borderSize(0); }
+    int quadHeight() const { return _level0Description.dimension(1) - 2 * borderSize(0); }
+    int levels() const { return _levelWidths.size(); }
+    int levelWidth(int level) const { return _levelWidths[level]; }
+    int levelHeight(int level) const { return _levelHeights[level]; }
+    int quadIndex(int level, int qx, int qy) const; // returns -1 if nonexistent
+    // If enabled for float32 quads, levels >= 1 store IEEE half floats in uint16 arrays
+    bool levelIsHalfFloat(int level) const { return _halfFloat && level > 0; }
+
+    // Schedule the given quads for computation before all other quads
+    void request(const std::vector<std::tuple<int, int, int>>& quads);
+    // Schedule all remaining quads for computation
+    void startBackgroundBuild();
+    // Replace the data with an array of the same geometry. Only the quads whose
+    // data changed are recomputed, along with their ancestors. Returns whether
+    // anything changed.
+    bool update(const TGD::ArrayContainer& array, const FrameCache& cache);
+    // Same, with hashes from level0Hashes(), which can be shared by quadtrees
+    // of the same geometry
+    bool update(const TGD::ArrayContainer& array, const FrameCache& cache,
+            const std::vector<uint64_t>& level0Hashes);
+    std::vector<uint64_t> level0Hashes(const TGD::ArrayContainer& array) const;
+    // Take over the ready quads of another quadtree with the same geometry,
+    // e.g. of the previous frame, whose data is the same in both trees
+    // according to the level 0 hashes of our original array. Unlike update(),
+    // this leaves the other tree intact: the quads are shared afterwards.
+    void adopt(QuadTree& other, const std::vector<uint64_t>& level0Hashes);
+    // Compute the given quads now, with the help of the calling thread
+    void waitFor(const std::vector<std::tuple<int, int, int>>& quads);
+
+    bool isReady(int level, int qx, int qy);
+    unsigned long long version(int level, int qx, int qy);
+    // Computes the quad first if necessary
+    TGD::ArrayContainer quad(int level, int qx, int qy);
+    // If the data of the quad is a region of the original array, returns true
+    // and sets the array and the top left corner of the region (including the
+    // border), so that the data can be used without copying it
+    bool directQuad(int level, int qx, int qy, TGD::ArrayContainer& array, int& x, int& y);
+
+    // A nearest-neighbor subsampled stand-in for the top level quad.
+    // It is cheap to compute and can be displayed until the real quads are ready.
+    const TGD::ArrayContainer& preview();
+};
+
+#endif
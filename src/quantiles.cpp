@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include <omp.h>
+
+#include "quantiles.hpp"
+
+
+Quantiles::Quantiles() :
+    _initialized(false),
+    _approximate(false),
+    _lowFraction(0.0f), _highFraction(1.0f),
+    _lowVal(std::numeric_limits<float>::quiet_NaN()),
+    _highVal(std::numeric_limits<float>::quiet_NaN())
+{
+}
+
+/* Order-preserving unsigned keys: for finite values, a < b if and only if
+ * key(a) < key(b). Signed integers get their sign bit flipped; floats get all
+ * bits flipped if negative and only the sign bit flipped otherwise. */
+template<typename T>
+using KeyType = typename std::conditional<sizeof(T) <= 4, uint32_t, uint64_t>::type;
+
+template<typename T>
+static inline KeyType<T> toKey(T v)
+{
+    typedef KeyType<T> K;
+    const K sign = K(1) << (sizeof(T) * 8 - 1);
+    if constexpr (std::is_floating_point<T>::value) {
+        K bits;
+        std::memcpy(&bits, &v, sizeof(T));
+        return (bits & sign) ? ~bits : (bits | sign);
+    } else if constexpr (std::is_signed<T>::value) {
+        return K(typename std::make_unsigned<T>::type(v)) ^ sign;
+    } else {
+        return v;
+    }
+}
+
+template<typename T>
+static inline T fromKey(KeyType<T> k)
+{
+    typedef KeyType<T> K;
+    const K sign = K(1) << (sizeof(T) * 8 - 1);
+    if constexpr (std::is_floating_point<T>::value) {
+        K bits = (k & sign) ? (k & ~sign) : ~k;
+        T v;
+        std::memcpy(&v, &bits, sizeof(T));
+        return v;
+    } else if constexpr (std::is_signed<T>::value) {
+        return T(typename std::make_unsigned<T>::type(k ^ sign));
+    } else {
+        return k;
+    }
+}
+
+/* Find the values with the given ranks among the finite values (the
+ * fractions are mapped to ranks once their number is known). Each pass
+ * histograms the next 16 bit digit of the keys of the values whose higher
+ * digits match the digits selected so far, and selects the digit whose bucket
+ * contains the rank. The first pass is shared by all ranks. Each thread uses
+ * its own histograms. */
+template<typename T>
+static void select(const Quantiles::ForEachArray& forEachArray, size_t c,
+        const std::vector<double>& fractions, std::vector<float>& values)
+{
+    typedef KeyType<T> K;
+    constexpr int digitBits = 16;
+    constexpr size_t digits = size_t(1) << digitBits;
+    constexpr int keyBits = std::max(digitBits, int(sizeof(T) * 8));
+    const size_t k = fractions.size();
+    const int maxParts = omp_get_max_threads();
+
+    std::vector<K> prefixes(k, 0);
+    std::vector<unsigned long long> ranks(k, 0);
+    std::vector<unsigned long long> partHist;
+    std::vector<unsigned long long> hist;
+    for (int shift = keyBits - digitBits; shift >= 0; shift -= digitBits) {
+        const bool firstPass = (shift + digitBits == keyBits);
+        const size_t histCount = (firstPass ? 1 : k);
+        partHist.assign(maxParts * histCount * digits, 0);
+        forEachArray([&](const TGD::ArrayContainer& array) {
+                size_t n = array.elementCount();
+                size_t cc = array.componentCount();
+                const T* data = static_cast<const T*>(array.data());
+                #pragma omp parallel
+                {
+                    unsigned long long* ph = partHist.data() + omp_get_thread_num() * histCount * digits;
+                    #pragma omp for schedule(static)
+                    for (size_t e = 0; e < n; e++) {
+                        T val = data[e * cc + c];
+                        if (!std::isfinite(val))
+                            continue;
+                        K key = toKey(val);
+                        size_t d = (key >> shift) & (digits - 1);
+                        if (firstPass) {
+                            ph[d]++;
+                        } else {
+                            for (size_t j = 0; j < k; j++)
+                                if ((key >> (shift + digitBits)) == prefixes[j])
+                                    ph[j * digits + d]++;
+                        }
+                    }
+                }
+            });
+        hist.assign(histCount * digits, 0);
+        for (int p = 0; p < maxParts; p++)
+            for (size_t i = 0; i < histCount * digits; i++)
+                hist[i] += partHist[p * histCount * digits + i];
+        if (firstPass) {
+            unsigned long long n = 0;
+            for (size_t d = 0; d < digits; d++)
+                n += hist[d];
+            if (n == 0) {
+                values.assign(k, std::numeric_limits<float>::quiet_NaN());
+                return;
+            }
+            for (size_t j = 0; j < k; j++)
+                ranks[j] = std::min(n - 1, (unsigned long long)std::llround(fractions[j] * (n - 1)));
+        }
+        for (size_t j = 0; j < k; j++) {
+            const unsigned long long* h = hist.data() + (firstPass ? 0 : j * digits);
+            size_t d = 0;
+            while (ranks[j] >= h[d]) {
+                ranks[j] -= h[d];
+                d++;
+            }
+            prefixes[j] = (prefixes[j] << digitBits) | K(d);
+        }
+    }
+    values.resize(k);
+    for (size_t j = 0; j < k; j++)
+        values[j] = fromKey<T>(prefixes[j]);
+}
+
+static void select(const Quantiles::ForEachArray& forEachArray, TGD::Type type, size_t c,
+        const std::vector<double>& fractions, std::vector<float>& values)
+{
+    switch (type) {
+    case TGD::int8:
+        select<int8_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::uint8:
+        select<uint8_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::int16:
+        select<int16_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::uint16:
+        select<uint16_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::int32:
+        select<int32_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::uint32:
+        select<uint32_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::int64:
+        select<int64_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::uint64:
+        select<uint64_t>(forEachArray, c, fractions, values);
+        break;
+    case TGD::float32:
+        select<float>(forEachArray, c, fractions, values);
+        break;
+    case TGD::float64:
+        select<double>(forEachArray, c, fractions, values);
+        break;
+    }
+}
+
+void Quantiles::init(const TGD::ArrayContainer& array, size_t componentIndex, float lowFraction, float highFraction)
+{
+    init([&](const std::function<void (const TGD::ArrayContainer&)>& f) { f(array); },
+            array.componentType(), componentIndex, lowFraction, highFraction);
+}
+
+void Quantiles::init(const ForEachArray& forEachArray, TGD::Type type, size_t componentIndex,
+        float lowFraction, float highFraction)
+{
+    std::vector<double> fractions = { lowFraction, highFraction };
+    std::vector<float> values;
+    select(forEachArray, type, componentIndex, fractions, values);
+    _lowFraction = lowFraction;
+    _highFraction = highFraction;
+    _lowVal = values[0];
+    _highVal = values[1];
+    _initialized = true;
+    _approximate = false;
+}
+
+void Quantiles::init(const ValueCounts& valueCounts, size_t componentIndex, float lowFraction, float highFraction)
+{
+    // The counts are already sorted by value, so this is a simple prefix sum
+    const std::vector<unsigned long long>& counts = valueCounts.counts(componentIndex);
+    unsigned long long n = 0;
+    for (size_t v = 0; v < counts.size(); v++)
+        n += counts[v];
+    _lowFraction = lowFraction;
+    _highFraction = highFraction;
+    _lowVal = std::numeric_limits<float>::quiet_NaN();
+    _highVal = std::numeric_limits<float>::quiet_NaN();
+    if (n > 0) {
+        float fractions[2] = { lowFraction, highFraction };
+        float* vals[2] = { &_lowVal, &_highVal };
+        for (int j = 0; j < 2; j++) {
+            unsigned long long rank = std::min(n - 1, (unsigned long long)std::llround(double(fractions[j]) * (n - 1)));
+            size_t v = 0;
+            while (rank >= counts[v]) {
+                rank -= counts[v];
+                v++;
+            }
+            *(vals[j]) = valueCounts.value(v);
+        }
+    }
+    _initialized = true;
+    _approximate = false;
+}
+
+struct QuantilesData {
+    float lowFraction;
+    float highFraction;
+    float lowVal;
+    float highVal;
+};
+
+bool Quantiles::load(const FrameCache& cache, const std::string& name, float lowFraction, float highFraction)
+{
+    QuantilesData data;
+    if (!cache.load(name, &data, sizeof(data)))
+        return false;
+    if (data.lowFraction != lowFraction || data.highFraction != highFraction)
+        return false;
+    _lowFraction = data.lowFraction;
+    _highFraction = data.highFraction;
+    _lowVal = data.lowVal;
+    _highVal = data.highVal;
+    _initialized = true;
+    _approximate = false;
+    return true;
+}
+
+void Quantiles::store(const FrameCache& cache, const std::string& name) const
+{
+    QuantilesData data = { _lowFraction, _highFraction, _lowVal, _highVal };
+    cache.store(name, &data, sizeof(data));
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_QUANTILES_HPP
+#define QV_QUANTILES_HPP
+
+#include <string>
+#include <functional>
+
+#include <tgd/array.hpp>
+
+#include "diskcache.hpp"
+#include "valuecounts.hpp"
+
+
+/* A lower and an upper quantile of the finite values of one component, e.g.
+ * for the fractions 0.005 and 0.995, which make a robust default range for
+ * data with outliers. The quantiles are exact: they are found by radix
+ * selection on order-preserving integer keys of the values (one pass over the
+ * data per 16 bits of the type, i.e. two passes for 32 bit integers and
+ * floats), without sorting or copying the data. */
+class Quantiles {
+private:
+    bool _initialized;
+    bool _approximate;
+    float _lowFraction, _highFraction;
+    float _lowVal, _highVal;
+
+public:
+    // Calls the given function for each array that holds a part of the data
+    typedef std::function<void (const std::function<void (const TGD::ArrayContainer&)>&)> ForEachArray;
+
+    Quantiles();
+
+    void init(const TGD::ArrayContainer& array, size_t componentIndex, float lowFraction, float highFraction);
+    // Same for data of the given type that is split into several arrays, e.g. tiles
+    void init(const ForEachArray& forEachArray, TGD::Type type, size_t componentIndex,
+            float lowFraction, float highFraction);
+    // Alternative to init() for 8 and 16 bit integer data that does not look at the data again
+    void init(const ValueCounts& valueCounts, size_t componentIndex, float lowFraction, float highFraction);
+    // alternative to init(); fails if the cached quantiles are for different fractions
+    bool load(const FrameCache& cache, const std::string& name, float lowFraction, float highFraction);
+    void store(const FrameCache& cache, const std::string& name) const;
+
+    bool initialized() const { return _initialized; }
+    void invalidate() { *this = Quantiles(); }
+    // Mark these quantiles as an estimate, e.g. from a subsample of the data
+    void setApproximate() { _approximate = true; }
+    bool approximate() const { return _approximate; }
+    // Whether these are the quantiles for the given fractions
+    bool matches(float lowFraction, float highFraction) const
+    {
+        return _initialized && _lowFraction == lowFraction && _highFraction == highFraction;
+    }
+    float lowFraction() const { return _lowFraction; }
+    float highFraction() const { return _highFraction; }
+    float lowVal() const { return _lowVal; }   // NaN if there are no finite values
+    float highVal() const { return _highVal; } // NaN if there are no finite values
+};
+
+#endif
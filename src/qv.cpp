@@ -26,6 +26,7 @@
 
 #include <limits>
 #include <cmath>
+#include <cstdio>
 
 #include <QGuiApplication>
 #include <QClipboard>
@@ -38,24 +39,61 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QIcon>
+#include <QTimer>
 
 #include "qv.hpp"
 #include "gl.hpp"
+#include "memorybudget.hpp"
 
 
+static float rangePercentile = 0.5f;
+static bool percentileRangeByDefault = false;
+
+void QV::setPercentileRange(float percentile)
+{
+    rangePercentile = percentile;
+    percentileRangeByDefault = true;
+}
+
+static float playbackTargetFps = 25.0f;
+
+void QV::setPlaybackFps(float fps)
+{
+    playbackTargetFps = fps;
+}
+
 QV::QV(Set& set, QWidget* parent) :
     QOpenGLWidget(parent),
     _set(set),
+    _quadsPending(false),
+    _rangePending(false),
+    _loadFileIndex(-1),
+    _loadFrameIndex(-1),
     _dragMode(false),
+    _roiDragMode(false),
+    _playbackFiles(false),
+    _playbackLength(0),
+    _playbackStart(0),
+    _playbackPosition(0),
+    _playbackQueued(-1),
+    _playbackDroppedFrames(0),
+    _playbackFpsFrames(0),
+    _playbackFps(0.0f),
     overlayInfoActive(false),
     overlayValueActive(false),
     overlayStatisticActive(false),
     overlayHistogramActive(false),
-    overlayColorMapActive(false)
+    overlayColorMapActive(false),
+    roiModeActive(false),
+    percentileRangeActive(percentileRangeByDefault),
+    playbackActive(false)
 {
     setMouseTracking(true);
     window()->setWindowIcon(QIcon(":res/qv-logo-512.png"));
     updateTitle();
+    prefetchNeighbors();
+    if (_set.probing())
+        QTimer::singleShot(100, this, SLOT(removeFailedFiles()));
 
     float overlayScaleFactor = window()->devicePixelRatioF();
     _overlayFallback.initialize(overlayScaleFactor);
@@ -90,6 +128,8 @@ void QV::updateView()
 void QV::updateTitle()
 {
     std::string s = _set.currentDescription();
+    if (playbackActive)
+        s += " - " + playbackStatus();
     if (s.size() == 0)
         s = "qv";
     else
@@ -273,11 +313,24 @@ void QV::prepareQuadRendering(Frame* frame, int quadTreeLevel,
     // Min/max values
     float visMinVal = _set.currentParameters()->visMinVal(frame->channelIndex());
     float visMaxVal = _set.currentParameters()->visMaxVal(frame->channelIndex());
+    _rangePending = false;
     if (!std::isfinite(visMinVal) || !std::isfinite(visMaxVal)) {
         visMinVal = frame->visMinVal(frame->channelIndex());
         visMaxVal = frame->visMaxVal(frame->channelIndex());
-        _set.currentParameters()->setVisMinVal(frame->channelIndex(), visMinVal);
-        _set.currentParameters()->setVisMaxVal(frame->channelIndex(), visMaxVal);
+        if (percentileRangeActive) {
+            // ignore outliers, but stay within the default range
+            const Quantiles& Q = frame->currentQuantilesOrEstimate(rangePercentile / 100.0f, 1.0f - rangePercentile / 100.0f);
+            if (Q.lowVal() < Q.highVal()) {
+                visMinVal = std::max(visMinVal, Q.lowVal());
+                visMaxVal = std::min(visMaxVal, Q.highVal());
+            }
+            // keep an estimated range only until the exact quantiles are known
+            _rangePending = Q.approximate();
+        }
+        if (!_rangePending) {
+            _set.currentParameters()->setVisMinVal(frame->channelIndex(), visMinVal);
+            _set.currentParameters()->setVisMaxVal(frame->channelIndex(), visMaxVal);
+        }
     }
     _viewPrg.setUniformValue("visMinVal", visMinVal);
     _viewPrg.setUniformValue("visMaxVal", visMaxVal);
@@ -288,22 +341,22 @@ void QV::prepareQuadRendering(Frame* frame, int quadTreeLevel,
     _viewPrg.setUniformValue("colorMap", _set.currentParameters()->colorMap().type() != ColorMapNone);
     _viewPrg.setUniformValue("showColor", frame->channelIndex() == ColorChannelIndex);
     _viewPrg.setUniformValue("colorSpace", int(frame->colorSpace()));
-    _viewPrg.setUniformValue("channelCount", frame->channelCount());
-    _viewPrg.setUniformValue("dataChannelIndex", frame->channelCount() <= 4 ? frame->channelIndex() : 0);
-    _viewPrg.setUniformValue("colorChannel0Index", frame->colorChannelIndex(0));
-    _viewPrg.setUniformValue("colorChannel1Index", frame->colorChannelIndex(1));
-    _viewPrg.setUniformValue("colorChannel2Index", frame->colorChannelIndex(2));
-    _viewPrg.setUniformValue("alphaChannelIndex", frame->alphaChannelIndex());
+    if (frame->channelIndex() == ColorChannelIndex) {
+        _viewPrg.setUniformValue("colorChannel0Index", frame->colorTextureComponent(0));
+        _viewPrg.setUniformValue("colorChannel1Index", frame->colorTextureComponent(1));
+        _viewPrg.setUniformValue("colorChannel2Index", frame->colorTextureComponent(2));
+        _viewPrg.setUniformValue("alphaChannelIndex", frame->alphaTextureComponent());
+    } else {
+        _viewPrg.setUniformValue("dataChannelIndex", frame->textureComponent(frame->channelIndex()));
+    }
     _viewPrg.setUniformValue("colorWas8Bit", frame->type() == TGD::uint8);
     _viewPrg.setUniformValue("colorWas16Bit", frame->type() == TGD::uint16);
     _viewPrg.setUniformValue("texIsSRGB", frame->channelCount() <= 4 && frame->type() == TGD::uint8
             && (frame->colorSpace() == ColorSpaceSGray || frame->colorSpace() == ColorSpaceSRGB));
+    _viewPrg.setUniformValue("texValueFactor", frame->textureValueFactor());
     // Textures
-    _viewPrg.setUniformValue("tex0", 0);
-    _viewPrg.setUniformValue("tex1", 1);
-    _viewPrg.setUniformValue("tex2", 2);
-    _viewPrg.setUniformValue("alphaTex", 3);
-    _viewPrg.setUniformValue("colorMapTex", 4);
+    _viewPrg.setUniformValue("tex", 0);
+    _viewPrg.setUniformValue("colorMapTex", 1);
     float quadWidthWithBorder = frame->quadWidth() + 2 * frame->quadBorderSize(quadTreeLevel);
     float quadHeightWithBorder = frame->quadHeight() + 2 * frame->quadBorderSize(quadTreeLevel);
     float texCoordFactorX = frame->quadWidth() / quadWidthWithBorder;
@@ -318,8 +371,7 @@ void QV::prepareQuadRendering(Frame* frame, int quadTreeLevel,
     ASSERT_GLCHECK();
 }
 
-void QV::renderQuad(Frame* frame, int quadTreeLevel, int qx, int qy,
-        int relevantChannelCount, int relevantChannelIndices[4],
+void QV::renderQuad(Frame* frame, int quadTreeLevel, int qx, int qy, int textureGroup,
         float quadFactorX, float quadFactorY,
         float quadOffsetX, float quadOffsetY)
 {
@@ -329,135 +381,80 @@ void QV::renderQuad(Frame* frame, int quadTreeLevel, int qx, int qy,
     _viewPrg.setUniformValue("quadFactorY", quadFactorY);
     _viewPrg.setUniformValue("quadOffsetX", quadOffsetX);
     _viewPrg.setUniformValue("quadOffsetY", quadOffsetY);
-    bool showColor = (frame->channelIndex() == ColorChannelIndex);
-    unsigned int t0, t1, t2, t3;
-    if (showColor) {
-        if (frame->channelCount() <= 4) {
-            t0 = getPreparedTexture(quadTreeLevel, qx, qy, relevantChannelIndices[0]);
-            assert(t0 != 0);
-            t1 = t0;
-            t2 = t0;
-            t3 = t0;
-        } else {
-            t0 = getPreparedTexture(quadTreeLevel, qx, qy, relevantChannelIndices[0]);
-            if (relevantChannelCount > 1)
-                t1 = getPreparedTexture(quadTreeLevel, qx, qy, relevantChannelIndices[1]);
-            else
-                t1 = t0;
-            if (relevantChannelCount > 2)
-                t2 = getPreparedTexture(quadTreeLevel, qx, qy, relevantChannelIndices[2]);
-            else
-                t2 = t0;
-            if (relevantChannelCount > 3)
-                t3 = getPreparedTexture(quadTreeLevel, qx, qy, relevantChannelIndices[3]);
-            else
-                t3 = t0;
-        }
-    } else {
-        t0 = getPreparedTexture(quadTreeLevel, qx, qy, relevantChannelIndices[0]);
-        t1 = t0;
-        t2 = t0;
-        t3 = t0;
-    }
+    unsigned int tex = getPreparedTexture(quadTreeLevel, qx, qy, textureGroup);
+    assert(tex != 0);
     if (_set.currentParameters()->colorMap().changed()) {
         _set.currentParameters()->colorMap().uploadTexture(_colorMapTex);
     }
     gl->glActiveTexture(GL_TEXTURE0);
-    gl->glBindTexture(GL_TEXTURE_2D, t0);
+    gl->glBindTexture(GL_TEXTURE_2D, tex);
     gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _set.currentParameters()->magInterpolation ? GL_LINEAR : GL_NEAREST);
     gl->glActiveTexture(GL_TEXTURE1);
-    gl->glBindTexture(GL_TEXTURE_2D, t1);
-    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _set.currentParameters()->magInterpolation ? GL_LINEAR : GL_NEAREST);
-    gl->glActiveTexture(GL_TEXTURE2);
-    gl->glBindTexture(GL_TEXTURE_2D, t2);
-    gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _set.currentParameters()->magInterpolation ? GL_LINEAR : GL_NEAREST);
-    gl->glActiveTexture(GL_TEXTURE3);
-    gl->glBindTexture(GL_TEXTURE_2D, t3);
-    gl->glActiveTexture(GL_TEXTURE4);
     gl->glBindTexture(GL_TEXTURE_2D, _colorMapTex);
     gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _set.currentParameters()->magInterpolation ? GL_LINEAR : GL_NEAREST);
     gl->glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
     ASSERT_GLCHECK();
 }
 
-void QV::getRelevantChannels(Frame* frame, int& relevantChannelCount, int relevantChannelIndices[4]) const
-{
-    bool showColor = (frame->channelIndex() == ColorChannelIndex);
-    if (showColor) {
-        if (frame->channelCount() <= 4) {
-            relevantChannelCount = 1;
-            relevantChannelIndices[0] = -1;
-        } else {
-            relevantChannelCount = 1;
-            relevantChannelIndices[0] = frame->colorChannelIndex(0);
-            if (frame->colorChannelIndex(1) != frame->colorChannelIndex(0)) {
-                relevantChannelIndices[relevantChannelCount++] = frame->colorChannelIndex(1);
-            }
-            if (frame->colorChannelIndex(2) != frame->colorChannelIndex(0)) {
-                relevantChannelIndices[relevantChannelCount++] = frame->colorChannelIndex(2);
-            }
-            if (frame->alphaChannelIndex() >= 0) {
-                relevantChannelIndices[relevantChannelCount++] = frame->alphaChannelIndex();
-            }
-        }
-    } else {
-        relevantChannelCount = 1;
-        relevantChannelIndices[0] = (frame->channelCount() <= 4 ? -1 : frame->channelIndex());
-    }
-}
-
 void QV::prepareTextures(Frame* frame,
         const std::vector<std::tuple<int, int, int>>& relevantQuads,
-        int relevantChannelCount, const int relevantChannelIndices[4],
-        bool refreshQuads)
+        int textureGroup, bool allowPreview)
 {
     ASSERT_GLCHECK();
     auto gl = getGlFunctionsFromCurrentContext();
 
-    size_t textureCount = relevantQuads.size() * relevantChannelCount;
+    size_t textureCount = relevantQuads.size();
     std::vector<unsigned int> textures(textureCount);
     std::vector<std::tuple<int, int, int, int>> textureProperties(textureCount);
+    std::vector<bool> textureIsPreview(textureCount, false);
+    std::vector<unsigned long long> textureVersions(textureCount);
 
     //fprintf(stderr, "qv.cpp preparing %zu textures\n", textureCount);
-    for (size_t i = 0; i < relevantQuads.size(); i++) {
-        for (int j = 0; j < relevantChannelCount; j++) {
-            size_t ti = i * relevantChannelCount + j;
-            unsigned int tex = 0;
-            int ql = std::get<0>(relevantQuads[i]);
-            int qx = std::get<1>(relevantQuads[i]);
-            int qy = std::get<2>(relevantQuads[i]);
-            int ci = relevantChannelIndices[j];
-            //fprintf(stderr, "qv.cpp preparing texture %zu for quads %d,%d,%d,%d\n", ti, ql, qx, qy, ci);
-            size_t k = 0;
-            if (!refreshQuads) {
-                tex = getPreparedTexture(ql, qx, qy, ci, &k);
+    for (size_t ti = 0; ti < relevantQuads.size(); ti++) {
+        unsigned int tex = 0;
+        int ql = std::get<0>(relevantQuads[ti]);
+        int qx = std::get<1>(relevantQuads[ti]);
+        int qy = std::get<2>(relevantQuads[ti]);
+        //fprintf(stderr, "qv.cpp preparing texture %zu for quads %d,%d,%d,%d\n", ti, ql, qx, qy, textureGroup);
+        size_t k = 0;
+        tex = getPreparedTexture(ql, qx, qy, textureGroup, &k);
+        textureVersions[ti] = frame->quadVersion(ql, qx, qy, textureGroup);
+        if (tex != 0) {
+            //fprintf(stderr, "  found in cache: %u!\n", tex);
+            _cachedTextures[k] = 0;
+            if (_cachedTextureIsPreview[k] || _cachedTextureVersions[k] != textureVersions[ti]) {
+                // replace the preview once the real quad is available, and
+                // replace outdated data
+                textureIsPreview[ti] = !frame->uploadQuadToTexture(tex, ql, qx, qy, textureGroup, allowPreview);
             }
-            if (tex != 0) {
-                //fprintf(stderr, "  found in cache: %u!\n", tex);
-                _cachedTextures[k] = 0;
-            } else {
-                gl->glGenTextures(1, &tex);
-                //fprintf(stderr, "  uploading to new tex: %u!\n", tex);
-                frame->uploadQuadToTexture(tex, ql, qx, qy, ci);
-            }
-            textures[ti] = tex;
-            textureProperties[ti] = std::tuple<int, int, int, int>(ql, qx, qy, ci);
+        } else {
+            gl->glGenTextures(1, &tex);
+            //fprintf(stderr, "  uploading to new tex: %u!\n", tex);
+            textureIsPreview[ti] = !frame->uploadQuadToTexture(tex, ql, qx, qy, textureGroup, allowPreview);
         }
+        textures[ti] = tex;
+        textureProperties[ti] = std::tuple<int, int, int, int>(ql, qx, qy, textureGroup);
     }
     gl->glDeleteTextures(_cachedTextures.size(), _cachedTextures.data());
     _cachedTextures = textures;
     _cachedTextureProperties = textureProperties;
+    _cachedTextureIsPreview = textureIsPreview;
+    _cachedTextureVersions = textureVersions;
+    size_t textureDataSize = 0;
+    for (size_t i = 0; i < relevantQuads.size(); i++)
+        textureDataSize += frame->quadTextureDataSize(std::get<0>(relevantQuads[i]));
+    _cachedTexturesAllocation = defaultMemoryBudget().add(MemoryVRAM, textureDataSize, false);
     ASSERT_GLCHECK();
 }
 
-unsigned int QV::getPreparedTexture(int ql, int qx, int qy, int ci, size_t* k) const
+unsigned int QV::getPreparedTexture(int ql, int qx, int qy, int tg, size_t* k) const
 {
     for (size_t i = 0; i < _cachedTextures.size(); i++) {
         int cachedQl = std::get<0>(_cachedTextureProperties[i]);
         int cachedQx = std::get<1>(_cachedTextureProperties[i]);
         int cachedQy = std::get<2>(_cachedTextureProperties[i]);
-        int cachedCi = std::get<3>(_cachedTextureProperties[i]);
-        if (ql == cachedQl && qx == cachedQx && qy == cachedQy && ci == cachedCi) {
+        int cachedTg = std::get<3>(_cachedTextureProperties[i]);
+        if (ql == cachedQl && qx == cachedQx && qy == cachedQy && tg == cachedTg) {
             if (k) {
                 *k = i;
             }
@@ -467,11 +464,14 @@ unsigned int QV::getPreparedTexture(int ql, int qx, int qy, int ci, size_t* k) c
     return 0;
 }
 
-void QV::renderFrame(Frame* frame, int quadTreeLevel,
+void QV::getRelevantQuads(Frame* frame, int quadTreeLevel,
         float xFactor, float yFactor,
-        float xOffset, float yOffset)
+        float xOffset, float yOffset,
+        std::vector<std::tuple<int, int, int>>& relevantQuads,
+        std::vector<std::tuple<float, float, float, float>>& relevantQuadParameters) const
 {
-    prepareQuadRendering(frame, quadTreeLevel, xFactor, yFactor, xOffset, yOffset);
+    relevantQuads.clear();
+    relevantQuadParameters.clear();
     // Loop over the quads on the requested level to find relevant quads
     int maxQuadTreeLevelSize = 1;
     for (int l = frame->quadTreeLevels() - 1; l > quadTreeLevel; l--)
@@ -485,8 +485,6 @@ void QV::renderFrame(Frame* frame, int quadTreeLevel,
     float quadCompensationFactorX = 1.0f / (float(frame->width()) / coveredWidth);
     float quadCompensationFactorY = 1.0f / (float(frame->height()) / coveredHeight);
     const QRectF frustum2D(-1.0f, -1.0f, 2.0f, 2.0f);
-    std::vector<std::tuple<int, int, int>> relevantQuads;
-    std::vector<std::tuple<float, float, float, float>> relevantQuadParameters;
     for (int qy = 0; qy < frame->quadTreeLevelHeight(quadTreeLevel); qy++) {
         for (int qx = 0; qx < frame->quadTreeLevelWidth(quadTreeLevel); qx++) {
             float quadFactorX = quadCompensationFactorX / maxQuadTreeLevelSize;
@@ -505,6 +503,34 @@ void QV::renderFrame(Frame* frame, int quadTreeLevel,
             relevantQuadParameters.push_back(std::tuple<float, float, float, float>(quadFactorX, quadFactorY, quadOffsetX, quadOffsetY));
         }
     }
+}
+
+static bool quadsAreReady(Frame* frame, const std::vector<std::tuple<int, int, int>>& quads)
+{
+    for (size_t i = 0; i < quads.size(); i++) {
+        if (!frame->quadIsReady(std::get<0>(quads[i]), std::get<1>(quads[i]), std::get<2>(quads[i])))
+            return false;
+    }
+    return true;
+}
+
+void QV::renderFrame(Frame* frame, int quadTreeLevel,
+        float xFactor, float yFactor,
+        float xOffset, float yOffset)
+{
+    std::vector<std::tuple<int, int, int>> relevantQuads;
+    std::vector<std::tuple<float, float, float, float>> relevantQuadParameters;
+    getRelevantQuads(frame, quadTreeLevel, xFactor, yFactor, xOffset, yOffset,
+            relevantQuads, relevantQuadParameters);
+    int textureGroup = frame->textureGroup(frame->channelIndex());
+    // Use a coarser level if the textures would not fit into the VRAM budget
+    size_t vramBudget = defaultMemoryBudget().budget(MemoryVRAM);
+    while (vramBudget > 0 && quadTreeLevel < frame->quadTreeLevels() - 1
+            && relevantQuads.size() * frame->quadTextureDataSize(quadTreeLevel) > vramBudget) {
+        quadTreeLevel++;
+        getRelevantQuads(frame, quadTreeLevel, xFactor, yFactor, xOffset, yOffset,
+                relevantQuads, relevantQuadParameters);
+    }
     // Give the frame an opportunity to prepare the quads
     //fprintf(stderr, "qv.cpp wants %zu quads\n", relevantQuads.size());
     bool cacheRemainsValid = frame->prepareQuadsForRendering(relevantQuads, _set.currentParameters()->watchMode);
@@ -512,15 +538,26 @@ void QV::renderFrame(Frame* frame, int quadTreeLevel,
         glDeleteTextures(_cachedTextures.size(), _cachedTextures.data());
         _cachedTextures.clear();
         _cachedTextureProperties.clear();
+        _cachedTextureIsPreview.clear();
+        _cachedTextureVersions.clear();
+        _cachedTexturesAllocation.reset();
     }
+    // While the quads are computed in the background, render the finest coarser
+    // level that is ready instead, or a preview of the top level quad.
+    int renderQuadTreeLevel = quadTreeLevel;
+    bool quadsReady = quadsAreReady(frame, relevantQuads);
+    while (!quadsReady && renderQuadTreeLevel < frame->quadTreeLevels() - 1) {
+        renderQuadTreeLevel++;
+        getRelevantQuads(frame, renderQuadTreeLevel, xFactor, yFactor, xOffset, yOffset,
+                relevantQuads, relevantQuadParameters);
+        quadsReady = quadsAreReady(frame, relevantQuads);
+    }
+    _quadsPending = (renderQuadTreeLevel != quadTreeLevel || !quadsReady);
+    //if (_quadsPending)
+    //    fprintf(stderr, "qv.cpp renders level %d instead of %d\n", renderQuadTreeLevel, quadTreeLevel);
+    prepareQuadRendering(frame, renderQuadTreeLevel, xFactor, yFactor, xOffset, yOffset);
     // Get the relevant quad parts into textures
-    int relevantChannelCount = 0;
-    int relevantChannelIndices[4] = { -1, -1, -1, -1 };
-    getRelevantChannels(frame, relevantChannelCount, relevantChannelIndices);
-    //fprintf(stderr, "qv.cpp wants %d channels: %d %d %d %d\n", relevantChannelCount,
-    //        relevantChannelIndices[0], relevantChannelIndices[1], relevantChannelIndices[2], relevantChannelIndices[3]);
-    prepareTextures(frame, relevantQuads, relevantChannelCount, relevantChannelIndices,
-            _set.currentParameters()->watchMode);
+    prepareTextures(frame, relevantQuads, textureGroup, !quadsReady);
     // Render the quads
     for (size_t i = 0; i < relevantQuads.size(); i++) {
         //fprintf(stderr, "qv.cpp renders quad %zu: %d,%d,%d [%g %g %g %g]\n", i,
@@ -535,7 +572,7 @@ void QV::renderFrame(Frame* frame, int quadTreeLevel,
                 std::get<0>(relevantQuads[i]),
                 std::get<1>(relevantQuads[i]),
                 std::get<2>(relevantQuads[i]),
-                relevantChannelCount, relevantChannelIndices,
+                textureGroup,
                 std::get<0>(relevantQuadParameters[i]),
                 std::get<1>(relevantQuadParameters[i]),
                 std::get<2>(relevantQuadParameters[i]),
@@ -567,12 +604,12 @@ QImage QV::renderFrameToImage(Frame* frame)
         gl->glPixelStorei(GL_PACK_ALIGNMENT, 2);
     else
         gl->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if (percentileRangeActive) {
+        // the exported image must not use an estimated range
+        frame->currentQuantiles(rangePercentile / 100.0f, 1.0f - rangePercentile / 100.0f);
+    }
     prepareQuadRendering(frame, 0, 1.0f, 1.0f, 0.0f, 0.0f);
-    int relevantChannelCount = 0;
-    int relevantChannelIndices[4] = { -1, -1, -1, -1 };
-    getRelevantChannels(frame, relevantChannelCount, relevantChannelIndices);
-    //fprintf(stderr, "renderFrameToImage: %d relevant channels: %d %d %d %d\n", relevantChannelCount,
-    //        relevantChannelIndices[0], relevantChannelIndices[1], relevantChannelIndices[2], relevantChannelIndices[3]);
+    int textureGroup = frame->textureGroup(frame->channelIndex());
     //fprintf(stderr, "renderFrameToImage: %dx%d = %d relevant quads\n",
     //        frame->quadTreeLevelHeight(0), frame->quadTreeLevelWidth(0),
     //        frame->quadTreeLevelHeight(0) * frame->quadTreeLevelWidth(0));
@@ -581,10 +618,8 @@ QImage QV::renderFrameToImage(Frame* frame)
     for (int tileY = 0; tileY < frame->quadTreeLevelHeight(0); tileY++) {
         for (int tileX = 0; tileX < frame->quadTreeLevelWidth(0); tileX++) {
             relevantQuad[0] = std::tuple<int, int, int>(0, tileX, tileY);
-            prepareTextures(frame, relevantQuad, relevantChannelCount, relevantChannelIndices, false);
-            renderQuad(frame, 0, tileX, tileY,
-                    relevantChannelCount, relevantChannelIndices,
-                    1.0f, 1.0f, 0.0f, 0.0f);
+            prepareTextures(frame, relevantQuad, textureGroup, false);
+            renderQuad(frame, 0, tileX, tileY, textureGroup, 1.0f, 1.0f, 0.0f, 0.0f);
             gl->glReadPixels(0, 0, frame->quadWidth(), frame->quadHeight(), GL_RGB, GL_UNSIGNED_BYTE, tmpArray.data());
             int copyableLines = frame->quadHeight();
             if (tileY * frame->quadHeight() + copyableLines > frame->height())
@@ -628,7 +663,14 @@ void QV::paintGL()
     // Draw the frame
     File* file = _set.currentFile();
     Frame* frame = (file ? file->currentFrame() : nullptr);
+    if (frame && mappedFileChanged(frame->array())) {
+        // another program changed the file, so the mapped data must not be
+        // accessed anymore: read it again instead
+        frame = nullptr;
+        QTimer::singleShot(0, this, SLOT(reloadFile()));
+    }
     QPoint dataCoords(-1, -1);
+    QRect roi; // null if not in region of interest mode
     if (frame) {
         float xFactor, yFactor, xOffset, yOffset;
         navigationParameters(frame, w, h, xFactor, yFactor, xOffset, yOffset);
@@ -658,6 +700,25 @@ void QV::paintGL()
                 || dataCoords.y() < 0 || dataCoords.y() >= frame->height()) {
             dataCoords = QPoint(-1, -1);
         }
+        if (roiModeActive) {
+            // the region of interest is the dragged rectangle, or the visible area
+            if (_roiDragMode) {
+                QPoint roiA = dataCoordinates(_roiDragStart, w, h,
+                        frame->width(), frame->height(),
+                        xFactor, yFactor, xOffset, yOffset);
+                QPoint roiO = dataCoordinates(_mousePos, w, h,
+                        frame->width(), frame->height(),
+                        xFactor, yFactor, xOffset, yOffset);
+                _roi = QRect(QPoint(std::min(roiA.x(), roiO.x()), std::min(roiA.y(), roiO.y())),
+                        QPoint(std::max(roiA.x(), roiO.x()), std::max(roiA.y(), roiO.y())));
+            }
+            roi = _roi;
+            if (roi.isNull()) {
+                roi = QRect(QPoint(std::min(dataA.x(), dataO.x()), std::min(dataA.y(), dataO.y())),
+                        QPoint(std::max(dataA.x(), dataO.x()), std::max(dataA.y(), dataO.y())));
+            }
+            roi = roi.intersected(QRect(0, 0, frame->width(), frame->height()));
+        }
     }
 
     // Draw the overlays
@@ -684,7 +745,7 @@ void QV::paintGL()
             overlayYOffset += _overlayColorMap.heightInPixels();
         }
         if (overlayHistogramActive) {
-            _overlayHistogram.update(_overlayHistogramTex, w, dataCoords, _set);
+            _overlayHistogram.update(_overlayHistogramTex, w, dataCoords, _set, roi);
             gl->glViewport(0, overlayYOffset, w, _overlayHistogram.heightInPixels());
             gl->glUseProgram(_overlayPrg.programId());
             gl->glActiveTexture(GL_TEXTURE0);
@@ -693,7 +754,7 @@ void QV::paintGL()
             overlayYOffset += _overlayHistogram.heightInPixels();
         }
         if (overlayStatisticActive) {
-            _overlayStatistic.update(_overlayStatisticTex, w, _set);
+            _overlayStatistic.update(_overlayStatisticTex, w, _set, roi);
             gl->glViewport(0, overlayYOffset, w, _overlayStatistic.heightInPixels());
             gl->glUseProgram(_overlayPrg.programId());
             gl->glActiveTexture(GL_TEXTURE0);
@@ -711,7 +772,7 @@ void QV::paintGL()
             overlayYOffset += _overlayValue.heightInPixels();
         }
         if (overlayInfoActive) {
-            _overlayInfo.update(_overlayInfoTex, w, _set);
+            _overlayInfo.update(_overlayInfoTex, w, _set, playbackActive ? playbackStatus() : std::string());
             gl->glViewport(0, overlayYOffset, w, _overlayInfo.heightInPixels());
             gl->glUseProgram(_overlayPrg.programId());
             gl->glActiveTexture(GL_TEXTURE0);
@@ -726,6 +787,10 @@ void QV::paintGL()
 
     if (frame && _set.currentParameters()->watchMode) {
         update();
+    } else if (frame && (_quadsPending || _rangePending
+                || ((overlayStatisticActive || overlayHistogramActive) && frame->analysisPending()))) {
+        // check again when the background computations made some progress
+        QTimer::singleShot(50, this, SLOT(update()));
     }
 }
 
@@ -736,8 +801,10 @@ bool QV::haveCurrentFile() const
 
 void QV::openFile()
 {
+    stopPlayback();
     int previousFileCount = _set.fileCount();
     std::string errMsg;
+    cancelBackgroundLoad();
     QStringList names = QFileDialog::getOpenFileNames(this);
     QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
     for (int i = 0; i < names.size(); i++) {
@@ -751,6 +818,7 @@ void QV::openFile()
         _set.removeFile(previousFileCount);
     }
     QGuiApplication::restoreOverrideCursor();
+    prefetchNeighbors();
     this->updateTitle();
     this->updateView();
 }
@@ -758,9 +826,12 @@ void QV::openFile()
 void QV::closeFile()
 {
     if (haveCurrentFile()) {
+        stopPlayback();
+        cancelBackgroundLoad();
         QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
         _set.removeFile(_set.fileIndex());
         QGuiApplication::restoreOverrideCursor();
+        prefetchNeighbors();
         this->updateTitle();
         this->updateView();
     }
@@ -769,44 +840,160 @@ void QV::closeFile()
 void QV::reloadFile()
 {
     if (haveCurrentFile()) {
+        stopPlayback();
         std::string errMsg;
+        cancelBackgroundLoad();
+        _loader.reset();
         QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
         if (!_set.currentFile()->reload(errMsg)) {
             QMessageBox::critical(this, "Error", errMsg.c_str());
         }
         QGuiApplication::restoreOverrideCursor();
+        prefetchNeighbors();
         this->updateTitle();
         this->updateView();
     }
 }
 
+std::vector<Loader::Item> QV::prefetchItems(int fileIndex, int frameIndex)
+{
+    // closest first, alternating between the next and previous ones
+    std::vector<Loader::Item> items;
+    std::string errMsg;
+    File* file = _set.file(fileIndex);
+    int fc = file->frameCount(errMsg);
+    for (int d = 1; d <= Loader::prefetchDistance(); d++) {
+        for (int i : { frameIndex + d, frameIndex - d }) {
+            if (fc > 0 && i >= 0 && i < fc && !file->isRecentFrame(i))
+                items.push_back(Loader::Item(file->fileName(), file->importerHints(), i));
+        }
+        for (int i : { fileIndex + d, fileIndex - d }) {
+            if (i >= 0 && i < _set.fileCount()) {
+                // only files that support random access, see adjustFileIndex()
+                File* neighbor = _set.file(i);
+                int nfc = neighbor->frameCount(errMsg);
+                if (nfc > 0 && !neighbor->isRecentFrame(std::min(frameIndex, nfc - 1)))
+                    items.push_back(Loader::Item(neighbor->fileName(), neighbor->importerHints(),
+                                std::min(frameIndex, nfc - 1)));
+            }
+        }
+    }
+    return items;
+}
+
+void QV::prefetchNeighbors()
+{
+    if (haveCurrentFile() && _loadFileIndex < 0)
+        _loader.prefetch(prefetchItems(_set.fileIndex(), _set.currentFile()->frameIndex()));
+}
+
+void QV::loadInBackground(int fileIndex, int frameIndex)
+{
+    File* file = _set.file(fileIndex);
+    _loadFileIndex = fileIndex;
+    _loadFrameIndex = frameIndex;
+    _loader.request(Loader::Item(file->fileName(), file->importerHints(), frameIndex),
+            prefetchItems(fileIndex, frameIndex));
+    QTimer::singleShot(10, this, SLOT(collectLoadedFrame()));
+}
+
+void QV::cancelBackgroundLoad()
+{
+    _loader.cancel();
+    _loadFileIndex = -1;
+    _loadFrameIndex = -1;
+}
+
+void QV::collectLoadedFrame()
+{
+    if (!_loader.pending())
+        return;
+    TGD::ArrayContainer array;
+    std::shared_ptr<Frame> prefetchedFrame;
+    std::string errMsg;
+    if (!_loader.result(array, prefetchedFrame, errMsg)) {
+        QTimer::singleShot(10, this, SLOT(collectLoadedFrame()));
+        return;
+    }
+    int fileIndex = _loadFileIndex;
+    int frameIndex = _loadFrameIndex;
+    _loadFileIndex = -1;
+    _loadFrameIndex = -1;
+    if (errMsg.size() > 0
+            || !_set.setFileIndex(fileIndex, frameIndex, array, prefetchedFrame.get(), errMsg)) {
+        QMessageBox::critical(this, "Error", (errMsg
+                    + ".\n\nClosing this file.").c_str());
+        _set.removeFile(fileIndex);
+        prefetchNeighbors();
+    }
+    this->updateTitle();
+    this->updateView();
+}
+
+void QV::removeFailedFiles()
+{
+    // Files that were added unchecked are removed once they turn out to be
+    // unusable, just like files that fail when they are added. File indices
+    // change, so wait while they are in use.
+    bool probing = _set.probing();
+    if (_loadFileIndex < 0 && !playbackActive) {
+        std::vector<std::string> errMsgs = _set.removeFailedFiles();
+        for (size_t i = 0; i < errMsgs.size(); i++)
+            fprintf(stderr, "ignoring %s\n", errMsgs[i].c_str());
+        if (errMsgs.size() > 0) {
+            prefetchNeighbors();
+            this->updateTitle();
+            this->updateView();
+        }
+    } else {
+        probing = true;
+    }
+    if (probing)
+        QTimer::singleShot(100, this, SLOT(removeFailedFiles()));
+}
+
 void QV::adjustFileIndex(int offset)
 {
+    stopPlayback();
     if (!haveCurrentFile())
         return;
 
-    int i = _set.fileIndex();
+    // navigate relative to the file that is being loaded, if any
+    int i = (_loadFileIndex >= 0 ? _loadFileIndex : _set.fileIndex());
     int ni = i + offset;
     if (ni < 0)
         ni = 0;
     else if (ni >= _set.fileCount())
         ni = _set.fileCount() - 1;
-    if (ni != i) {
+    if (ni == _set.fileIndex()) {
+        // back to the current file
+        cancelBackgroundLoad();
+    } else if (ni != i) {
         std::string errMsg;
-        QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-        if (!_set.setFileIndex(ni, errMsg)) {
-            QMessageBox::critical(this, "Error", (errMsg
-                        + ".\n\nClosing this file.").c_str());
-            _set.removeFile(ni);
+        int frameIndex = _set.initialFrameIndex(ni, errMsg);
+        if (frameIndex >= 0 && _set.file(ni)->frameCount(errMsg) > 0
+                && !_set.file(ni)->isRecentFrame(frameIndex)) {
+            // the current frame remains visible until the new one is read
+            loadInBackground(ni, frameIndex);
+        } else {
+            cancelBackgroundLoad();
+            QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+            if (!_set.setFileIndex(ni, errMsg)) {
+                QMessageBox::critical(this, "Error", (errMsg
+                            + ".\n\nClosing this file.").c_str());
+                _set.removeFile(ni);
+            }
+            QGuiApplication::restoreOverrideCursor();
+            this->updateTitle();
+            this->updateView();
         }
-        QGuiApplication::restoreOverrideCursor();
-        this->updateTitle();
-        this->updateView();
     }
+    prefetchNeighbors();
 }
 
 void QV::adjustFrameIndex(int offset)
 {
+    stopPlayback();
     if (!haveCurrentFile())
         return;
 
@@ -814,20 +1001,35 @@ void QV::adjustFrameIndex(int offset)
     std::string errMsg;
     int fc = file->frameCount(errMsg);
     if (fc == 0) {
+        cancelBackgroundLoad();
         QMessageBox::critical(this, "Error", (errMsg
                     + ".\n\nClosing this file.").c_str());
         _set.removeFile(_set.fileIndex());
         return;
     }
     int i = file->frameIndex();
+    if (_loadFileIndex >= 0 && _loadFileIndex != _set.fileIndex()) {
+        // frame navigation within the current file supersedes loading another file
+        cancelBackgroundLoad();
+    } else if (_loadFileIndex >= 0) {
+        // navigate relative to the frame that is being loaded
+        i = _loadFrameIndex;
+    }
     int ni = i + offset;
     if (ni < 0)
         ni = 0;
     else if (fc > 0 && ni >= fc)
         ni = fc - 1;
-    if (ni != i) {
-        if (fc > 0 || ni < i || ni <= file->maxFrameIndexSoFar()) {
+    if (ni == file->frameIndex()) {
+        // back to the current frame
+        cancelBackgroundLoad();
+    } else if (ni != i) {
+        if (fc > 0 && !file->isRecentFrame(ni)) {
+            // the current frame remains visible until the new one is read
+            loadInBackground(_set.fileIndex(), ni);
+        } else if (fc > 0 || ni < i || ni <= file->maxFrameIndexSoFar()) {
             // we know the frame exists so we can jump right to it
+            cancelBackgroundLoad();
             if (file->setFrameIndex(ni, errMsg)) {
                 this->updateTitle();
                 this->updateView();
@@ -864,6 +1066,7 @@ void QV::adjustFrameIndex(int offset)
             this->updateView();
         }
     }
+    prefetchNeighbors();
 }
 
 void QV::setChannelIndex(int index)
@@ -908,18 +1111,23 @@ void QV::adjustVisInterval(int minSteps, int maxSteps)
     float adjustment = (defaultVisMax - defaultVisMin) / 100.0f;
     float oldMinVal = _set.currentParameters()->visMinVal(frame->channelIndex());
     float oldMaxVal = _set.currentParameters()->visMaxVal(frame->channelIndex());
+    if (!std::isfinite(oldMinVal) || !std::isfinite(oldMaxVal)) {
+        // the visible range is not known exactly yet
+        oldMinVal = defaultVisMin;
+        oldMaxVal = defaultVisMax;
+    }
     float newMinVal = oldMinVal + minSteps * adjustment;
     float newMaxVal = oldMaxVal + maxSteps * adjustment;
     if (newMinVal < defaultVisMin)
         newMinVal = defaultVisMin;
-    else if (_set.currentParameters()->visMaxVal(frame->channelIndex()) - newMinVal < adjustment)
-        newMinVal = _set.currentParameters()->visMaxVal(frame->channelIndex()) - adjustment;
+    else if (oldMaxVal - newMinVal < adjustment)
+        newMinVal = oldMaxVal - adjustment;
     else if (newMinVal > defaultVisMax - adjustment)
         newMinVal = defaultVisMax - adjustment;
     if (newMaxVal < defaultVisMin + adjustment)
         newMaxVal = defaultVisMin + adjustment;
-    else if (newMaxVal - _set.currentParameters()->visMinVal(frame->channelIndex()) < adjustment)
-        newMaxVal = _set.currentParameters()->visMinVal(frame->channelIndex()) + adjustment;
+    else if (newMaxVal - oldMinVal < adjustment)
+        newMaxVal = oldMinVal + adjustment;
     else if (newMaxVal > defaultVisMax)
         newMaxVal = defaultVisMax;
     _set.currentParameters()->setVisMinVal(frame->channelIndex(), newMinVal);
@@ -1027,6 +1235,18 @@ void QV::toggleDRR()
     this->updateView();
 }
 
+void QV::togglePercentileRange()
+{
+    if (!haveCurrentFile())
+        return;
+
+    QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+    percentileRangeActive = !percentileRangeActive;
+    // let the next rendering determine the visible ranges of all channels again
+    _set.currentParameters()->resetVisIntervals();
+    this->updateView();
+}
+
 void QV::adjustDRRBrightness(int direction)
 {
     if (!haveCurrentFile())
@@ -1042,15 +1262,6 @@ void QV::adjustDRRBrightness(int direction)
     this->updateView();
 }
 
-static bool frameIsPrettyBig(const Frame* frame)
-{
-    // This is of course just a heuristic since we cannot know how fast the machine
-    // really is. I checked with my not entirely new laptop.
-    return frame->quadTreeLevels() > 1
-        || (size_t(frame->width()) * size_t(frame->height()) >
-                size_t(Frame::requiredMaxTextureSize) * size_t(Frame::requiredMaxTextureSize) / 4);
-}
-
 void QV::toggleOverlayInfo()
 {
     if (!haveCurrentFile())
@@ -1065,12 +1276,9 @@ void QV::toggleOverlayStatistics()
     if (!haveCurrentFile())
         return;
 
+    // Big frames show estimates until the exact values are computed in the
+    // background, so there is no need for a wait cursor
     overlayStatisticActive = !overlayStatisticActive;
-    Frame* frame = _set.currentFile()->currentFrame();
-    if (overlayStatisticActive && frameIsPrettyBig(frame)
-            && !frame->haveStatistic(frame->channelIndex())) {
-        QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    }
     this->updateView();
 }
 
@@ -1079,13 +1287,9 @@ void QV::toggleOverlayValue()
     if (!haveCurrentFile())
         return;
 
+    // Values are cheap to query: the lightness is computed only for the tiles
+    // that are needed, so there is no need for a wait cursor
     overlayValueActive = !overlayValueActive;
-    Frame* frame = _set.currentFile()->currentFrame();
-    if (overlayValueActive && frameIsPrettyBig(frame)
-            && frame->colorSpace() != ColorSpaceNone
-            && !frame->haveLightness()) {
-        QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    }
     this->updateView();
 }
 
@@ -1094,12 +1298,8 @@ void QV::toggleOverlayHistogram()
     if (!haveCurrentFile())
         return;
 
+    // Same as for the statistics overlay
     overlayHistogramActive = !overlayHistogramActive;
-    Frame* frame = _set.currentFile()->currentFrame();
-    if (overlayHistogramActive && frameIsPrettyBig(frame)
-            && !frame->haveHistogram(frame->channelIndex())) {
-        QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-    }
     this->updateView();
 }
 
@@ -1112,6 +1312,17 @@ void QV::toggleOverlayColormap()
     this->updateView();
 }
 
+void QV::toggleROIMode()
+{
+    if (!haveCurrentFile())
+        return;
+
+    roiModeActive = !roiModeActive;
+    _roiDragMode = false;
+    _roi = QRect();
+    this->updateView();
+}
+
 void QV::toggleApplyCurrentParametersToAllFiles()
 {
     if (!haveCurrentFile())
@@ -1130,11 +1341,158 @@ void QV::toggleWatchMode()
         update();
 }
 
+Loader::Item QV::playbackItem(int position)
+{
+    File* file = _set.currentFile();
+    std::string errMsg;
+    if (!_playbackFiles)
+        return Loader::Item(file->fileName(), file->importerHints(), position);
+    // files that do not support random access are skipped, see adjustFileIndex()
+    int frameIndex = _set.initialFrameIndex(position, errMsg);
+    if (frameIndex < 0 || _set.file(position)->frameCount(errMsg) <= 0)
+        frameIndex = -1;
+    return Loader::Item(_set.file(position)->fileName(), _set.file(position)->importerHints(), frameIndex);
+}
+
+std::string QV::playbackStatus() const
+{
+    char s[64];
+    std::snprintf(s, sizeof(s), "playing: %.1f fps, %llu dropped", _playbackFps, _playbackDroppedFrames);
+    return s;
+}
+
+void QV::togglePlayback()
+{
+    if (!haveCurrentFile())
+        return;
+
+    if (playbackActive) {
+        stopPlayback();
+        return;
+    }
+    // play the frames of the current file, or else the files of the set
+    std::string errMsg;
+    int fc = _set.currentFile()->frameCount(errMsg);
+    if (fc > 1) {
+        _playbackFiles = false;
+        _playbackLength = fc;
+        _playbackPosition = _set.currentFile()->frameIndex();
+    } else if (_set.fileCount() > 1) {
+        _playbackFiles = true;
+        _playbackLength = _set.fileCount();
+        _playbackPosition = _set.fileIndex();
+    } else {
+        return;
+    }
+    cancelBackgroundLoad();
+    playbackActive = true;
+    _playbackStart = _playbackPosition;
+    _playbackQueued = -1;
+    _playbackClockStart = std::chrono::steady_clock::now();
+    _playbackDroppedFrames = 0;
+    _playbackFpsStart = _playbackClockStart;
+    _playbackFpsFrames = 0;
+    _playbackFps = 0.0f;
+    playbackStep();
+    this->updateTitle();
+    this->updateView();
+}
+
+void QV::stopPlayback()
+{
+    if (playbackActive) {
+        playbackActive = false;
+        prefetchNeighbors();
+        this->updateTitle();
+        this->updateView();
+    }
+}
+
+void QV::playbackStep()
+{
+    if (!playbackActive)
+        return;
+    if (!haveCurrentFile() || (_playbackFiles && _playbackLength != _set.fileCount())) {
+        stopPlayback();
+        return;
+    }
+
+    // The playback clock determines the position that is due now
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - _playbackClockStart).count();
+    long long elapsedFrames = elapsed * playbackTargetFps;
+    int due = (_playbackStart + elapsedFrames) % _playbackLength;
+
+    // Show the due frame if it is ready. If decoding cannot keep up, frames
+    // that were not ready in time are dropped: we never wait for a frame
+    // once the next one is due.
+    if (due != _playbackPosition) {
+        Loader::Item item = playbackItem(due);
+        File* file = (_playbackFiles ? _set.file(due) : _set.currentFile());
+        std::string errMsg;
+        bool ok = true;
+        bool shown = false;
+        if (item.arrayIndex >= 0 && file->isRecentFrame(item.arrayIndex)) {
+            ok = (_playbackFiles ? _set.setFileIndex(due, errMsg) : file->setFrameIndex(due, errMsg));
+            shown = ok;
+        } else if (item.arrayIndex >= 0) {
+            std::shared_ptr<Frame> frame = _loader.takePrefetched(item);
+            if (frame) {
+                ok = _set.setFileIndex(_playbackFiles ? due : _set.fileIndex(), item.arrayIndex,
+                        TGD::ArrayContainer(), frame.get(), errMsg);
+                shown = ok;
+            }
+        }
+        if (!ok) {
+            stopPlayback();
+            QMessageBox::critical(this, "Error", errMsg.c_str());
+            return;
+        }
+        if (shown) {
+            _playbackDroppedFrames += (due - _playbackPosition - 1 + _playbackLength) % _playbackLength;
+            _playbackPosition = due;
+            _playbackFpsFrames++;
+            this->updateTitle();
+            this->updateView();
+        }
+    }
+    double fpsElapsed = std::chrono::duration<double>(now - _playbackFpsStart).count();
+    if (fpsElapsed >= 1.0) {
+        _playbackFps = _playbackFpsFrames / fpsElapsed;
+        _playbackFpsStart = now;
+        _playbackFpsFrames = 0;
+        this->updateTitle();
+    }
+
+    // Keep the bounded queue of frames that are decoded and processed ahead
+    // filled; frames that were not ready in time are dropped from it
+    if (due != _playbackQueued) {
+        const int queueLength = std::max(4, Loader::prefetchDistance());
+        std::vector<Loader::Item> items;
+        for (int i = 0; i < queueLength && i < _playbackLength; i++) {
+            int position = (due + i) % _playbackLength;
+            if (position == _playbackPosition)
+                continue;
+            Loader::Item item = playbackItem(position);
+            File* file = (_playbackFiles ? _set.file(position) : _set.currentFile());
+            if (item.arrayIndex >= 0 && !file->isRecentFrame(item.arrayIndex))
+                items.push_back(item);
+        }
+        _loader.prefetch(items, false);
+        _playbackQueued = due;
+    }
+
+    // Check again when the next frame is due, or soon if the due frame is late
+    double nextDue = (elapsedFrames + 1) / playbackTargetFps - elapsed;
+    int msecs = (due != _playbackPosition ? 2 : std::max(1, int(nextDue * 1000.0)));
+    QTimer::singleShot(msecs, this, SLOT(playbackStep()));
+}
+
 void QV::mouseMoveEvent(QMouseEvent* e)
 {
     if (haveCurrentFile()) {
         _mousePos = e->pos();
-        if (overlayValueActive || overlayHistogramActive)
+        if (overlayValueActive || overlayHistogramActive || _roiDragMode)
             this->updateView();
         if (_dragMode) {
             QPoint dragEnd = e->pos();
@@ -1149,8 +1507,15 @@ void QV::mouseMoveEvent(QMouseEvent* e)
 void QV::mousePressEvent(QMouseEvent* e)
 {
     if (haveCurrentFile() && e->button() == Qt::LeftButton) {
-        _dragMode = true;
-        _dragStart = e->pos();
+        if (roiModeActive) {
+            // dragging selects the region of interest instead of moving the view
+            _roiDragMode = true;
+            _roiDragStart = e->pos();
+            _mousePos = e->pos();
+        } else {
+            _dragMode = true;
+            _dragStart = e->pos();
+        }
     }
 }
 
@@ -1158,6 +1523,13 @@ void QV::mouseReleaseEvent(QMouseEvent* e)
 {
     if (haveCurrentFile() && e->button() == Qt::LeftButton) {
         _dragMode = false;
+        if (_roiDragMode) {
+            _roiDragMode = false;
+            // a click without dragging selects the visible area again
+            if ((e->pos() - _roiDragStart).manhattanLength() == 0)
+                _roi = QRect();
+            this->updateView();
+        }
     }
 }
 
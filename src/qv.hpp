@@ -29,11 +29,14 @@
 
 #include <vector>
 #include <tuple>
+#include <chrono>
 
 #include <QOpenGLWidget>
 #include <QOpenGLShaderProgram>
 
 #include "set.hpp"
+#include "loader.hpp"
+#include "memorybudget.hpp"
 #include "overlay-fallback.hpp"
 #include "overlay-info.hpp"
 #include "overlay-value.hpp"
@@ -52,6 +55,14 @@ private:
     int _w, _h;
     std::vector<unsigned int> _cachedTextures;
     std::vector<std::tuple<int, int, int, int>> _cachedTextureProperties;
+    std::vector<bool> _cachedTextureIsPreview;
+    std::vector<unsigned long long> _cachedTextureVersions;
+    std::shared_ptr<MemoryAllocation> _cachedTexturesAllocation;
+    bool _quadsPending;
+    bool _rangePending; // the visible range is based on estimated quantiles
+    Loader _loader;
+    int _loadFileIndex;  // file and frame requested from the loader, or -1
+    int _loadFrameIndex;
     unsigned int _colorMapTex;
     unsigned int _overlayColorMapTex;
     unsigned int _overlayFallbackTex;
@@ -66,6 +77,9 @@ private:
     QOpenGLShaderProgram _overlayPrg;
     bool _dragMode;
     QPoint _dragStart;
+    bool _roiDragMode;
+    QPoint _roiDragStart;
+    QRect _roi; // in data coordinates; null means the visible area
     QPoint _mousePos;
     OverlayFallback _overlayFallback;
     OverlayInfo _overlayInfo;
@@ -73,6 +87,17 @@ private:
     OverlayStatistic _overlayStatistic;
     OverlayHistogram _overlayHistogram;
     OverlayColorMap _overlayColorMap;
+    /* playback of the frames of the current file or of the files of the set: */
+    bool _playbackFiles;
+    int _playbackLength;
+    int _playbackStart;    // position at the start of the playback clock
+    int _playbackPosition; // position that is currently shown
+    int _playbackQueued;   // position from which on frames are prefetched
+    std::chrono::steady_clock::time_point _playbackClockStart;
+    unsigned long long _playbackDroppedFrames;
+    std::chrono::steady_clock::time_point _playbackFpsStart;
+    int _playbackFpsFrames;
+    float _playbackFps; // achieved, measured about once per second
 
     void updateView();
     void updateTitle();
@@ -88,31 +113,54 @@ private:
     void prepareQuadRendering(Frame* frame, int quadTreeLevel,
             float xFactor, float yFactor,
             float xOffset, float yOffset);
-    void getRelevantChannels(Frame* frame, int& relevantChannelCount, int relevantChannelIndices[4]) const;
     void prepareTextures(Frame* frame,
             const std::vector<std::tuple<int, int, int>>& relevantQuads,
-            int relevantChannelCount, const int relevantChannelIndices[4],
-            bool refreshQuads);
-    unsigned int getPreparedTexture(int ql, int qx, int qy, int ci, size_t* k = nullptr) const;
-    void renderQuad(Frame* frame, int quadTreeLevel, int qx, int qy,
-            int relevantChannelCount, int relevantChannelIndices[4],
+            int textureGroup, bool allowPreview);
+    unsigned int getPreparedTexture(int ql, int qx, int qy, int tg, size_t* k = nullptr) const;
+    void renderQuad(Frame* frame, int quadTreeLevel, int qx, int qy, int textureGroup,
             float quadFactorX, float quadFactorY,
             float quadOffsetX, float quadOffsetY);
+    void getRelevantQuads(Frame* frame, int quadTreeLevel,
+            float xFactor, float yFactor,
+            float xOffset, float yOffset,
+            std::vector<std::tuple<int, int, int>>& relevantQuads,
+            std::vector<std::tuple<float, float, float, float>>& relevantQuadParameters) const;
     void renderFrame(Frame* frame, int quadTreeLevel,
             float xFactor, float yFactor,
             float xOffset, float yOffset);
     QImage renderFrameToImage(Frame* frame);
 
     bool haveCurrentFile() const;
+    std::vector<Loader::Item> prefetchItems(int fileIndex, int frameIndex);
+    void prefetchNeighbors();
+    void loadInBackground(int fileIndex, int frameIndex);
+    void cancelBackgroundLoad();
+    Loader::Item playbackItem(int position);
+    void stopPlayback();
+    std::string playbackStatus() const;
+
+private slots:
+    void collectLoadedFrame();
+    void playbackStep();
+    void removeFailedFiles();
 
 public:
     QV(Set& set, QWidget* parent = nullptr);
 
+    // Use the given percentile and its counterpart (e.g. 0.5 for 0.5% and
+    // 99.5%) for the percentile range mode, and start in that mode (global setting)
+    static void setPercentileRange(float percentile);
+    // Target frames per second for playback (global setting)
+    static void setPlaybackFps(float fps);
+
     bool overlayInfoActive;
     bool overlayValueActive;
     bool overlayStatisticActive;
     bool overlayHistogramActive;
     bool overlayColorMapActive;
+    bool roiModeActive; // statistics and histogram for a region of interest
+    bool percentileRangeActive; // default visible range from percentiles instead of min/max
+    bool playbackActive;
 
     virtual QSize sizeHint() const override;
     virtual void initializeGL() override;
@@ -141,14 +189,17 @@ public:
     void resetZoom();
     void recenter();
     void toggleDRR();
+    void togglePercentileRange();
     void adjustDRRBrightness(int direction);
     void toggleOverlayInfo();
     void toggleOverlayStatistics();
     void toggleOverlayValue();
     void toggleOverlayHistogram();
     void toggleOverlayColormap();
+    void toggleROIMode();
     void toggleApplyCurrentParametersToAllFiles();
     void toggleWatchMode();
+    void togglePlayback();
 
 signals:
     void toggleFullscreen();
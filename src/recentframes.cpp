@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "recentframes.hpp"
+#include "memorybudget.hpp"
+
+
+static int recentFramesMax = 8;
+
+void RecentFrames::setMaxFrames(int n)
+{
+    recentFramesMax = n;
+}
+
+int RecentFrames::maxFrames()
+{
+    return recentFramesMax;
+}
+
+bool RecentFrames::contains(const std::string& fileName, int frameIndex) const
+{
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+        if (it->frameIndex == frameIndex && it->fileName == fileName)
+            return true;
+    return false;
+}
+
+void RecentFrames::enforceLimits()
+{
+    while (int(_entries.size()) > maxFrames())
+        _entries.pop_back();
+    // The original arrays of the frames are not evictable, so if evicting
+    // quads etc is not enough, drop the least recently used frames
+    defaultMemoryBudget().enforce();
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+        it->frame.releaseEvictedData();
+    while (_entries.size() > 0 && !defaultMemoryBudget().hasRoom(MemoryRAM, 0)) {
+        //fprintf(stderr, "recent frames: dropping %s frame %d\n", _entries.back().fileName.c_str(), _entries.back().frameIndex);
+        _entries.pop_back();
+    }
+}
+
+void RecentFrames::put(const std::string& fileName, int frameIndex, Frame& frame)
+{
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if (it->frameIndex == frameIndex && it->fileName == fileName) {
+            _entries.erase(it);
+            break;
+        }
+    }
+    if (maxFrames() > 0) {
+        _entries.push_front(Entry { fileName, frameIndex, Frame() });
+        std::swap(_entries.front().frame, frame);
+        enforceLimits();
+    }
+    frame.reset();
+}
+
+bool RecentFrames::take(const std::string& fileName, int frameIndex, Frame& frame)
+{
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if (it->frameIndex == frameIndex && it->fileName == fileName) {
+            std::swap(it->frame, frame);
+            _entries.erase(it);
+            // textures prepared for the previous frame are no longer valid
+            frame.invalidateTextures();
+            return true;
+        }
+    }
+    return false;
+}
+
+void RecentFrames::remove(const std::string& fileName)
+{
+    for (auto it = _entries.begin(); it != _entries.end(); ) {
+        if (it->fileName == fileName)
+            it = _entries.erase(it);
+        else
+            ++it;
+    }
+}
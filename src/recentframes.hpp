@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_RECENTFRAMES_HPP
+#define QV_RECENTFRAMES_HPP
+
+#include <string>
+#include <list>
+
+#include "frame.hpp"
+
+/* Recently viewed frames, including their quadtrees and statistics, so that
+ * going back to one of them does not require to read and process it again.
+ * The frames are shared by all files of a set and identified by file name
+ * and frame index. The least recently used frames are dropped when there
+ * are more than maxFrames() of them, or when the RAM budget of the default
+ * memory budget is exceeded even after evicting everything else that is
+ * evictable. */
+class RecentFrames {
+private:
+    struct Entry {
+        std::string fileName;
+        int frameIndex;
+        Frame frame;
+    };
+    std::list<Entry> _entries; // most recently used first
+
+    void enforceLimits();
+
+public:
+    // Maximum number of frames to keep (global setting); 0 disables this
+    static void setMaxFrames(int n);
+    static int maxFrames();
+
+    bool contains(const std::string& fileName, int frameIndex) const;
+    // Keep the given frame; it is reset afterwards
+    void put(const std::string& fileName, int frameIndex, Frame& frame);
+    // Move a frame out of the cache into the given frame, if it is there
+    bool take(const std::string& fileName, int frameIndex, Frame& frame);
+    // Drop all frames of the given file, e.g. if the file changed
+    void remove(const std::string& fileName);
+};
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdint>
+#include <new>
+
+#include "seekindex.hpp"
+
+
+/* Cached data: the number of frames and the completeness flag as two 32 bit integers */
+
+SeekIndex::SeekIndex(const std::string& fileName, const TGD::TagList& importerHints) :
+    _fileName(fileName), _importerHints(importerHints),
+    _cache(defaultDiskCache().fileCache(fileName)),
+    _stopping(false), _frameCount(0), _complete(false), _storedFrameCount(0), _storedComplete(false)
+{
+    int32_t data[2];
+    if (_cache.load("seekindex", data, sizeof(data)) && data[0] >= 0) {
+        _frameCount = data[0];
+        _complete = (data[1] != 0);
+        _storedFrameCount = data[0];
+        _storedComplete = _complete;
+    }
+}
+
+SeekIndex::~SeekIndex()
+{
+    stop();
+}
+
+void SeekIndex::start()
+{
+    if (_complete || _thread.joinable())
+        return;
+    _stopping = false;
+    _thread = std::thread([this]() { work(); });
+}
+
+void SeekIndex::stop()
+{
+    if (!_thread.joinable())
+        return;
+    _stopping = true;
+    _thread.join();
+    store();
+}
+
+void SeekIndex::store()
+{
+    if (_frameCount > _storedFrameCount || _complete != _storedComplete) {
+        int32_t data[2] = { _frameCount, _complete ? 1 : 0 };
+        _cache.store("seekindex", data, sizeof(data));
+        _storedFrameCount = _frameCount;
+        _storedComplete = _complete;
+    }
+}
+
+/* The arrays that are read only to find the frames are thrown away right
+ * away, so they all share a single buffer on the heap. The buffer only grows
+ * when an array is bigger than all before it. An importer that needs another
+ * array while the buffer is in use gets separate memory. */
+class ScratchAllocator : public TGD::Allocator {
+private:
+    mutable void* _buffer;
+    mutable size_t _size;
+    mutable bool _inUse;
+
+public:
+    ScratchAllocator() : _buffer(nullptr), _size(0), _inUse(false)
+    {
+    }
+
+    ~ScratchAllocator()
+    {
+        ::operator delete(_buffer);
+    }
+
+    virtual void* allocate(size_t size) const override
+    {
+        if (_inUse)
+            return ::operator new(size);
+        if (size > _size) {
+            ::operator delete(_buffer);
+            _buffer = ::operator new(size);
+            _size = size;
+        }
+        _inUse = true;
+        return _buffer;
+    }
+
+    virtual void deallocate(void* ptr, size_t /* size */) const override
+    {
+        if (ptr == _buffer)
+            _inUse = false;
+        else
+            ::operator delete(ptr);
+    }
+};
+
+void SeekIndex::work()
+{
+    // TGD cannot tell where the arrays are in the file, and it cannot skip an
+    // array without decoding it, so every array is read. But nothing is kept:
+    // the data only passes through a scratch buffer, and none of the
+    // processing that a Frame would do happens here. Frames that are known to
+    // exist are then read by their index.
+    ScratchAllocator scratch;
+    TGD::Importer importer(_fileName, _importerHints);
+    int n = 0;
+    while (!_stopping) {
+        TGD::Error tgdError = TGD::ErrorNone;
+        if (!importer.hasMore(&tgdError)) {
+            if (tgdError == TGD::ErrorNone)
+                _complete = true;
+            break;
+        }
+        importer.readArray(&tgdError, -1, scratch);
+        if (tgdError != TGD::ErrorNone)
+            break;
+        n++;
+        if (n > _frameCount)
+            _frameCount = n;
+    }
+    //fprintf(stderr, "seek index: %s has %d frames%s\n", _fileName.c_str(), int(_frameCount), _complete ? "" : " so far");
+    if (_complete)
+        store();
+}
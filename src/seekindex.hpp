@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_SEEKINDEX_HPP
+#define QV_SEEKINDEX_HPP
+
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include <tgd/io.hpp>
+
+#include "diskcache.hpp"
+
+/* For files whose frame count is not known in advance (see
+ * File::frameCount()): discovers the frames by reading through the file in a
+ * background thread, with its own importer. Frames that are known to exist
+ * can be read directly by their index, so jumping far ahead does not require
+ * to step through all frames in between. The number of frames found so far,
+ * and whether the end of the file was reached, is kept in the disk cache so
+ * that a file that is opened again knows its frames right away. */
+class SeekIndex {
+private:
+    std::string _fileName;
+    TGD::TagList _importerHints;
+    FrameCache _cache;
+    std::thread _thread;
+    std::atomic<bool> _stopping;
+    std::atomic<int> _frameCount;
+    std::atomic<bool> _complete;
+    int _storedFrameCount;
+    bool _storedComplete;
+
+    void work();
+    void store();
+
+public:
+    SeekIndex(const std::string& fileName, const TGD::TagList& importerHints);
+    ~SeekIndex();
+    SeekIndex(const SeekIndex&) = delete;
+    SeekIndex& operator=(const SeekIndex&) = delete;
+
+    // Start or stop the background thread; nothing happens if the index is
+    // complete or the thread is already running or stopped
+    void start();
+    void stop();
+
+    // The number of frames that are known to exist
+    int frameCount() const { return _frameCount; }
+    // Whether frameCount() is the number of frames in the file
+    bool isComplete() const { return _complete; }
+};
+
+#endif
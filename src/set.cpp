@@ -23,18 +23,20 @@
  */
 
 #include <filesystem>
+#include <algorithm>
 
 #include "set.hpp"
 
 
-Set::Set() : _fileIndex(-1), _keepParameterIndex(false), _parameterIndex(-1)
+Set::Set() : _recentFrames(std::make_shared<RecentFrames>()),
+    _fileIndex(-1), _keepParameterIndex(false), _parameterIndex(-1)
 {
 }
 
 bool Set::addFile(const std::string& fileName, std::string& errorMessage)
 {
     File file;
-    if (file.init(fileName, _importerHints, errorMessage)) {
+    if (file.init(fileName, _importerHints, _recentFrames, errorMessage)) {
         _files.push_back(file);
         _parameters.push_back(Parameters());
         return true;
@@ -43,10 +45,63 @@ bool Set::addFile(const std::string& fileName, std::string& errorMessage)
     }
 }
 
+void Set::addFilesUnchecked(const std::vector<std::string>& fileNames)
+{
+    std::vector<std::shared_ptr<FileProbe>> probes(fileNames.size());
+    _files.reserve(_files.size() + fileNames.size());
+    _parameters.reserve(_parameters.size() + fileNames.size());
+    for (size_t i = 0; i < fileNames.size(); i++) {
+        probes[i] = std::make_shared<FileProbe>();
+        _files.emplace_back();
+        _files.back().init(fileNames[i], _importerHints, _recentFrames, probes[i]);
+        _parameters.push_back(Parameters());
+    }
+    _probers.push_back(std::make_shared<Prober>(fileNames, _importerHints, probes));
+}
+
+bool Set::probing()
+{
+    _probers.erase(std::remove_if(_probers.begin(), _probers.end(),
+                [](const std::shared_ptr<Prober>& p) { return p->finished(); }),
+            _probers.end());
+    return _probers.size() > 0;
+}
+
+std::vector<std::string> Set::removeFailedFiles()
+{
+    // A single pass over all files, since there may be many of them.
+    // Failed files were never visited, so they cannot be the parameter
+    // index and have no recent frames.
+    std::vector<std::string> errorMessages;
+    std::string errorMessage;
+    int oldFileIndex = _fileIndex;
+    int oldParameterIndex = _parameterIndex;
+    size_t j = 0;
+    for (size_t i = 0; i < _files.size(); i++) {
+        if (int(i) != oldFileIndex && _files[i].probeFailed(errorMessage)) {
+            errorMessages.push_back(errorMessage);
+            if (int(i) < oldFileIndex)
+                _fileIndex--;
+            if (int(i) < oldParameterIndex)
+                _parameterIndex--;
+        } else {
+            if (j != i) {
+                _files[j] = std::move(_files[i]);
+                _parameters[j] = std::move(_parameters[i]);
+            }
+            j++;
+        }
+    }
+    _files.erase(_files.begin() + j, _files.end());
+    _parameters.erase(_parameters.begin() + j, _parameters.end());
+    return errorMessages;
+}
+
 void Set::removeFile(int removeIndex)
 {
     if (removeIndex < 0 || removeIndex >= fileCount())
         return;
+    std::string removeFileName = _files[removeIndex].fileName();
 
     if (removeIndex == fileIndex()) {
         std::string tmpErrMsg;
@@ -74,6 +129,7 @@ void Set::removeFile(int removeIndex)
         _files.erase(_files.begin() + removeIndex);
         _parameters.erase(_parameters.begin() + removeIndex);
     }
+    _recentFrames->remove(removeFileName);
     if (removeIndex == parameterIndex()) {
         _parameterIndex = _fileIndex;
     } else if (removeIndex < parameterIndex()) {
@@ -104,28 +160,58 @@ bool Set::setFileIndex(int index, std::string& errorMessage)
         return false;
     }
 
+    int frameIndex = initialFrameIndex(index, errorMessage);
+    if (frameIndex < 0)
+        return false;
+    return switchFile(index, frameIndex, nullptr, nullptr, errorMessage);
+}
+
+int Set::initialFrameIndex(int index, std::string& errorMessage)
+{
     int frameIndex = 0;
-    int channelIndex = -1;
-    if (_fileIndex >= 0) {
+    if (_fileIndex >= 0)
         frameIndex = currentFile()->frameIndex();
-        if (frameIndex >= 0)
-            channelIndex = currentFile()->currentFrame()->channelIndex();
-    }
 
     if (frameIndex < 0) {
         frameIndex = 0;
     } else {
         int frameCount = _files[index].frameCount(errorMessage);
         if (frameCount == 0)
-            return false;
+            return -1;
         if (frameCount < 0)
             frameIndex = 0;
         else if (frameIndex >= frameCount)
             frameIndex = frameCount - 1;
     }
+    return frameIndex;
+}
 
-    if (!_files[index].setFrameIndex(frameIndex, errorMessage))
+bool Set::setFileIndex(int index, int frameIndex, const TGD::ArrayContainer& array, const Frame* prefetchedFrame,
+        std::string& errorMessage)
+{
+    if (index < 0 || index >= fileCount()) {
+        errorMessage = "file " + std::to_string(index) + " does not exist";
         return false;
+    }
+    if (index == _fileIndex)
+        return currentFile()->setFrame(frameIndex, array, prefetchedFrame, errorMessage);
+    return switchFile(index, frameIndex, &array, prefetchedFrame, errorMessage);
+}
+
+bool Set::switchFile(int index, int frameIndex, const TGD::ArrayContainer* array, const Frame* prefetchedFrame,
+        std::string& errorMessage)
+{
+    int channelIndex = -1;
+    if (_fileIndex >= 0 && currentFile()->frameIndex() >= 0)
+        channelIndex = currentFile()->currentFrame()->channelIndex();
+
+    if (array) {
+        if (!_files[index].setFrame(frameIndex, *array, prefetchedFrame, errorMessage))
+            return false;
+    } else {
+        if (!_files[index].setFrameIndex(frameIndex, errorMessage))
+            return false;
+    }
 
     if ((channelIndex == ColorChannelIndex && _files[index].currentFrame()->colorSpace() == ColorSpaceNone)
             || (channelIndex != ColorChannelIndex && channelIndex >= _files[index].currentFrame()->channelCount()))
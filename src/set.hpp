@@ -30,11 +30,16 @@
 class Set {
 private:
     TGD::TagList _importerHints;
+    std::shared_ptr<RecentFrames> _recentFrames;
     std::vector<File> _files;
     std::vector<Parameters> _parameters;
     int _fileIndex;
     bool _keepParameterIndex;
     int _parameterIndex;
+    std::vector<std::shared_ptr<Prober>> _probers;
+
+    bool switchFile(int index, int frameIndex, const TGD::ArrayContainer* array, const Frame* prefetchedFrame,
+            std::string& errorMessage);
 
 public:
     Set();
@@ -42,10 +47,24 @@ public:
     void setImporterHints(const TGD::TagList& importerHints) { _importerHints = importerHints; }
 
     bool addFile(const std::string& fileName, std::string& errorMessage);
+    // Add files right away without opening them, e.g. all files in a big
+    // directory; they are checked in the background (see Prober)
+    void addFilesUnchecked(const std::vector<std::string>& fileNames);
+    // Whether files added unchecked are still being checked
+    bool probing();
+    // Remove the files that were found to be unusable, except the current
+    // one, and return their error messages
+    std::vector<std::string> removeFailedFiles();
     void removeFile(int fileIndex);
     int fileCount() const { return _files.size(); }
 
     bool setFileIndex(int index, std::string& errorMessage);
+    // The frame index that setFileIndex() would use for the given file, or -1 on error
+    int initialFrameIndex(int index, std::string& errorMessage);
+    // Like setFileIndex(), but with the array of the frame given by initialFrameIndex()
+    // already read, e.g. by the Loader, or prefetched (see File::setFrame())
+    bool setFileIndex(int index, int frameIndex, const TGD::ArrayContainer& array, const Frame* prefetchedFrame,
+            std::string& errorMessage);
     int fileIndex() const { return _fileIndex; }
 
     File* file(int index) { return &(_files[index]); }
@@ -22,7 +22,7 @@
  * SOFTWARE.
  */
 
-uniform sampler2D tex0, tex1, tex2, alphaTex;
+uniform sampler2D tex; // holds up to four channels
 
 uniform float dataWidth, dataHeight;
 
@@ -36,9 +36,8 @@ const int ColorSpaceY           = 5;
 const int ColorSpaceXYZ         = 6;
 uniform bool showColor;
 uniform int colorSpace;
-uniform int channelCount;
-uniform int dataChannelIndex;
-uniform int colorChannel0Index;
+uniform int dataChannelIndex; // texture component that holds the data channel
+uniform int colorChannel0Index; // texture components that hold the color channels
 uniform int colorChannel1Index;
 uniform int colorChannel2Index;
 uniform int alphaChannelIndex;
@@ -46,6 +45,7 @@ uniform int alphaChannelIndex;
 uniform bool colorWas8Bit;
 uniform bool colorWas16Bit;
 uniform bool texIsSRGB;
+uniform float texValueFactor; // maps normalized integer texture values to data values
 
 uniform float visMinVal;
 uniform float visMaxVal;
@@ -211,7 +211,7 @@ void main(void)
         rgb = vec3(0.0);
     } else if (!showColor) {
         // Get value
-        float v = texture(tex0, vTexCoord)[dataChannelIndex];
+        float v = texture(tex, vTexCoord)[dataChannelIndex] * texValueFactor;
         if (texIsSRGB)
             v = linear_to_s(v) * 255.0;
         // Apply range selection
@@ -232,26 +232,18 @@ void main(void)
     } else {
         // Read data into canonical form
         vec4 data = vec4(0.0, 0.0, 0.0, 1.0);
-        if (channelCount <= 4) {
-            vec4 tmpData = texture(tex0, vTexCoord);
-            data[0] = tmpData[colorChannel0Index];
-            data[1] = tmpData[colorChannel1Index];
-            data[2] = tmpData[colorChannel2Index];
-            if (alphaChannelIndex >= 0) {
-                data[3] = tmpData[alphaChannelIndex];
-            }
-        } else {
-            data[0] = texture(tex0, vTexCoord).r;
-            data[1] = texture(tex1, vTexCoord).r;
-            data[2] = texture(tex2, vTexCoord).r;
-            if (alphaChannelIndex >= 0) {
-                data[3] = texture(alphaTex, vTexCoord).r;
-            }
+        vec4 tmpData = texture(tex, vTexCoord);
+        data[0] = tmpData[colorChannel0Index];
+        data[1] = tmpData[colorChannel1Index];
+        data[2] = tmpData[colorChannel2Index];
+        if (alphaChannelIndex >= 0) {
+            data[3] = tmpData[alphaChannelIndex];
         }
         if (colorSpace == ColorSpaceSGray || colorSpace == ColorSpaceSRGB) {
-            if (colorWas16Bit)
+            // normalized integer textures already provide values in [0,1]
+            if (colorWas16Bit && texValueFactor == 1.0)
                 data /= 65535.0;
-            else if (colorWas8Bit && !texIsSRGB)
+            else if (colorWas8Bit && !texIsSRGB && texValueFactor == 1.0)
                 data /= 255.0;
             if (!texIsSRGB)
                 for (int i = 0; i < 3; i++)
@@ -292,7 +284,7 @@ void main(void)
 
     // Apply grid
     if (magGrid) {
-        vec2 texSize = vec2(textureSize(tex0, 0));
+        vec2 texSize = vec2(textureSize(tex, 0));
         vec2 texelCoord = vTexCoord * texSize;
         vec2 fragmentSizeInTexels = vec2(dFdx(texelCoord.x), dFdy(texelCoord.y));
         // only display grid if data texels are large enough on screen
@@ -23,8 +23,12 @@
  */
 
 #include <cassert>
+#include <cstdint>
 #include <limits>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
 
 #include <omp.h>
 
@@ -38,112 +42,375 @@ Statistic::Statistic() :
     _maxVal(std::numeric_limits<float>::quiet_NaN()),
     _sampleMean(std::numeric_limits<float>::quiet_NaN()),
     _sampleVariance(std::numeric_limits<float>::quiet_NaN()),
-    _sampleDeviation(std::numeric_limits<float>::quiet_NaN())
+    _sampleDeviation(std::numeric_limits<float>::quiet_NaN()),
+    _mean(0.0), _m2(0.0),
+    _approximate(false)
 {
 }
 
+/* Accumulated statistics of a set of values: the number of finite values,
+ * their minimum and maximum, their mean, and the sum of their squared
+ * differences from the mean (M2). Sets are merged with the formula of Chan et
+ * al., which is numerically robust even for a large number of values. */
+struct Accumulator {
+    unsigned long long n = 0;
+    float minVal = std::numeric_limits<float>::quiet_NaN();
+    float maxVal = std::numeric_limits<float>::quiet_NaN();
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void merge(unsigned long long nb, float minb, float maxb, double meanb, double m2b)
+    {
+        if (nb == 0)
+            return;
+        if (n == 0) {
+            n = nb;
+            minVal = minb;
+            maxVal = maxb;
+            mean = meanb;
+            m2 = m2b;
+        } else {
+            double na = n;
+            double nTotal = na + nb;
+            double delta = meanb - mean;
+            mean += delta * (nb / nTotal);
+            m2 += m2b + delta * delta * (na * nb / nTotal);
+            n += nb;
+            minVal = std::min(minVal, minb);
+            maxVal = std::max(maxVal, maxb);
+        }
+    }
+
+    void merge(const Accumulator& other)
+    {
+        merge(other.n, other.minVal, other.maxVal, other.mean, other.m2);
+    }
+};
+
+/* Accumulate one component of a chunk of elements. The values are shifted by
+ * the first value so that the sums stay small, which avoids the cancellation
+ * problems of the naive sum of squares. The loops have no early exits so that
+ * the compiler can vectorize them; integer types with up to 16 bits use exact
+ * integer sums. */
 template<typename T>
-static void initHelper(const TGD::Array<T> array, size_t componentIndex,
-        unsigned long long& _finiteValues, float& _minVal, float& _maxVal,
-        float& _sampleMean, float& _sampleVariance, float& _sampleDeviation)
+static void accumulateChunk(const T* data, size_t n, size_t cc, size_t c, Accumulator& acc)
 {
+    if constexpr (std::is_integral<T>::value && sizeof(T) <= 2) {
+        // chunks are small enough that the sums cannot overflow
+        int shift = data[c];
+        int64_t s = 0, q = 0;
+        int lo = shift, hi = shift;
+        for (size_t e = 0; e < n; e++) {
+            int val = data[e * cc + c];
+            int v = val - shift;
+            s += v;
+            q += int64_t(v) * v;
+            lo = std::min(lo, val);
+            hi = std::max(hi, val);
+        }
+        double ds = s;
+        acc.merge(n, lo, hi, shift + ds / n, double(q) - ds * ds / n);
+    } else if constexpr (std::is_integral<T>::value) {
+        T shiftT = data[c];
+        double shift = shiftT;
+        double s = 0.0, q = 0.0;
+        T lo = shiftT, hi = shiftT;
+        for (size_t e = 0; e < n; e++) {
+            T val = data[e * cc + c];
+            double v = double(val) - shift;
+            s += v;
+            q += v * v;
+            lo = std::min(lo, val);
+            hi = std::max(hi, val);
+        }
+        acc.merge(n, lo, hi, shift + s / n, q - s * s / n);
+    } else {
+        size_t first = 0;
+        while (first < n && !std::isfinite(data[first * cc + c]))
+            first++;
+        if (first == n)
+            return;
+        T shiftT = data[first * cc + c];
+        double shift = shiftT;
+        unsigned long long k = 0;
+        double s = 0.0, q = 0.0;
+        T lo = shiftT, hi = shiftT;
+        for (size_t e = first; e < n; e++) {
+            T val = data[e * cc + c];
+            bool finite = std::isfinite(val);
+            double v = (finite ? double(val) - shift : 0.0);
+            k += finite;
+            s += v;
+            q += v * v;
+            lo = (finite && val < lo ? val : lo);
+            hi = (finite && val > hi ? val : hi);
+        }
+        acc.merge(k, lo, hi, shift + s / k, q - s * s / k);
+    }
+}
+
+/* Accumulate the given components of all elements in a single pass over the
+ * data. Each thread works on chunks that fit into the cache; the results of
+ * the threads are merged in a fixed order so that they are reproducible. */
+template<typename T>
+static void accumulate(const TGD::ArrayContainer& array, const std::vector<size_t>& components,
+        std::vector<Accumulator>& acc)
+{
+    const size_t chunkSize = 1024;
     size_t n = array.elementCount();
     size_t cc = array.componentCount();
-    const T* data = array[0];
+    const T* data = static_cast<const T*>(array.data());
+    size_t chunks = n / chunkSize + (n % chunkSize ? 1 : 0);
 
     int maxParts = omp_get_max_threads();
-    std::vector<unsigned long long> partFiniteValues(maxParts, 0);
-    std::vector<float> partMinVals(maxParts, std::numeric_limits<float>::quiet_NaN());
-    std::vector<float> partMaxVals(maxParts, std::numeric_limits<float>::quiet_NaN());
-    std::vector<double> partSums(maxParts, 0.0);
-    std::vector<double> partSumsOfSquares(maxParts, 0.0);
-    int parts;
+    std::vector<std::vector<Accumulator>> partAcc(maxParts, std::vector<Accumulator>(components.size()));
+    int parts = 1;
     #pragma omp parallel
     {
+        #pragma omp single
         parts = omp_get_num_threads();
-        size_t partSize = n / parts + (n % parts == 0 ? 0 : 1);
         int p = omp_get_thread_num();
-
-        for (size_t pe = 0; pe < partSize; pe++) {
-            size_t e = p * partSize + pe;
-            if (e >= n)
-                break;
-            T val = data[e * cc + componentIndex];
-            if (std::isfinite(val)) {
-                partFiniteValues[p]++;
-                if (partFiniteValues[p] == 1) {
-                    partMinVals[p] = val;
-                    partMaxVals[p] = val;
-                } else if (val < partMinVals[p]) {
-                    partMinVals[p] = val;
-                } else if (val > partMaxVals[p]) {
-                    partMaxVals[p] = val;
-                }
-                partSums[p] += val;
-                partSumsOfSquares[p] += val * val;
-            }
+        #pragma omp for schedule(static)
+        for (size_t chunk = 0; chunk < chunks; chunk++) {
+            size_t e = chunk * chunkSize;
+            size_t m = std::min(chunkSize, n - e);
+            for (size_t i = 0; i < components.size(); i++)
+                accumulateChunk(data + e * cc, m, cc, components[i], partAcc[p][i]);
         }
     }
+    for (int p = 0; p < parts; p++)
+        for (size_t i = 0; i < components.size(); i++)
+            acc[i].merge(partAcc[p][i]);
+}
 
-    double sum = 0.0;
-    double sumOfSquares = 0.0;
-    for (int p = 0; p < parts; p++) {
-        _finiteValues += partFiniteValues[p];
-        sum += partSums[p];
-        sumOfSquares += partSumsOfSquares[p];
-        if (std::isfinite(partMinVals[p]) && (!std::isfinite(_minVal) || _minVal > partMinVals[p]))
-            _minVal = partMinVals[p];
-        if (std::isfinite(partMaxVals[p]) && (!std::isfinite(_maxVal) || _maxVal < partMaxVals[p]))
-            _maxVal = partMaxVals[p];
-    }
-    if (_finiteValues > 0) {
-        _sampleMean = sum / _finiteValues;
-        if (_finiteValues > 1) {
-            _sampleVariance = (sumOfSquares - sum / _finiteValues * sum) / (_finiteValues - 1);
-            if (_sampleVariance < 0.0f)
-                _sampleVariance = 0.0f;
-            _sampleDeviation = std::sqrt(_sampleVariance);
-        } else if (_finiteValues == 1) {
-            _sampleVariance = 0.0f;
-            _sampleDeviation = 0.0f;
-        }
+/* Accumulate one component of a rectangle of the array, row by row. This is
+ * meant for small regions and therefore does not use multiple threads. */
+template<typename T>
+static void accumulateRegion(const TGD::ArrayContainer& array, size_t c,
+        size_t x, size_t y, size_t w, size_t h, Accumulator& acc)
+{
+    const size_t chunkSize = 1024;
+    size_t width = array.dimension(0);
+    size_t cc = array.componentCount();
+    const T* data = static_cast<const T*>(array.data());
+    for (size_t row = y; row < y + h; row++)
+        for (size_t e = 0; e < w; e += chunkSize)
+            accumulateChunk(data + (row * width + x + e) * cc, std::min(chunkSize, w - e), cc, c, acc);
+}
+
+static void accumulateRegion(const TGD::ArrayContainer& array, size_t c,
+        size_t x, size_t y, size_t w, size_t h, Accumulator& acc)
+{
+    switch (array.componentType()) {
+    case TGD::int8:
+        accumulateRegion<int8_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::uint8:
+        accumulateRegion<uint8_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::int16:
+        accumulateRegion<int16_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::uint16:
+        accumulateRegion<uint16_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::int32:
+        accumulateRegion<int32_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::uint32:
+        accumulateRegion<uint32_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::int64:
+        accumulateRegion<int64_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::uint64:
+        accumulateRegion<uint64_t>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::float32:
+        accumulateRegion<float>(array, c, x, y, w, h, acc);
+        break;
+    case TGD::float64:
+        accumulateRegion<double>(array, c, x, y, w, h, acc);
+        break;
     }
 }
 
-void Statistic::init(const TGD::ArrayContainer& array, size_t componentIndex)
+static void accumulate(const TGD::ArrayContainer& array, const std::vector<size_t>& components,
+        std::vector<Accumulator>& acc)
 {
-    assert(!_initialized);
     switch (array.componentType()) {
     case TGD::int8:
-        initHelper(TGD::Array<int8_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<int8_t>(array, components, acc);
         break;
     case TGD::uint8:
-        initHelper(TGD::Array<uint8_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<uint8_t>(array, components, acc);
         break;
     case TGD::int16:
-        initHelper(TGD::Array<int16_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<int16_t>(array, components, acc);
         break;
     case TGD::uint16:
-        initHelper(TGD::Array<uint16_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<uint16_t>(array, components, acc);
         break;
     case TGD::int32:
-        initHelper(TGD::Array<int32_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<int32_t>(array, components, acc);
         break;
     case TGD::uint32:
-        initHelper(TGD::Array<uint32_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<uint32_t>(array, components, acc);
         break;
     case TGD::int64:
-        initHelper(TGD::Array<int64_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<int64_t>(array, components, acc);
         break;
     case TGD::uint64:
-        initHelper(TGD::Array<uint64_t>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<uint64_t>(array, components, acc);
         break;
     case TGD::float32:
-        initHelper(TGD::Array<float>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<float>(array, components, acc);
         break;
     case TGD::float64:
-        initHelper(TGD::Array<double>(array), componentIndex, _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation);
+        accumulate<double>(array, components, acc);
         break;
     }
+}
+
+void Statistic::init(const TGD::ArrayContainer& array, size_t componentIndex)
+{
+    add(array, componentIndex);
+    finish();
+}
+
+void Statistic::init(const TGD::ArrayContainer& array, std::vector<Statistic>& statistics)
+{
+    assert(statistics.size() == array.componentCount());
+    std::vector<size_t> components;
+    for (size_t c = 0; c < statistics.size(); c++)
+        if (!statistics[c].initialized())
+            components.push_back(c);
+    std::vector<Accumulator> acc(components.size());
+    accumulate(array, components, acc);
+    for (size_t i = 0; i < components.size(); i++) {
+        Statistic& S = statistics[components[i]];
+        S = Statistic();
+        S._finiteValues = acc[i].n;
+        S._minVal = acc[i].minVal;
+        S._maxVal = acc[i].maxVal;
+        S._mean = acc[i].mean;
+        S._m2 = acc[i].m2;
+        S.finish();
+    }
+}
+
+void Statistic::init(const ValueCounts& valueCounts, size_t componentIndex)
+{
+    assert(!_initialized);
+    // Merge the sets of equal values; this is exact up to floating point rounding
+    Accumulator acc;
+    const std::vector<unsigned long long>& counts = valueCounts.counts(componentIndex);
+    for (size_t v = 0; v < counts.size(); v++) {
+        if (counts[v] > 0) {
+            float val = valueCounts.value(v);
+            acc.merge(counts[v], val, val, val, 0.0);
+        }
+    }
+    _finiteValues = acc.n;
+    _minVal = acc.minVal;
+    _maxVal = acc.maxVal;
+    _mean = acc.mean;
+    _m2 = acc.m2;
+    finish();
+}
+
+void Statistic::add(const TGD::ArrayContainer& array, size_t componentIndex)
+{
+    assert(!_initialized);
+    std::vector<size_t> components(1, componentIndex);
+    std::vector<Accumulator> acc(1);
+    acc[0].merge(_finiteValues, _minVal, _maxVal, _mean, _m2);
+    accumulate(array, components, acc);
+    _finiteValues = acc[0].n;
+    _minVal = acc[0].minVal;
+    _maxVal = acc[0].maxVal;
+    _mean = acc[0].mean;
+    _m2 = acc[0].m2;
+}
+
+void Statistic::add(const TGD::ArrayContainer& array, size_t componentIndex,
+        size_t x, size_t y, size_t width, size_t height)
+{
+    assert(!_initialized);
+    Accumulator acc;
+    acc.merge(_finiteValues, _minVal, _maxVal, _mean, _m2);
+    accumulateRegion(array, componentIndex, x, y, width, height, acc);
+    _finiteValues = acc.n;
+    _minVal = acc.minVal;
+    _maxVal = acc.maxVal;
+    _mean = acc.mean;
+    _m2 = acc.m2;
+}
+
+void Statistic::merge(const Statistic& other)
+{
+    assert(!_initialized && !other._initialized);
+    Accumulator acc;
+    acc.merge(_finiteValues, _minVal, _maxVal, _mean, _m2);
+    acc.merge(other._finiteValues, other._minVal, other._maxVal, other._mean, other._m2);
+    _finiteValues = acc.n;
+    _minVal = acc.minVal;
+    _maxVal = acc.maxVal;
+    _mean = acc.mean;
+    _m2 = acc.m2;
+}
+
+void Statistic::finish()
+{
+    assert(!_initialized);
+    if (_finiteValues > 0) {
+        _sampleMean = _mean;
+        if (_finiteValues > 1) {
+            _sampleVariance = _m2 / (_finiteValues - 1);
+            if (_sampleVariance < 0.0f)
+                _sampleVariance = 0.0f;
+            _sampleDeviation = std::sqrt(_sampleVariance);
+        } else if (_finiteValues == 1) {
+            _sampleVariance = 0.0f;
+            _sampleDeviation = 0.0f;
+        }
+    }
     _initialized = true;
 }
+
+void Statistic::setApproximate(double factor)
+{
+    _finiteValues = std::round(_finiteValues * factor);
+    _approximate = true;
+}
+
+struct StatisticData {
+    unsigned long long finiteValues;
+    float minVal;
+    float maxVal;
+    float sampleMean;
+    float sampleVariance;
+    float sampleDeviation;
+};
+
+bool Statistic::load(const FrameCache& cache, const std::string& name)
+{
+    StatisticData data;
+    if (!cache.load(name, &data, sizeof(data)))
+        return false;
+    _finiteValues = data.finiteValues;
+    _minVal = data.minVal;
+    _maxVal = data.maxVal;
+    _sampleMean = data.sampleMean;
+    _sampleVariance = data.sampleVariance;
+    _sampleDeviation = data.sampleDeviation;
+    _initialized = true;
+    return true;
+}
+
+void Statistic::store(const FrameCache& cache, const std::string& name) const
+{
+    assert(_initialized);
+    StatisticData data = { _finiteValues, _minVal, _maxVal, _sampleMean, _sampleVariance, _sampleDeviation };
+    cache.store(name, &data, sizeof(data));
+}
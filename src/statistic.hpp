@@ -27,8 +27,13 @@
 #ifndef QV_STATISTIC_HPP
 #define QV_STATISTIC_HPP
 
+#include <vector>
+
 #include <tgd/array.hpp>
 
+#include "diskcache.hpp"
+#include "valuecounts.hpp"
+
 class Statistic {
 private:
     bool _initialized;
@@ -38,13 +43,35 @@ private:
     float _sampleMean;
     float _sampleVariance;
     float _sampleDeviation;
+    double _mean, _m2; // only used while adding data
+    bool _approximate;
 
 public:
     Statistic();
 
     void init(const TGD::ArrayContainer& array, size_t componentIndex);
+    // Initialize the statistics of all components of the array that are not
+    // initialized yet, in a single pass over the data
+    static void init(const TGD::ArrayContainer& array, std::vector<Statistic>& statistics);
+    // Alternative to init() for 8 and 16 bit integer data that does not look at the data again
+    void init(const ValueCounts& valueCounts, size_t componentIndex);
+    // Alternative to init() for data that is split into several arrays, e.g.
+    // tiles: call add() for each array, then finish()
+    void add(const TGD::ArrayContainer& array, size_t componentIndex);
+    // Same for the rectangle of the array with the given top left corner and size
+    void add(const TGD::ArrayContainer& array, size_t componentIndex,
+            size_t x, size_t y, size_t width, size_t height);
+    // Merge the values added to another statistic that is not finished yet
+    void merge(const Statistic& other);
+    void finish();
+    bool load(const FrameCache& cache, const std::string& name); // alternative to init()
+    void store(const FrameCache& cache, const std::string& name) const;
+    // Mark as an estimate computed from a subsample that has 1/factor of the
+    // values; the number of finite values is scaled accordingly
+    void setApproximate(double factor);
 
     bool initialized() const { return _initialized; }
+    bool approximate() const { return _approximate; }
     void invalidate() { *this = Statistic(); }
     unsigned long long finiteValues() const { return _finiteValues; }
     float minVal() const { return _minVal; }
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_THREADPOOL_HPP
+#define QV_THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/* A simple pool of worker threads that execute tasks in the background.
+ * Tasks must not assume that they are ever executed: tasks that are still
+ * queued when the pool is destroyed are dropped, and running tasks should
+ * check stopping() regularly and return early if it is true. */
+class ThreadPool {
+private:
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void ()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::atomic<bool> _stopping;
+
+    void work();
+
+public:
+    ThreadPool(int threadCount = 0); // 0 means number of hardware threads
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return _threads.size(); }
+    bool stopping() const { return _stopping; }
+    void enqueue(const std::function<void ()>& task);
+};
+
+ThreadPool& defaultThreadPool();
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include <omp.h>
+
+#include "valuecounts.hpp"
+
+
+ValueCounts::ValueCounts() : _type(TGD::uint8)
+{
+}
+
+bool ValueCounts::supports(TGD::Type type)
+{
+    return type == TGD::int8 || type == TGD::uint8 || type == TGD::int16 || type == TGD::uint16;
+}
+
+template<typename T>
+static void countHelper(const TGD::ArrayContainer& array, std::vector<std::vector<unsigned long long>>& counts)
+{
+    const size_t values = size_t(1) << (8 * sizeof(T));
+    const int offset = std::numeric_limits<T>::min();
+    size_t n = array.elementCount();
+    size_t cc = array.componentCount();
+    const T* data = static_cast<const T*>(array.data());
+
+    // Each thread counts into its own tables to avoid contention. These use
+    // 32 bit counters to save memory, and the data is processed in blocks
+    // that are small enough that they cannot overflow. A thread only gets
+    // tables if it has enough elements to count to make up for clearing and
+    // merging them, and the tables of all threads are limited in size: if
+    // necessary, the channels are counted in several passes.
+    const size_t blockSize = size_t(1) << 30;
+    const size_t maxTableSize = size_t(16) << 20;
+    int maxParts = std::max(1, int(std::min(size_t(omp_get_max_threads()), n / values)));
+    size_t channelsPerPass = std::max(size_t(1), std::min(cc,
+                maxTableSize / (maxParts * values * sizeof(uint32_t))));
+    std::vector<uint32_t> partCounts(maxParts * channelsPerPass * values);
+    counts.assign(cc, std::vector<unsigned long long>(values, 0));
+    for (size_t c0 = 0; c0 < cc; c0 += channelsPerPass) {
+        size_t pc = std::min(channelsPerPass, cc - c0);
+        for (size_t blockStart = 0; blockStart < n; blockStart += blockSize) {
+            size_t blockEnd = std::min(blockStart + blockSize, n);
+            std::fill(partCounts.begin(), partCounts.end(), 0);
+            int parts = 1;
+            #pragma omp parallel num_threads(maxParts)
+            {
+                #pragma omp single
+                parts = omp_get_num_threads();
+                uint32_t* c = partCounts.data() + omp_get_thread_num() * pc * values;
+                #pragma omp for schedule(static)
+                for (size_t e = blockStart; e < blockEnd; e++) {
+                    for (size_t i = 0; i < pc; i++)
+                        c[i * values + (int(data[e * cc + c0 + i]) - offset)]++;
+                }
+            }
+            for (size_t i = 0; i < pc; i++) {
+                for (int p = 0; p < parts; p++) {
+                    const uint32_t* c = partCounts.data() + (p * pc + i) * values;
+                    for (size_t v = 0; v < values; v++)
+                        counts[c0 + i][v] += c[v];
+                }
+            }
+        }
+    }
+}
+
+void ValueCounts::init(const TGD::ArrayContainer& array)
+{
+    assert(supports(array.componentType()));
+    _type = array.componentType();
+    switch (_type) {
+    case TGD::int8:
+        countHelper<int8_t>(array, _counts);
+        break;
+    case TGD::uint8:
+        countHelper<uint8_t>(array, _counts);
+        break;
+    case TGD::int16:
+        countHelper<int16_t>(array, _counts);
+        break;
+    case TGD::uint16:
+        countHelper<uint16_t>(array, _counts);
+        break;
+    default:
+        break;
+    }
+}
+
+float ValueCounts::value(size_t index) const
+{
+    int offset = (_type == TGD::int8 ? std::numeric_limits<int8_t>::min()
+            : _type == TGD::int16 ? std::numeric_limits<int16_t>::min() : 0);
+    return int(index) + offset;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2025 Martin Lambers <marlam@marlam.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef QV_VALUECOUNTS_HPP
+#define QV_VALUECOUNTS_HPP
+
+#include <vector>
+
+#include <tgd/array.hpp>
+
+
+/* The number of occurrences of each value in each component of 8 or 16 bit
+ * integer data. It is computed in a single pass over the data by direct
+ * counting, and statistics and histograms of all components can be derived
+ * from it exactly without looking at the data again. */
+class ValueCounts {
+private:
+    TGD::Type _type;
+    std::vector<std::vector<unsigned long long>> _counts; // per component
+
+public:
+    ValueCounts();
+
+    // Whether value counts can be used for data of the given type
+    static bool supports(TGD::Type type);
+
+    void init(const TGD::ArrayContainer& array);
+    bool initialized() const { return _counts.size() > 0; }
+    void invalidate() { _counts.clear(); }
+
+    TGD::Type type() const { return _type; }
+    // The counts are indexed by the value minus the minimum value of the type
+    size_t size() const { return _counts[0].size(); }
+    float value(size_t index) const;
+    const std::vector<unsigned long long>& counts(size_t componentIndex) const { return _counts[componentIndex]; }
+};
+
+#endif